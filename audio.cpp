@@ -1,13 +1,34 @@
+#include <algorithm>
+#include <atomic>
+#include <exception>
 #include <vector>
-#include <queue>
 #include <memory>
 
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <openal/al.h>
 #include <openal/alc.h>
 #include <pthread.h>
+#include <sched.h>
+#include <sys/stat.h>
+
+#include "audio.h"
+#include "batch.h"
+#include "convert.h"
+#include "graph.h"
+#include "graphfile.h"
+#include "livegraph.h"
+#include "offline.h"
+#include "resample.h"
+#include "realtime.h"
+#include "ringbuffer.h"
+#include "samplecache.h"
+#include "samplefile.h"
+#include "samplestream.h"
+#include "sink.h"
+#include "stats.h"
 
 #define CHECK_AL_ERRORS(func) \
     { \
@@ -43,72 +64,277 @@
         } \
     }
 
+// AL_SOFT_events is only declared by OpenAL Soft's alext.h, which the system
+// OpenAL on Mac OS X doesn't ship, so we declare what we use ourselves and
+// look the functions up at runtime
+#ifndef AL_APIENTRY
+#define AL_APIENTRY
+#endif
+
+#ifndef AL_SOFT_events
+#define AL_SOFT_events 1
+#define AL_EVENT_CALLBACK_FUNCTION_SOFT 0x19A2
+#define AL_EVENT_CALLBACK_USER_PARAM_SOFT 0x19A3
+#define AL_EVENT_TYPE_BUFFER_COMPLETED_SOFT 0x19A4
+#define AL_EVENT_TYPE_SOURCE_STATE_CHANGED_SOFT 0x19A5
+#define AL_EVENT_TYPE_DISCONNECTED_SOFT 0x19A6
+typedef void (AL_APIENTRY*ALEVENTPROCSOFT)(ALenum eventType, ALuint object, ALuint param, ALsizei length, const ALchar *message, void *userParam);
+typedef void (AL_APIENTRY*LPALEVENTCONTROLSOFT)(ALsizei count, const ALenum *types, ALboolean enable);
+typedef void (AL_APIENTRY*LPALEVENTCALLBACKSOFT)(ALEVENTPROCSOFT callback, void *userParam);
+#endif
+
+#ifndef AL_SOFT_source_latency
+#define AL_SOFT_source_latency 1
+#define AL_SAMPLE_OFFSET_LATENCY_SOFT 0x1200
+#define AL_SEC_OFFSET_LATENCY_SOFT 0x1201
+typedef int64_t ALint64SOFT;
+typedef void (AL_APIENTRY*LPALGETSOURCEI64VSOFT)(ALuint source, ALenum param, ALint64SOFT *values);
+#endif
+
+enum SampleType {
+    SAMPLE_INT16,
+    SAMPLE_FLOAT32
+};
+
 struct AudioFrame {
     int sampleCount;
     int sampleRate;
     int channelCount;
+    SampleType sampleType;
 
+    // only the vector matching sampleType holds data
     std::vector<int16_t> samples;
+    std::vector<float> floatSamples;
+
+    // monotonic time the producer queued the frame at, for the stats
+    int64_t pushTime;
 };
 
-class AudioRenderer {
-    private:
-        static const int numBuffers = 5;
 
-        std::queue<AudioFrame *> audioQueue;
+class AudioRenderer;
 
-        int queuedSampleCount;
-        int bufferedSampleCount;
-        float secondsPlayed;
+// The OpenAL device and context, shared by all renderers in the process. The
+// first renderer that starts opens them and the last one that stops closes
+// them again.
+class AudioDevice {
+    private:
+        // serializes starting and stopping renderers
+        pthread_mutex_t mutex;
+        int users;
 
         ALCdevice *device;
         ALCcontext *context;
 
-        ALuint buffers[numBuffers];
+        // AL_SOFT_events has one callback per context, it passes buffer
+        // completions on to every renderer under its own lock so OpenAL's
+        // event thread never waits for a device being opened or closed
+        bool eventsSupported;
+        pthread_mutex_t renderersMutex;
+        std::vector<AudioRenderer *> renderers;
+
+        static void AL_APIENTRY eventCallbackTrampoline(ALenum eventType, ALuint object, ALuint param, ALsizei length, const ALchar *message, void *audioDevice);
+
+        bool open();
+        void close();
+        void setupEvents();
+        void handleEvent(ALenum eventType, ALuint object, ALuint param);
+    public:
+        AudioDevice();
+
+        // returns false if the device can't be opened
+        bool acquire(AudioRenderer *renderer);
+        void release(AudioRenderer *renderer);
+
+        bool supportsEvents();
+};
+
+class AudioRenderer : public AudioSink {
+    friend class AudioDevice;
+
+    private:
+        // frames waiting in front of the OpenAL buffers, about 1.5 seconds
+        // of audio with the default settings
+        static const int queueCapacity = 64;
+
+        AudioConfig config;
+
+        // format of the samples uploaded to OpenAL, the formats for float
+        // samples come from AL_EXT_FLOAT32
+        SampleType outputType;
+        ALenum monoFloatFormat;
+        ALenum stereoFloatFormat;
+
+        // all frames are allocated up front and travel between the producer
+        // and the audio thread through these two queues
+        std::vector<AudioFrame> framePool;
+        SpscQueue<AudioFrame *> audioQueue;
+        SpscQueue<AudioFrame *> freeFrames;
+        EventSignal frameAvailable;
+        EventSignal frameReleased;
+
+        // frame handed out by acquireWriteBlock, owned by the producer
+        AudioFrame *writeFrame;
+
+        // a write block given back unplayed, the producer takes it before the
+        // pool. freeFrames only has the audio thread pushing, so the
+        // producer can't put it back there.
+        AudioFrame *spareFrame;
+
+        // frames that don't match the output format are resampled and
+        // channel mapped into convertedFrame before upload, all of this is
+        // only touched by the audio thread
+        FormatConverter converter;
+        AudioFrame convertedFrame;
+        std::vector<float> conversionInput;
+        std::vector<float> conversionOutput;
+
+        std::atomic<int> queuedSampleCount;
+        std::atomic<int> bufferedSampleCount;
+
+        // playback clock, samples of all buffers that have been unqueued plus
+        // the source offset into the buffers that are still queued. The audio
+        // thread makes the sequence odd while it unqueues so readers know to
+        // retry instead of seeing the offset drop before the count goes up.
+        std::atomic<unsigned> clockSequence;
+        std::atomic<int64_t> processedSampleCount;
+        std::atomic<int64_t> clockOrigin;
+        std::atomic<int64_t> lastSamplePosition;
+
+        // sample offsets that account for the device latency, from
+        // AL_SOFT_source_latency if available
+        LPALGETSOURCEI64VSOFT getSourcei64v;
+
+        // set while the audio thread runs, clearing it makes the thread and
+        // a producer waiting for a free frame return
+        std::atomic<bool> running;
+
+        std::vector<ALuint> buffers;
         ALuint source;
 
+        // buffers currently queued on the source in playback order, only
+        // touched by the audio thread
+        std::vector<ALuint> queuedBuffers;
+        int queuedBufferHead;
+        int queuedBufferCount;
+
+        // buffer completion notifications from AL_SOFT_events, if available
+        bool eventsSupported;
+        std::atomic<int> completedBuffers;
+        EventSignal bufferCompleted;
+
         pthread_t thread;
-        pthread_mutex_t mutex;
-        pthread_cond_t cond;
+
+        // runtime statistics, see AudioStats
+        std::atomic<int64_t> underruns;
+        std::atomic<int64_t> framesUploaded;
+        ValueRange queueDepth;
+        std::atomic<int64_t> popFrameWait;
+        std::atomic<int64_t> bufferWait;
+        std::atomic<int64_t> acquireFrameWait;
+        DurationHistogram uploadLatency;
+        DurationHistogram renderTime;
+
+        // when the producer queued its last frame, 0 before the first one
+        int64_t lastPushTime;
 
         static void *audioThreadTrampoline(void *audioRenderer);
 
+        bool createSource();
+        void handleEvent(ALenum eventType, ALuint object, ALuint param);
+        long remainingBufferTime();
+        int bufferSampleCount(ALuint buffer);
+        int64_t sourceSampleOffset();
+
         void *audioThreadHandler();
 
+        AudioFrame *acquireFrame(int sampleCount, int sampleRate, int channelCount);
+        void enqueueFrame(AudioFrame *frame);
         AudioFrame *popFrame();
+        void releaseFrame(AudioFrame *frame);
+        AudioFrame *convertFrame(AudioFrame *frame);
         ALuint waitForProcessedBuffer();
         void consumeFrame(ALuint buffer, AudioFrame *frame);
     public:
         AudioRenderer();
         virtual ~AudioRenderer();
 
-        bool start();
+        // start from the thread that feeds (or while nothing does), stop
+        // from any thread, a producer feeding meanwhile gets no more frames
+        bool start(const AudioConfig &config);
         void stop();
 
-        void pushFrame(const int16_t *samples, int sampleCount, int sampleRate, int channelCount);
+        const AudioConfig &getConfig();
+        double getOutputLatency();
 
-        float getSecondsPlayed();
+        void pushFrame(const int16_t *samples, int sampleCount, int sampleRate, int channelCount);
+        void pushFrame(const float *samples, int sampleCount, int sampleRate, int channelCount);
+
+        // zero copy alternative to pushFrame, render straight into a frame
+        // from the pool using the configured rate and channel count, then
+        // commit it. Only the variant matching the output type returns a
+        // block, the other one returns nullptr.
+        bool usesFloatOutput();
+        int16_t *acquireWriteBlock(int frames);
+        float *acquireFloatWriteBlock(int frames);
+        void commitWriteBlock();
+        void releaseWriteBlock();
+
+        // position of the sample that is currently coming out of the device,
+        // counted from start or the last reset
+        int64_t getSamplePosition();
+        double getSecondsPlayed();
         void resetSecondsPlayed();
 
         int getBufferSize();
+
+        void getStats(AudioStats &stats);
+        void resetStats();
 };
 
-AudioRenderer::AudioRenderer() : queuedSampleCount(0), bufferedSampleCount(0), secondsPlayed(0), device(nullptr), context(nullptr) {
+// never destroyed, renderers created through the C API may still be running
+// when the statics go away at exit
+static AudioDevice audioDevice;
+
+AudioDevice::AudioDevice() : users(0), device(nullptr), context(nullptr), eventsSupported(false) {
+    pthread_mutex_init(&mutex, NULL);
+    pthread_mutex_init(&renderersMutex, NULL);
 }
 
-AudioRenderer::~AudioRenderer() {
-    // stop playback
-    if (context) {
-        stop();
+bool AudioDevice::acquire(AudioRenderer *renderer) {
+    pthread_mutex_lock(&mutex);
+
+    bool result = users > 0 || open();
+    if (result) {
+        users++;
+
+        pthread_mutex_lock(&renderersMutex);
+        renderers.push_back(renderer);
+        pthread_mutex_unlock(&renderersMutex);
     }
+
+    pthread_mutex_unlock(&mutex);
+    return result;
 }
 
-bool AudioRenderer::start() {
-    // if we already have a context then we are already started
-    if (context) {
-        return true;
+void AudioDevice::release(AudioRenderer *renderer) {
+    pthread_mutex_lock(&mutex);
+
+    pthread_mutex_lock(&renderersMutex);
+    renderers.erase(std::remove(renderers.begin(), renderers.end(), renderer), renderers.end());
+    pthread_mutex_unlock(&renderersMutex);
+
+    if (--users == 0) {
+        close();
     }
 
+    pthread_mutex_unlock(&mutex);
+}
+
+bool AudioDevice::supportsEvents() {
+    return eventsSupported;
+}
+
+bool AudioDevice::open() {
     device = alcOpenDevice(NULL);
     CHECK_ALC_ERRORS("alcOpenDevice");
 
@@ -124,76 +350,346 @@ bool AudioRenderer::start() {
     alDistanceModel(AL_NONE);
     CHECK_AL_ERRORS("alDistanceModel");
 
-    alGenBuffers(numBuffers, buffers);
-    CHECK_AL_ERRORS("alGenBuffers");
+    setupEvents();
 
-    alGenSources(1, &source);
-    CHECK_AL_ERRORS("alGenSources");
+    return true;
+}
 
-    pthread_mutex_init(&mutex, NULL);
-    pthread_cond_init(&cond, NULL);
+void AudioDevice::close() {
+    alcMakeContextCurrent(NULL);
+    alcDestroyContext(context);
+    alcCloseDevice(device);
+
+    context = nullptr;
+    device = nullptr;
+    eventsSupported = false;
+}
+
+void AL_APIENTRY AudioDevice::eventCallbackTrampoline(ALenum eventType, ALuint object, ALuint param, ALsizei, const ALchar *, void *audioDevice) {
+    ((AudioDevice *)audioDevice)->handleEvent(eventType, object, param);
+}
 
+void AudioDevice::setupEvents() {
+    if (!alIsExtensionPresent("AL_SOFT_events")) {
+        return;
+    }
+
+    auto eventControl = (LPALEVENTCONTROLSOFT)alGetProcAddress("alEventControlSOFT");
+    auto eventCallback = (LPALEVENTCALLBACKSOFT)alGetProcAddress("alEventCallbackSOFT");
+    if (!eventControl || !eventCallback) {
+        return;
+    }
+
+    eventCallback(eventCallbackTrampoline, this);
+    CHECK_AL_ERRORS_AND_IGNORE("alEventCallbackSOFT");
+
+    ALenum types[] = {AL_EVENT_TYPE_BUFFER_COMPLETED_SOFT};
+    eventControl(1, types, AL_TRUE);
+    CHECK_AL_ERRORS_AND_IGNORE("alEventControlSOFT");
+
+    eventsSupported = true;
+}
+
+void AudioDevice::handleEvent(ALenum eventType, ALuint object, ALuint param) {
+    // every renderer checks whether the buffer belongs to its source
+    pthread_mutex_lock(&renderersMutex);
+    for (AudioRenderer *renderer : renderers) {
+        renderer->handleEvent(eventType, object, param);
+    }
+    pthread_mutex_unlock(&renderersMutex);
+}
+
+AudioRenderer::AudioRenderer() : outputType(SAMPLE_INT16), monoFloatFormat(AL_NONE), stereoFloatFormat(AL_NONE), framePool(queueCapacity), audioQueue(queueCapacity), freeFrames(queueCapacity), writeFrame(nullptr), spareFrame(nullptr), queuedSampleCount(0), bufferedSampleCount(0), clockSequence(0), processedSampleCount(0), clockOrigin(0), lastSamplePosition(0), getSourcei64v(nullptr), running(false), source(0), queuedBufferHead(0), queuedBufferCount(0), eventsSupported(false), completedBuffers(0), underruns(0), framesUploaded(0), popFrameWait(0), bufferWait(0), acquireFrameWait(0), lastPushTime(0) {
+    audio_config_default(&config);
+}
+
+AudioRenderer::~AudioRenderer() {
+    // stop playback
+    stop();
+}
+
+bool AudioRenderer::start(const AudioConfig &config) {
+    if (running) {
+        return true;
+    }
+
+    if (config.bufferCount < 2 || config.framesPerBuffer <= 0 || config.sampleRate <= 0 || config.renderRate < 0 || config.channelCount < 1 || config.channelCount > 2) {
+        printf("AudioRenderer: invalid config (%d buffers of %d frames, %d Hz from %d Hz, %d channels)\n", config.bufferCount, config.framesPerBuffer, config.sampleRate, renderRate(config), config.channelCount);
+        return false;
+    }
+
+    this->config = config;
+
+    if (!audioDevice.acquire(this)) {
+        return false;
+    }
+
+    if (!createSource()) {
+        audioDevice.release(this);
+        return false;
+    }
+
+    eventsSupported = audioDevice.supportsEvents();
+
+    if (alIsExtensionPresent("AL_SOFT_source_latency")) {
+        getSourcei64v = (LPALGETSOURCEI64VSOFT)alGetProcAddress("alGetSourcei64vSOFT");
+    }
+
+    // upload float samples directly when the device can take them
+    outputType = SAMPLE_INT16;
+    if (config.floatOutput && alIsExtensionPresent("AL_EXT_FLOAT32")) {
+        monoFloatFormat = alGetEnumValue("AL_FORMAT_MONO_FLOAT32");
+        stereoFloatFormat = alGetEnumValue("AL_FORMAT_STEREO_FLOAT32");
+
+        if (monoFloatFormat != AL_NONE && stereoFloatFormat != AL_NONE) {
+            outputType = SAMPLE_FLOAT32;
+        }
+    }
+
+    // frames left over from the last run are simply forgotten, start is
+    // called from the producer's thread so it is the one consumer of
+    // freeFrames, and the audio thread that consumed audioQueue is gone
+    AudioFrame *leftover;
+    while (audioQueue.pop(leftover)) {
+    }
+    while (freeFrames.pop(leftover)) {
+    }
+    writeFrame = nullptr;
+    spareFrame = nullptr;
+    queuedSampleCount = 0;
+
+    // size the sample storage of the frame pool once so recycling frames
+    // never touches the heap, bigger frames still work but allocate
+    for (auto &frame : framePool) {
+        frame.sampleType = outputType;
+        if (outputType == SAMPLE_FLOAT32) {
+            frame.floatSamples.reserve(config.framesPerBuffer * config.channelCount);
+        } else {
+            frame.samples.reserve(config.framesPerBuffer * config.channelCount);
+        }
+
+        freeFrames.push(&frame);
+    }
+
+    // conversion buffers and the resampler for the render rate, a frame at
+    // another rate still makes these grow the first time it arrives
+    converter.setOutputFormat(config.sampleRate, config.channelCount);
+    converter.setQuality(config.resampleQuality);
+    converter.reserve(renderRate(config), config.framesPerBuffer);
+
+    // room for blocks at the render rate, even when it is lower than the
+    // output rate
+    int convertedSamples = std::max(config.framesPerBuffer * 2, converter.maxOutputFrames(config.framesPerBuffer, renderRate(config))) * config.channelCount;
+
+    convertedFrame.sampleType = outputType;
+    if (outputType == SAMPLE_FLOAT32) {
+        convertedFrame.floatSamples.reserve(convertedSamples);
+    } else {
+        convertedFrame.samples.reserve(convertedSamples);
+        conversionOutput.reserve(convertedSamples);
+    }
+
+    conversionInput.reserve(config.framesPerBuffer * 2);
+
+    if (config.lockMemory) {
+        lockMemory();
+    }
+
+    running = true;
     pthread_create(&thread, NULL, audioThreadTrampoline, this);
 
     return true;
 }
 
+bool AudioRenderer::createSource() {
+    buffers.resize(config.bufferCount);
+    queuedBuffers.resize(config.bufferCount);
+
+    alGenBuffers(config.bufferCount, buffers.data());
+    CHECK_AL_ERRORS("alGenBuffers");
+
+    alGenSources(1, &source);
+    // like CHECK_AL_ERRORS but the buffers made above go again
+    ALenum error = alGetError();
+    if (error != AL_NO_ERROR) {
+        printf("alGenSources: %s", alGetString(error));
+        alDeleteBuffers(config.bufferCount, buffers.data());
+        return false;
+    }
+
+    return true;
+}
+
 void AudioRenderer::stop() {
-    // TODO: stub
-    //printf("AudioRenderer::stop() stub!\n");
+    if (!running) {
+        return;
+    }
+
+    // wake up the audio thread wherever it waits, and a producer that is
+    // waiting for a free frame
+    running = false;
+    frameAvailable.signal();
+    frameReleased.signal();
+    bufferCompleted.signal();
+
+    pthread_join(thread, NULL);
+
+    alSourceStop(source);
+    alSourcei(source, AL_BUFFER, 0);
+    alDeleteSources(1, &source);
+    alDeleteBuffers(config.bufferCount, buffers.data());
+    CHECK_AL_ERRORS_AND_IGNORE("alDeleteBuffers");
+
+    audioDevice.release(this);
+    source = 0;
+
+    // the frame queues are left to start, a producer can still be taking
+    // frames from freeFrames until it sees running drop
+    bufferedSampleCount = 0;
+    processedSampleCount = 0;
+    clockOrigin = 0;
+    lastSamplePosition = 0;
+
+    queuedBufferHead = 0;
+    queuedBufferCount = 0;
+    completedBuffers = 0;
+    lastPushTime = 0;
+
+    converter.reset();
+}
+
+const AudioConfig &AudioRenderer::getConfig() {
+    return config;
+}
+
+double AudioRenderer::getOutputLatency() {
+    // a frame that has just been uploaded plays after all other buffers
+    return (double)config.bufferCount * config.framesPerBuffer / renderRate(config);
 }
 
 void *AudioRenderer::audioThreadTrampoline(void *audioRenderer) {
     return ((AudioRenderer *)audioRenderer)->audioThreadHandler();
 }
 
+void AudioRenderer::handleEvent(ALenum eventType, ALuint object, ALuint param) {
+    // this runs on OpenAL's event thread, wake up the audio thread if one of
+    // our buffers has finished playing
+    if (eventType == AL_EVENT_TYPE_BUFFER_COMPLETED_SOFT && object == source) {
+        completedBuffers += param;
+        bufferCompleted.signal();
+    }
+}
+
 AudioFrame *AudioRenderer::popFrame() {
-    pthread_mutex_lock(&mutex);
+    AudioFrame *frame = nullptr;
 
-    // block until there is something in the queue
-    while (audioQueue.empty()) {
-        int err = pthread_cond_wait(&cond, &mutex);
-        if (err) {
-            printf("AudioRenderer cond wait error: %s", strerror(err));
-            return nullptr;
-        }
-    }
+    queueDepth.record((int)audioQueue.size());
+    int64_t start = monotonicNanoseconds();
+
+    // block until there is something in the queue, returns NULL when the
+    // renderer stops
+    frameAvailable.wait([&]() { return audioQueue.pop(frame) || !running; });
+
+    popFrameWait.fetch_add(monotonicNanoseconds() - start, std::memory_order_relaxed);
 
-    // remove first element
-    auto frame = audioQueue.front();
-    audioQueue.pop();
+    if (!frame) {
+        return nullptr;
+    }
 
     // reduce number of samples in queue
     queuedSampleCount -= frame->sampleCount;
 
-    pthread_mutex_unlock(&mutex);
     return frame;
 }
 
+void AudioRenderer::releaseFrame(AudioFrame *frame) {
+    // hand the frame back to the producer
+    freeFrames.push(frame);
+    frameReleased.signal();
+}
+
+AudioFrame *AudioRenderer::convertFrame(AudioFrame *frame) {
+    // the converter works on float samples
+    const float *input = frame->floatSamples.data();
+    if (frame->sampleType == SAMPLE_INT16) {
+        conversionInput.resize(frame->sampleCount * frame->channelCount);
+        convertToFloat(conversionInput.data(), frame->samples.data(), conversionInput.size());
+        input = conversionInput.data();
+    }
+
+    int maxFrames = converter.maxOutputFrames(frame->sampleCount, frame->sampleRate);
+    int frames;
+
+    if (outputType == SAMPLE_FLOAT32) {
+        convertedFrame.floatSamples.resize(maxFrames * config.channelCount);
+        frames = converter.process(input, frame->sampleCount, frame->sampleRate, frame->channelCount, convertedFrame.floatSamples.data());
+        convertedFrame.floatSamples.resize(frames * config.channelCount);
+    } else {
+        conversionOutput.resize(maxFrames * config.channelCount);
+        frames = converter.process(input, frame->sampleCount, frame->sampleRate, frame->channelCount, conversionOutput.data());
+        convertedFrame.samples.resize(frames * config.channelCount);
+        convertToInt16(convertedFrame.samples.data(), conversionOutput.data(), convertedFrame.samples.size());
+    }
+
+    convertedFrame.sampleCount = frames;
+    convertedFrame.sampleRate = config.sampleRate;
+    convertedFrame.channelCount = config.channelCount;
+
+    return &convertedFrame;
+}
+
 void AudioRenderer::consumeFrame(ALuint buffer, AudioFrame *frame) {
-    ALenum format = frame->channelCount == 1 ? AL_FORMAT_MONO16 : AL_FORMAT_STEREO16;
-    ALsizei size = frame->sampleCount * frame->channelCount * (ALsizei)sizeof(int16_t);
+    // every buffer gets the output format so the source never has to be
+    // stopped for a format change, frames in another format are converted
+    AudioFrame *upload = frame;
+    if (frame->sampleRate != config.sampleRate || frame->channelCount != config.channelCount) {
+        upload = convertFrame(frame);
+    } else {
+        converter.reset();
+    }
+
+    if (upload->sampleType == SAMPLE_FLOAT32) {
+        ALenum format = upload->channelCount == 1 ? monoFloatFormat : stereoFloatFormat;
+        ALsizei size = upload->sampleCount * upload->channelCount * (ALsizei)sizeof(float);
+
+        alBufferData(buffer, format, upload->floatSamples.data(), size, upload->sampleRate);
+        CHECK_AL_ERRORS_AND_IGNORE("alBufferData");
+    } else {
+        ALenum format = upload->channelCount == 1 ? AL_FORMAT_MONO16 : AL_FORMAT_STEREO16;
+        ALsizei size = upload->sampleCount * upload->channelCount * (ALsizei)sizeof(int16_t);
+
+        alBufferData(buffer, format, upload->samples.data(), size, upload->sampleRate);
+        CHECK_AL_ERRORS_AND_IGNORE("alBufferData");
+    }
 
-    alBufferData(buffer, format, frame->samples.data(), size, frame->sampleRate);
-    CHECK_AL_ERRORS_AND_IGNORE("alBufferData");
+    uploadLatency.record(monotonicNanoseconds() - frame->pushTime);
+    framesUploaded.fetch_add(1, std::memory_order_relaxed);
 
     alSourceQueueBuffers(source, 1, &buffer);
     CHECK_AL_ERRORS_AND_IGNORE("alSourceQueueBuffers");
 
-    pthread_mutex_lock(&mutex);
-    bufferedSampleCount += frame->sampleCount;
-    secondsPlayed += frame->sampleCount * 1.0f / frame->sampleRate;
-    pthread_mutex_unlock(&mutex);
+    queuedBuffers[(queuedBufferHead + queuedBufferCount) % config.bufferCount] = buffer;
+    queuedBufferCount++;
+
+    bufferedSampleCount += upload->sampleCount;
 
-    delete frame;
+    // OpenAL has copied the samples so the frame can be reused
+    releaseFrame(frame);
 }
 
 ALuint AudioRenderer::waitForProcessedBuffer() {
     ALint processedCount;
     ALuint buffer;
 
-    // wait until there is an empty audio buffer available
+    int64_t start = monotonicNanoseconds();
+
+    // wait until there is an empty audio buffer available, 0 (which is
+    // never a buffer name) means the renderer stops
     for (;;) {
+        if (!running) {
+            return 0;
+        }
+
         alGetSourcei(source, AL_BUFFERS_PROCESSED, &processedCount);
         CHECK_AL_ERRORS_AND_IGNORE("alGetSourcei");
 
@@ -201,14 +697,42 @@ ALuint AudioRenderer::waitForProcessedBuffer() {
             break;
         }
 
-        usleep(100);
+        long remaining = remainingBufferTime();
+
+        if (eventsSupported) {
+            // sleep until OpenAL reports a completed buffer, the timeout only
+            // guards against a lost event
+            bufferCompleted.waitFor([&]() { return completedBuffers.exchange(0) > 0 || !running; }, remaining * 2);
+        } else {
+            // sleep until the playing buffer should be done
+            usleep(remaining);
+        }
     }
 
-    // get a buffer
+    bufferWait.fetch_add(monotonicNanoseconds() - start, std::memory_order_relaxed);
+
+    // get a buffer, moving its samples from the source offset into the
+    // processed count while the clock readers are told to hold off
+    int samples = bufferSampleCount(queuedBuffers[queuedBufferHead]);
+
+    clockSequence++;
+
     alSourceUnqueueBuffers(source, 1, &buffer);
-    CHECK_AL_ERRORS("alSourceUnqueueBuffers");
+    CHECK_AL_ERRORS_AND_IGNORE("alSourceUnqueueBuffers");
+
+    processedSampleCount += samples;
+    clockSequence++;
+
+    queuedBufferHead = (queuedBufferHead + 1) % config.bufferCount;
+    queuedBufferCount--;
 
     // update the number of currently buffered samples
+    bufferedSampleCount -= samples;
+
+    return buffer;
+}
+
+int AudioRenderer::bufferSampleCount(ALuint buffer) {
     ALint size;
     alGetBufferi(buffer, AL_SIZE, &size);
 
@@ -218,155 +742,866 @@ ALuint AudioRenderer::waitForProcessedBuffer() {
     ALint bits;
     alGetBufferi(buffer, AL_BITS, &bits);
 
-    int samples = size * 8 / (channels * bits);
-    pthread_mutex_lock(&mutex);
-    bufferedSampleCount -= samples;
-    pthread_mutex_unlock(&mutex);
+    return size * 8 / (channels * bits);
+}
 
-    return buffer;
+int64_t AudioRenderer::sourceSampleOffset() {
+    if (getSourcei64v) {
+        // 32.32 fixed point offset and the latency in nanoseconds, together
+        // they give the sample that is actually being heard
+        ALint64SOFT values[2];
+        getSourcei64v(source, AL_SAMPLE_OFFSET_LATENCY_SOFT, values);
+
+        return (values[0] >> 32) - values[1] * config.sampleRate / 1000000000;
+    }
+
+    ALint offset;
+    alGetSourcei(source, AL_SAMPLE_OFFSET, &offset);
+
+    return offset;
 }
 
-void *AudioRenderer::audioThreadHandler() {
-    // prebuffer audio
-    for (int i=0; i<numBuffers; ++i) {
-        consumeFrame(buffers[i], popFrame());
+long AudioRenderer::remainingBufferTime() {
+    // never poll faster than this
+    const long minimumWait = 100;
+
+    if (queuedBufferCount == 0) {
+        return minimumWait;
     }
 
-    for (;;) {
-        AudioFrame *frame;
+    // nothing has been processed yet, so the front of the queue is the
+    // buffer that is playing and the sample offset lies within it
+    ALuint buffer = queuedBuffers[queuedBufferHead];
 
-        alSourcePlay(source);
-        CHECK_AL_ERRORS_AND_IGNORE("alSourcePlay");
+    ALint offset;
+    alGetSourcei(source, AL_SAMPLE_OFFSET, &offset);
+    CHECK_AL_ERRORS_AND_IGNORE("alGetSourcei");
 
-        // dequeue and consume audio frames
-        for (;;) {
-            ALuint buffer = waitForProcessedBuffer();
-            frame = popFrame();
+    ALint sampleRate;
+    alGetBufferi(buffer, AL_FREQUENCY, &sampleRate);
 
-            ALint sampleRate;
-            alGetBufferi(buffer, AL_FREQUENCY, &sampleRate);
+    int samples = bufferSampleCount(buffer);
+    long remaining = (samples - offset) * 1000000L / sampleRate;
 
-            ALint channelCount;
-            alGetBufferi(buffer, AL_CHANNELS, &channelCount);
+    return std::max(remaining, minimumWait);
+}
 
-            if (sampleRate != frame->sampleRate || channelCount != frame->channelCount) {
-                // format change, break out of loop to reset stream
-                break;
-            }
+void *AudioRenderer::audioThreadHandler() {
+    ThreadPolicy policy;
+    policy.priority = config.realtimePriority;
+    policy.cpu = config.cpu;
+    policy.flushDenormals = config.flushDenormals != 0;
+    policy.period = (double)config.framesPerBuffer / renderRate(config);
+    applyThreadPolicy(policy);
 
-            consumeFrame(buffer, frame);
+    // prebuffer audio
+    for (int i=0; i<config.bufferCount; ++i) {
+        AudioFrame *frame = popFrame();
+        if (!frame) {
+            return nullptr;
+        }
 
-            // restart the source if we are not playing anymore, this occurs
-            // when there is a buffer underrun
-            ALenum state;
-            alGetSourcei(source, AL_SOURCE_STATE, &state);
-            if (state != AL_PLAYING) {
-                alSourcePlay(source);
-                CHECK_AL_ERRORS_AND_IGNORE("alSourcePlay");
-            }
+        consumeFrame(buffers[i], frame);
+    }
+
+    alSourcePlay(source);
+    CHECK_AL_ERRORS_AND_IGNORE("alSourcePlay");
+
+    // dequeue and consume audio frames until the renderer stops
+    for (;;) {
+        ALuint buffer = waitForProcessedBuffer();
+        if (!buffer) {
+            break;
         }
 
-        // we only reach this section if the audio format has changed
-        alSourcei(source, AL_BUFFER, 0);
-        CHECK_AL_ERRORS_AND_IGNORE("alSourcei");
+        AudioFrame *frame = popFrame();
+        if (!frame) {
+            break;
+        }
 
-        alSourceStop(source);
-        CHECK_AL_ERRORS_AND_IGNORE("alSourceStop");
+        consumeFrame(buffer, frame);
 
-        consumeFrame(buffers[0], frame);
+        // restart the source if we are not playing anymore, this occurs
+        // when there is a buffer underrun
+        ALenum state;
+        alGetSourcei(source, AL_SOURCE_STATE, &state);
+        if (state != AL_PLAYING) {
+            underruns.fetch_add(1, std::memory_order_relaxed);
 
-        for (int i=1; i<numBuffers; ++i) {
-            consumeFrame(buffers[i], popFrame());
+            alSourcePlay(source);
+            CHECK_AL_ERRORS_AND_IGNORE("alSourcePlay");
         }
     }
 
     return nullptr;
 }
 
-void AudioRenderer::pushFrame(const int16_t *samples, int sampleCount, int sampleRate, int channelCount) {
-    // create frame
-    AudioFrame *frame = new AudioFrame;
+AudioFrame *AudioRenderer::acquireFrame(int sampleCount, int sampleRate, int channelCount) {
+    int64_t start = monotonicNanoseconds();
+    if (lastPushTime) {
+        renderTime.record(start - lastPushTime);
+    }
+
+    // take a frame from the pool, blocking until the audio thread has
+    // released one if all of them are in flight, NULL if the renderer isn't
+    // running
+    AudioFrame *frame = nullptr;
+    if (spareFrame && running) {
+        std::swap(frame, spareFrame);
+    } else {
+        frameReleased.wait([&]() { return freeFrames.pop(frame) || !running; });
+    }
+
+    acquireFrameWait.fetch_add(monotonicNanoseconds() - start, std::memory_order_relaxed);
+
+    if (!frame) {
+        return nullptr;
+    }
+
     frame->sampleCount = sampleCount;
     frame->sampleRate = sampleRate;
     frame->channelCount = channelCount;
 
-    // fill sample vector
-    size_t shortCount = sampleCount * channelCount;
-    frame->samples.reserve(shortCount);
-    for (int i=0; i<shortCount; ++i) {
-        frame->samples.push_back(samples[i]);
+    // resizing reuses the storage reserved at start
+    if (frame->sampleType == SAMPLE_FLOAT32) {
+        frame->floatSamples.resize(sampleCount * channelCount);
+    } else {
+        frame->samples.resize(sampleCount * channelCount);
     }
 
-    pthread_mutex_lock(&mutex);
+    return frame;
+}
 
-    // enqueue frame
-    audioQueue.push(frame);
+void AudioRenderer::pushFrame(const int16_t *samples, int sampleCount, int sampleRate, int channelCount) {
+    AudioFrame *frame = acquireFrame(sampleCount, sampleRate, channelCount);
+    if (!frame) {
+        return;
+    }
+
+    if (frame->sampleType == SAMPLE_FLOAT32) {
+        convertToFloat(frame->floatSamples.data(), samples, frame->floatSamples.size());
+    } else {
+        memcpy(frame->samples.data(), samples, frame->samples.size() * sizeof(int16_t));
+    }
+
+    enqueueFrame(frame);
+}
+
+void AudioRenderer::pushFrame(const float *samples, int sampleCount, int sampleRate, int channelCount) {
+    AudioFrame *frame = acquireFrame(sampleCount, sampleRate, channelCount);
+    if (!frame) {
+        return;
+    }
+
+    if (frame->sampleType == SAMPLE_FLOAT32) {
+        convertToFloat(frame->floatSamples.data(), samples, frame->floatSamples.size());
+    } else {
+        convertToInt16(frame->samples.data(), samples, frame->samples.size());
+    }
+
+    enqueueFrame(frame);
+}
+
+bool AudioRenderer::usesFloatOutput() {
+    return outputType == SAMPLE_FLOAT32;
+}
+
+int16_t *AudioRenderer::acquireWriteBlock(int frames) {
+    if (outputType != SAMPLE_INT16 || writeFrame) {
+        return nullptr;
+    }
+
+    writeFrame = acquireFrame(frames, renderRate(config), config.channelCount);
+    return writeFrame ? writeFrame->samples.data() : nullptr;
+}
 
-    // increase amount of samples in queue
+float *AudioRenderer::acquireFloatWriteBlock(int frames) {
+    if (outputType != SAMPLE_FLOAT32 || writeFrame) {
+        return nullptr;
+    }
+
+    writeFrame = acquireFrame(frames, renderRate(config), config.channelCount);
+    return writeFrame ? writeFrame->floatSamples.data() : nullptr;
+}
+
+void AudioRenderer::commitWriteBlock() {
+    if (writeFrame) {
+        enqueueFrame(writeFrame);
+        writeFrame = nullptr;
+    }
+}
+
+void AudioRenderer::releaseWriteBlock() {
+    if (writeFrame) {
+        spareFrame = writeFrame;
+        writeFrame = nullptr;
+    }
+}
+
+void AudioRenderer::enqueueFrame(AudioFrame *frame) {
+    frame->pushTime = monotonicNanoseconds();
+    lastPushTime = frame->pushTime;
+
+    // increase amount of samples in queue, this happens before the push so
+    // the consumer never sees a negative count
     queuedSampleCount += frame->sampleCount;
 
-    pthread_cond_signal(&cond);
-    pthread_mutex_unlock(&mutex);
+    // enqueue frame, the queue has a slot for every frame in the pool so
+    // this always succeeds
+    audioQueue.push(frame);
+    frameAvailable.signal();
 }
 
-float AudioRenderer::getSecondsPlayed() {
-    float result;
+int64_t AudioRenderer::getSamplePosition() {
+    if (!running) {
+        return 0;
+    }
 
-    pthread_mutex_lock(&mutex);
-    result = secondsPlayed;
-    pthread_mutex_unlock(&mutex);
+    int64_t position;
+    for (;;) {
+        unsigned sequence = clockSequence.load();
+        if (sequence & 1) {
+            // the audio thread is in the middle of unqueueing a buffer
+            sched_yield();
+            continue;
+        }
 
-    return result;
+        position = processedSampleCount.load() + sourceSampleOffset();
+
+        if (clockSequence.load() == sequence) {
+            break;
+        }
+    }
+
+    // the offset of a source that ran dry reads as zero until the audio
+    // thread catches up, never let the clock run backwards because of it
+    int64_t last = lastSamplePosition.load();
+    while (position > last && !lastSamplePosition.compare_exchange_weak(last, position)) {
+    }
+
+    return std::max(position, last) - clockOrigin.load();
+}
+
+double AudioRenderer::getSecondsPlayed() {
+    return (double)getSamplePosition() / config.sampleRate;
 }
 
 void AudioRenderer::resetSecondsPlayed() {
-    pthread_mutex_lock(&mutex);
-    secondsPlayed = 0; // FIXME: subtracting seconds still in buffer might give more accuracy. Unsure if this precision is really needed though.
-    pthread_mutex_unlock(&mutex);
+    // samples that are still buffered haven't been played yet and will count
+    // after the reset
+    clockOrigin += getSamplePosition();
 }
 
 int AudioRenderer::getBufferSize() {
-    int result;
+    // uploaded buffers hold frames at the output rate, queued ones are still
+    // at the render rate
+    int buffered = bufferedSampleCount;
+    if (config.renderRate > 0 && config.renderRate != config.sampleRate) {
+        buffered = (int)((int64_t)buffered * config.renderRate / config.sampleRate);
+    }
 
-    pthread_mutex_lock(&mutex);
-    result = bufferedSampleCount + queuedSampleCount;
-    pthread_mutex_unlock(&mutex);
+    return buffered + queuedSampleCount;
+}
 
-    return result;
+void AudioRenderer::getStats(AudioStats &stats) {
+    stats.underruns = underruns.load(std::memory_order_relaxed);
+    stats.framesUploaded = framesUploaded.load(std::memory_order_relaxed);
+
+    queueDepth.read(stats.queueDepthMin, stats.queueDepthMax, stats.queueDepthAverage);
+
+    stats.popFrameWaitSeconds = popFrameWait.load(std::memory_order_relaxed) * 1e-9;
+    stats.bufferWaitSeconds = bufferWait.load(std::memory_order_relaxed) * 1e-9;
+    stats.acquireFrameWaitSeconds = acquireFrameWait.load(std::memory_order_relaxed) * 1e-9;
+
+    uploadLatency.read(stats.uploadLatency);
+    renderTime.read(stats.renderTime);
+}
+
+void AudioRenderer::resetStats() {
+    underruns.store(0, std::memory_order_relaxed);
+    framesUploaded.store(0, std::memory_order_relaxed);
+
+    queueDepth.reset();
+
+    popFrameWait.store(0, std::memory_order_relaxed);
+    bufferWait.store(0, std::memory_order_relaxed);
+    acquireFrameWait.store(0, std::memory_order_relaxed);
+
+    uploadLatency.reset();
+    renderTime.reset();
 }
 
+// Collects fed samples into the block that is currently being filled, which
+// is a frame from the pool of the sink, so every sample is converted exactly
+// once on its way to OpenAL. Full blocks are committed right away.
+class FeedBuffer {
+    private:
+        AudioSink *sink;
+
+        // only one of the pointers is used depending on the output type
+        int16_t *block;
+        float *floatBlock;
+        size_t fill;
+    public:
+        FeedBuffer(AudioSink *sink) : sink(sink), block(nullptr), floatBlock(nullptr), fill(0) {
+        }
+
+        // a partly filled block of the previous sink is dropped, its frame
+        // goes back to that sink
+        void setSink(AudioSink *sink) {
+            if (fill > 0) {
+                this->sink->releaseWriteBlock();
+            }
+
+            this->sink = sink;
+            fill = 0;
+        }
+
+        AudioSink *getSink() const {
+            return sink;
+        }
+
+        // samples are dropped while the sink isn't running
+        template <typename T>
+        void feed(const T *samples, int count) {
+            const AudioConfig &config = sink->getConfig();
+            const size_t frameSize = config.framesPerBuffer * config.channelCount;
+            const bool floatOutput = sink->usesFloatOutput();
+
+            while (count > 0) {
+                if (fill == 0) {
+                    if (floatOutput) {
+                        floatBlock = sink->acquireFloatWriteBlock(config.framesPerBuffer);
+                    } else {
+                        block = sink->acquireWriteBlock(config.framesPerBuffer);
+                    }
+
+                    if (!(floatOutput ? (void *)floatBlock : (void *)block)) {
+                        return;
+                    }
+                }
+
+                size_t chunk = std::min((size_t)count, frameSize - fill);
+                if (floatOutput) {
+                    convertToFloat(floatBlock + fill, samples, chunk);
+                } else {
+                    convertToInt16(block + fill, samples, chunk);
+                }
+
+                samples += chunk;
+                count -= chunk;
+                fill += chunk;
+
+                if (fill == frameSize) {
+                    sink->commitWriteBlock();
+                    fill = 0;
+                }
+            }
+        }
+
+        // pushes a partly filled block as a shorter frame
+        void flush() {
+            if (fill == 0) {
+                return;
+            }
+
+            const AudioConfig &config = sink->getConfig();
+            if (sink->usesFloatOutput()) {
+                sink->pushFrame(floatBlock, fill / config.channelCount, renderRate(config), config.channelCount);
+            } else {
+                sink->pushFrame(block, fill / config.channelCount, renderRate(config), config.channelCount);
+            }
+
+            // the samples were copied out of the block
+            sink->releaseWriteBlock();
+            fill = 0;
+        }
+};
+
+// A renderer of its own for the handle API, it is also the sink that the
+// output nodes of a graph can feed. The handle and every graph set to it
+// hold a reference, the last one to let go deletes it.
+class RendererHandle : public CacheAligned, public SampleSink {
+    private:
+        std::atomic<int> references;
+    public:
+        AudioRenderer renderer;
+        FeedBuffer feedBuffer;
+
+        RendererHandle() : references(1), feedBuffer(&renderer) {
+        }
+
+        void write(const float *samples, size_t count) {
+            feedBuffer.feed(samples, (int)count);
+        }
+
+        void retain() {
+            references.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void release() {
+            if (references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                delete this;
+            }
+        }
+};
+
 static AudioRenderer audioRenderer;
-std::vector<int16_t> prebuffer;
+static OfflineRenderer offlineRenderer;
+
+// where the feed functions and the clock go, the device unless rendering
+// offline
+static AudioSink *audioSink = &audioRenderer;
+static FeedBuffer feedBuffer(&audioRenderer);
 
 extern "C" {
+    void audio_config_default(AudioConfig *config) {
+        config->bufferCount = 5;
+        config->framesPerBuffer = 1024;
+        config->sampleRate = 44100;
+        config->channelCount = 1;
+        config->floatOutput = 1;
+
+        config->realtimePriority = 0;
+        config->cpu = -1;
+        config->flushDenormals = 1;
+        config->lockMemory = 0;
+
+        config->renderRate = 0;
+        config->resampleQuality = AUDIO_RESAMPLE_MEDIUM;
+    }
+
+    void audio_config_low_latency(AudioConfig *config) {
+        // about 17 ms at 44.1 kHz, needs a producer that never misses a beat
+        // and an audio thread that doesn't get preempted
+        audio_config_default(config);
+        config->bufferCount = 3;
+        config->framesPerBuffer = 256;
+        config->realtimePriority = 70;
+        config->lockMemory = 1;
+        config->resampleQuality = AUDIO_RESAMPLE_FAST;
+    }
+
+    void audio_config_throughput(AudioConfig *config) {
+        // about 740 ms at 44.1 kHz, rides out long stalls of the producer
+        audio_config_default(config);
+        config->bufferCount = 8;
+        config->framesPerBuffer = 4096;
+        config->resampleQuality = AUDIO_RESAMPLE_BEST;
+    }
+
     void audio_init() {
+        AudioConfig config;
+        audio_config_default(&config);
+
+        audio_init_ex(&config);
+    }
+
+    int audio_init_rate(int renderRate) {
+        AudioConfig config;
+        audio_config_default(&config);
+        config.renderRate = renderRate;
+
+        return audio_init_ex(&config);
+    }
+
+    int audio_init_ex(const AudioConfig *config) {
         printf("initializing audio\n");
 
-        audioRenderer.start();
+        if (!audioRenderer.start(*config)) {
+            return 0;
+        }
+
+        audioSink = &audioRenderer;
+        feedBuffer.setSink(audioSink);
+
+        printf("audio output latency: %.1f ms\n", audioRenderer.getOutputLatency() * 1000.0);
+        return 1;
+    }
+
+    int audio_init_offline(const AudioConfig *config, const char *path, int format, int direct) {
+        printf("initializing offline rendering to %s\n", path);
+
+        AudioConfig defaultConfig;
+        if (!config) {
+            audio_config_default(&defaultConfig);
+            config = &defaultConfig;
+        }
+
+        if (!offlineRenderer.start(*config, path, format, direct != 0)) {
+            return 0;
+        }
+
+        audioSink = &offlineRenderer;
+        feedBuffer.setSink(audioSink);
+
+        return 1;
     }
 
     void audio_deinit() {
         printf("deinitializing audio\n");
 
-        audioRenderer.stop();
+        if (audioSink == &offlineRenderer) {
+            // the file should have every sample, including a block that was
+            // only partly fed
+            feedBuffer.flush();
+
+            offlineRenderer.stop();
+            audioSink = &audioRenderer;
+        } else {
+            audioRenderer.stop();
+        }
+
+        feedBuffer.setSink(audioSink);
     }
 
     void audio_feed_sample(double sample) {
-        prebuffer.push_back((int16_t)(sample * 32767.0));
-        if (prebuffer.size() == 1024) {
-            audioRenderer.pushFrame(prebuffer.data(), 1024, 44100, 1);
-            prebuffer.clear();
-        }
+        feedBuffer.feed(&sample, 1);
+    }
+
+    void audio_feed_block(const double *samples, int count) {
+        feedBuffer.feed(samples, count);
+    }
+
+    void audio_feed_block_float(const float *samples, int count) {
+        feedBuffer.feed(samples, count);
     }
 
     int audio_get_buffer_size() {
-        return audioRenderer.getBufferSize();
+        return audioSink->getBufferSize();
+    }
+
+    double audio_get_output_latency() {
+        return audioSink->getOutputLatency();
+    }
+
+    long long audio_get_sample_position() {
+        return audioSink->getSamplePosition();
+    }
+
+    double audio_get_seconds_played() {
+        return audioSink->getSecondsPlayed();
+    }
+
+    void audio_reset_clock() {
+        audioSink->resetSecondsPlayed();
+    }
+
+    void audio_get_stats(AudioStats *stats) {
+        audioRenderer.getStats(*stats);
+    }
+
+    void audio_reset_stats() {
+        audioRenderer.resetStats();
+    }
+
+    AudioRendererHandle *audio_renderer_create(const AudioConfig *config) {
+        AudioConfig defaultConfig;
+        if (!config) {
+            audio_config_default(&defaultConfig);
+            config = &defaultConfig;
+        }
+
+        RendererHandle *handle = new RendererHandle();
+        if (!handle->renderer.start(*config)) {
+            delete handle;
+            return NULL;
+        }
+
+        return (AudioRendererHandle *)handle;
+    }
+
+    void audio_renderer_destroy(AudioRendererHandle *renderer) {
+        // graphs still set to it write into the stopped renderer, which drops
+        // the samples, until they let go of it
+        RendererHandle *handle = (RendererHandle *)renderer;
+        handle->renderer.stop();
+        handle->release();
+    }
+
+    void audio_renderer_feed(AudioRendererHandle *renderer, const float *samples, int count) {
+        ((RendererHandle *)renderer)->feedBuffer.feed(samples, count);
+    }
+
+    int audio_renderer_get_buffer_size(AudioRendererHandle *renderer) {
+        return ((RendererHandle *)renderer)->renderer.getBufferSize();
+    }
+
+    long long audio_renderer_get_sample_position(AudioRendererHandle *renderer) {
+        return ((RendererHandle *)renderer)->renderer.getSamplePosition();
+    }
+
+    void audio_renderer_get_stats(AudioRendererHandle *renderer, AudioStats *stats) {
+        ((RendererHandle *)renderer)->renderer.getStats(*stats);
     }
 
     void audio_sleep(double delay) {
         usleep(delay * 1000000);
     }
 
+    const float *audio_map_samples(const char *path, int *count) {
+        size_t sampleCount;
+        const float *samples = mapSampleFile(path, &sampleCount);
+
+        *count = (int)sampleCount;
+        return samples;
+    }
+
+    void audio_unmap_samples(const float *samples, int count) {
+        unmapSampleFile(samples, count);
+    }
+
+    int audio_get_sample_count(const char *path) {
+        struct stat info;
+        if (stat(path, &info) != 0) {
+            return -1;
+        }
+
+        return (int)(info.st_size / sizeof(float));
+    }
+
+    int audio_read_samples(const char *path, double *buffer, int capacity) {
+        MappedSampleFile file;
+        if (!file.open(path)) {
+            return -1;
+        }
+
+        int count = std::min((int)file.size(), capacity);
+        const float *samples = file.data();
+        for (int i=0; i<count; ++i) {
+            buffer[i] = samples[i];
+        }
+
+        return count;
+    }
+
+    int audio_read_samples_float(const char *path, float *buffer, int capacity) {
+        MappedSampleFile file;
+        if (!file.open(path)) {
+            return -1;
+        }
+
+        int count = std::min((int)file.size(), capacity);
+        memcpy(buffer, file.data(), count * sizeof(float));
+
+        return count;
+    }
+
+    AudioSamplesHandle *audio_samples_acquire(const char *path, int decode) {
+        SampleRef samples = sampleCache().acquire(path, decode != 0);
+        if (!samples) {
+            return NULL;
+        }
+
+        return (AudioSamplesHandle *)new SampleRef(samples);
+    }
+
+    void audio_samples_release(AudioSamplesHandle *samples) {
+        delete (SampleRef *)samples;
+    }
+
+    int audio_samples_get_count(AudioSamplesHandle *samples) {
+        return (int)(*(SampleRef *)samples)->size();
+    }
+
+    const float *audio_samples_get_data(AudioSamplesHandle *samples) {
+        return (*(SampleRef *)samples)->data();
+    }
+
+    const double *audio_samples_get_doubles(AudioSamplesHandle *samples) {
+        return (*(SampleRef *)samples)->doubles();
+    }
+
+    void audio_sample_cache_set_budget(long long bytes) {
+        sampleCache().setBudget(bytes > 0 ? (size_t)bytes : 0);
+    }
+
+    long long audio_sample_cache_get_size() {
+        return (long long)sampleCache().getSize();
+    }
+
+    SampleStreamHandle *audio_stream_open(const char *path, int chunkSize, int chunkCount) {
+        // 4 chunks of 4096 samples keep about 370 ms of mono 44.1 kHz audio
+        // in memory, enough to ride out a slow disk
+        SampleStream *stream = new SampleStream(chunkSize > 0 ? chunkSize : 4096, chunkCount > 0 ? chunkCount : 4);
+        if (!stream->open(path)) {
+            delete stream;
+            return NULL;
+        }
+
+        return (SampleStreamHandle *)stream;
+    }
+
+    int audio_stream_read(SampleStreamHandle *stream, double *buffer, int count) {
+        return (int)((SampleStream *)stream)->read(buffer, count);
+    }
+
+    int audio_stream_read_float(SampleStreamHandle *stream, float *buffer, int count) {
+        return (int)((SampleStream *)stream)->read(buffer, count);
+    }
+
+    int audio_stream_get_length(SampleStreamHandle *stream) {
+        return (int)((SampleStream *)stream)->length();
+    }
+
+    long long audio_stream_get_underruns(SampleStreamHandle *stream) {
+        return (long long)((SampleStream *)stream)->getUnderrunCount();
+    }
+
+    void audio_stream_close(SampleStreamHandle *stream) {
+        delete (SampleStream *)stream;
+    }
+
+    AudioGraphHandle *audio_graph_create(int sampleRate, int blockSize) {
+        if (sampleRate <= 0 || blockSize <= 0) {
+            return NULL;
+        }
+
+        return (AudioGraphHandle *)new AudioGraph(sampleRate, blockSize);
+    }
+
+    void audio_graph_destroy(AudioGraphHandle *graph) {
+        delete (AudioGraph *)graph;
+    }
+
+    int audio_graph_add_node(AudioGraphHandle *graph, int type) {
+        return ((AudioGraph *)graph)->addNode(type);
+    }
+
+    int audio_graph_set_input(AudioGraphHandle *graph, int node, int input, int buffer) {
+        return ((AudioGraph *)graph)->setInput(node, input, buffer) ? 0 : -1;
+    }
+
+    int audio_graph_set_output(AudioGraphHandle *graph, int node, int buffer) {
+        return ((AudioGraph *)graph)->setOutput(node, buffer) ? 0 : -1;
+    }
+
+    int audio_graph_set_param(AudioGraphHandle *graph, int node, int param, double value) {
+        return ((AudioGraph *)graph)->setParam(node, param, value) ? 0 : -1;
+    }
+
+    int audio_graph_set_sample_file(AudioGraphHandle *graph, int node, const char *path) {
+        return ((AudioGraph *)graph)->setSampleFile(node, path) ? 0 : -1;
+    }
+
+    int audio_graph_schedule_param(AudioGraphHandle *graph, int node, int param, double value, long long frame, int rampFrames, int curve) {
+        return ((AudioGraph *)graph)->scheduleParam(node, param, value, frame, rampFrames, curve) ? 0 : -1;
+    }
+
+    long long audio_graph_get_position(AudioGraphHandle *graph) {
+        return ((AudioGraph *)graph)->getPosition();
+    }
+
+    int audio_graph_set_node_key(AudioGraphHandle *graph, int node, int key) {
+        return ((AudioGraph *)graph)->setNodeKey(node, key) ? 0 : -1;
+    }
+
+    // nothing may throw through to the caller, which is C
+    int audio_graph_save(AudioGraphHandle *graph, const char *path) {
+        try {
+            return saveGraphFile(*(AudioGraph *)graph, path) ? 0 : -1;
+        } catch (const std::exception &error) {
+            printf("audio_graph_save: %s\n", error.what());
+            return -1;
+        }
+    }
+
+    AudioGraphHandle *audio_graph_load(const char *path) {
+        try {
+            return (AudioGraphHandle *)loadGraphFile(path);
+        } catch (const std::exception &error) {
+            printf("audio_graph_load: %s\n", error.what());
+            return NULL;
+        }
+    }
+
+    int audio_graph_get_sample_rate(AudioGraphHandle *graph) {
+        return ((AudioGraph *)graph)->getSampleRate();
+    }
+
+    void audio_graph_set_thread_count(AudioGraphHandle *graph, int threadCount) {
+        if (threadCount <= 0) {
+            threadCount = sysconf(_SC_NPROCESSORS_ONLN);
+        }
+
+        ((AudioGraph *)graph)->setThreadCount(threadCount);
+    }
+
+    void audio_graph_set_thread_policy(AudioGraphHandle *graph, int priority, int firstCpu) {
+        ThreadPolicy policy;
+        policy.priority = priority;
+        policy.cpu = firstCpu;
+        policy.flushDenormals = true;
+
+        ((AudioGraph *)graph)->setThreadPolicy(policy);
+    }
+
+    void audio_graph_set_renderer(AudioGraphHandle *graph, AudioRendererHandle *renderer) {
+        ((AudioGraph *)graph)->setSink((RendererHandle *)renderer);
+    }
+
+    void audio_graph_render(AudioGraphHandle *graph, int frames) {
+        ((AudioGraph *)graph)->render(frames);
+    }
+
+    AudioLiveGraphHandle *audio_live_graph_create(AudioGraphHandle *graph) {
+        return (AudioLiveGraphHandle *)new LiveGraph((AudioGraph *)graph);
+    }
+
+    void audio_live_graph_destroy(AudioLiveGraphHandle *live) {
+        delete (LiveGraph *)live;
+    }
+
+    int audio_live_graph_swap(AudioLiveGraphHandle *live, AudioGraphHandle *graph, int crossfadeFrames) {
+        return ((LiveGraph *)live)->swap((AudioGraph *)graph, std::max(crossfadeFrames, 0)) ? 0 : -1;
+    }
+
+    void audio_live_graph_set_renderer(AudioLiveGraphHandle *live, AudioRendererHandle *renderer) {
+        ((LiveGraph *)live)->setSink((RendererHandle *)renderer);
+    }
+
+    void audio_live_graph_render(AudioLiveGraphHandle *live, int frames) {
+        ((LiveGraph *)live)->render(frames);
+    }
+
+    AudioBatchHandle *audio_batch_create(AudioGraphHandle *graph, int instanceCount) {
+        if (instanceCount <= 0) {
+            return NULL;
+        }
+
+        return (AudioBatchHandle *)new GraphBatch(*(AudioGraph *)graph, instanceCount);
+    }
+
+    void audio_batch_destroy(AudioBatchHandle *batch) {
+        delete (GraphBatch *)batch;
+    }
+
+    int audio_batch_set_param(AudioBatchHandle *batch, int instance, int node, int param, double value) {
+        AudioGraph *graph = ((GraphBatch *)batch)->getInstance(instance);
+        return graph && graph->setParam(node, param, value) ? 0 : -1;
+    }
+
+    int audio_batch_set_sample_file(AudioBatchHandle *batch, int instance, int node, const char *path) {
+        AudioGraph *graph = ((GraphBatch *)batch)->getInstance(instance);
+        return graph && graph->setSampleFile(node, path) ? 0 : -1;
+    }
+
+    int audio_batch_set_output_file(AudioBatchHandle *batch, int instance, const char *path) {
+        return ((GraphBatch *)batch)->setOutputFile(instance, path) ? 0 : -1;
+    }
+
+    double audio_batch_render(AudioBatchHandle *batch, int frames, int threadCount) {
+        return ((GraphBatch *)batch)->render(frames, threadCount);
+    }
+
+    const float *audio_batch_get_output(AudioBatchHandle *batch, int instance, int *count) {
+        size_t sampleCount;
+        const float *samples = ((GraphBatch *)batch)->getOutput(instance, &sampleCount);
+
+        *count = (int)sampleCount;
+        return samples;
+    }
+
     float unpack_float(unsigned char a, unsigned char b, unsigned char c, unsigned char d) {
         unsigned char buf[4] = {a, b, c, d};
         float result = *((float *)buf);
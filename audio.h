@@ -1,11 +1,302 @@
 #ifndef __AUDIO_H
 #define __AUDIO_H
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// output settings, fill one in with a preset and adjust from there
+typedef struct AudioConfig {
+    int bufferCount;        // number of OpenAL buffers queued on the source
+    int framesPerBuffer;    // sample frames per buffer
+    int sampleRate;
+    int channelCount;       // 1 or 2, stereo samples are interleaved
+    int floatOutput;        // upload float samples if AL_EXT_FLOAT32 is available
+
+    // audio thread hardening, all best effort
+    int realtimePriority;   // 0 normal, 1-99 SCHED_FIFO (time constraint on OS X)
+    int cpu;                // core the audio thread is pinned to, -1 for any
+    int flushDenormals;     // FTZ/DAZ on the audio thread
+    int lockMemory;         // mlockall at start, later pages only without a limit
+
+    // rate of the fed samples when it differs from the device rate, like
+    // 48 kHz material or a graph running 2x oversampled, 0 for sampleRate.
+    // framesPerBuffer and the buffer size count frames at this rate.
+    int renderRate;
+    int resampleQuality;    // AUDIO_RESAMPLE_*, for any frames not at sampleRate
+} AudioConfig;
+
+// resampling of frames whose rate differs from the output. The sinc qualities
+// are windowed-sinc polyphase filters of increasing length and stopband, all
+// delay the signal by half their kernel.
+enum {
+    AUDIO_RESAMPLE_LINEAR,      // interpolation between neighbouring frames
+    AUDIO_RESAMPLE_FAST,
+    AUDIO_RESAMPLE_MEDIUM,
+    AUDIO_RESAMPLE_BEST
+};
+
+void audio_config_default(AudioConfig *config);
+void audio_config_low_latency(AudioConfig *config);
+void audio_config_throughput(AudioConfig *config);
+
+// file formats for offline rendering, both hold native float samples
+enum {
+    AUDIO_FILE_F32,
+    AUDIO_FILE_WAV
+};
+
 void audio_init();
+int audio_init_ex(const AudioConfig *config);
+
+// the default config fed at renderRate, like a graph at another sample rate
+int audio_init_rate(int renderRate);
+
+// renders to a file instead of the device, as fast as the samples are fed.
+// config may be NULL for the defaults, direct bypasses the page cache where
+// the file system allows it. The file is complete after audio_deinit.
+int audio_init_offline(const AudioConfig *config, const char *path, int format, int direct);
+
 void audio_deinit();
 void audio_feed_sample(double sample);
+void audio_feed_block(const double *samples, int count);
+void audio_feed_block_float(const float *samples, int count);
 int audio_get_buffer_size();
+double audio_get_output_latency();
+
+// sample-accurate playback clock, counts the samples that have actually been
+// played by the device since start or the last reset
+long long audio_get_sample_position();
+double audio_get_seconds_played();
+void audio_reset_clock();
+
+// runtime statistics of the device renderer, cheap enough to stay on. The
+// histograms count durations in power of two buckets: bucket 0 is under 1
+// microsecond, bucket i from 2^(i-1) up to 2^i microseconds and the last one
+// everything longer.
+#define AUDIO_HISTOGRAM_BUCKETS 24
+
+typedef struct AudioStats {
+    long long underruns;            // times the source ran dry and was restarted
+    long long framesUploaded;       // frames handed to OpenAL
+
+    // frames waiting in the queue whenever the audio thread takes one
+    int queueDepthMin;
+    int queueDepthMax;
+    double queueDepthAverage;
+
+    // time the audio thread spent waiting for the producer and for OpenAL to
+    // finish a buffer, and the producer waiting for a free frame
+    double popFrameWaitSeconds;
+    double bufferWaitSeconds;
+    double acquireFrameWaitSeconds;
+
+    // from the producer pushing a frame to its upload to OpenAL
+    long long uploadLatency[AUDIO_HISTOGRAM_BUCKETS];
+
+    // time the producer took to render each frame, from committing one to
+    // asking for the next
+    long long renderTime[AUDIO_HISTOGRAM_BUCKETS];
+} AudioStats;
+
+void audio_get_stats(AudioStats *stats);
+void audio_reset_stats();
+
+// independent output streams next to the one of audio_init, each with its
+// own source, frame queue and audio thread on the device they all share.
+// Feeding takes interleaved samples in the channel count of the config,
+// the clock and stats work like the global ones.
+typedef struct AudioRendererHandle AudioRendererHandle;
+
+// config may be NULL for the defaults, returns NULL if the device can't be
+// opened
+AudioRendererHandle *audio_renderer_create(const AudioConfig *config);
+
+// stops the stream, graphs and live graphs set to the renderer keep it
+// around (dropping their output) until they are destroyed or switched away
+void audio_renderer_destroy(AudioRendererHandle *renderer);
+
+void audio_renderer_feed(AudioRendererHandle *renderer, const float *samples, int count);
+int audio_renderer_get_buffer_size(AudioRendererHandle *renderer);
+long long audio_renderer_get_sample_position(AudioRendererHandle *renderer);
+void audio_renderer_get_stats(AudioRendererHandle *renderer, AudioStats *stats);
+
 void audio_sleep(double delay);
+
+// .f32 sample files, either mapped read-only (count is set to the number of
+// samples, NULL on failure) or copied into a caller buffer in one go (returns
+// the number of samples copied, -1 on failure)
+const float *audio_map_samples(const char *path, int *count);
+void audio_unmap_samples(const float *samples, int count);
+int audio_get_sample_count(const char *path);
+int audio_read_samples(const char *path, double *buffer, int capacity);
+int audio_read_samples_float(const char *path, float *buffer, int capacity);
+
+// .f32 files from the cache the native sample players use as well, mapped
+// once per path and modification time however many players share them.
+// Files nobody holds a handle to stay cached until the cache grows past its
+// budget (512 MB to start with), least recently acquired first. decode also
+// keeps a copy as doubles, made once per file. Both pointers stay valid
+// until the handle is released, NULL is returned on failure.
+typedef struct AudioSamplesHandle AudioSamplesHandle;
+
+AudioSamplesHandle *audio_samples_acquire(const char *path, int decode);
+void audio_samples_release(AudioSamplesHandle *samples);
+int audio_samples_get_count(AudioSamplesHandle *samples);
+const float *audio_samples_get_data(AudioSamplesHandle *samples);
+const double *audio_samples_get_doubles(AudioSamplesHandle *samples);
+
+void audio_sample_cache_set_budget(long long bytes);
+long long audio_sample_cache_get_size();
+
+// .f32 files streamed from disk by a background thread with a bounded
+// read-ahead, for files too large to load. The stream loops at the end of
+// the file and reads never block, missing samples come out as silence.
+// chunkSize and chunkCount may be 0 for defaults.
+typedef struct SampleStreamHandle SampleStreamHandle;
+
+SampleStreamHandle *audio_stream_open(const char *path, int chunkSize, int chunkCount);
+int audio_stream_read(SampleStreamHandle *stream, double *buffer, int count);
+int audio_stream_read_float(SampleStreamHandle *stream, float *buffer, int count);
+int audio_stream_get_length(SampleStreamHandle *stream);
+long long audio_stream_get_underruns(SampleStreamHandle *stream);
+void audio_stream_close(SampleStreamHandle *stream);
+
+// native graph runtime, runs the render program of a Graph from main.py a
+// block at a time. Nodes are added in topological order, the compiler numbers
+// the port buffers and wires them up, -1 leaves a port unconnected.
+typedef struct AudioGraphHandle AudioGraphHandle;
+
+enum {
+    AUDIO_NODE_OUTPUT_DEVICE,   // input 0, feeds the renderer
+    AUDIO_NODE_SAMPLE_PLAYER,   // loops a mapped sample file
+    AUDIO_NODE_STREAM_PLAYER,   // loops a sample file streamed from disk
+    AUDIO_NODE_OSCILLATOR,      // AUDIO_PARAM_FREQUENCY and AUDIO_PARAM_WAVEFORM
+    AUDIO_NODE_MIXER,           // inputs 0 first, 1 second, 2 mix
+    AUDIO_NODE_COMBINER,        // inputs 0 and 1, AUDIO_PARAM_*_LEVEL
+    AUDIO_NODE_DELAY,           // input 0, AUDIO_PARAM_DELAY in seconds
+    AUDIO_NODE_LOW_PASS,        // input 0, AUDIO_PARAM_CUTOFF in Hz
+    AUDIO_NODE_LOW_PASS_CASCADE,    // LOW_PASS with AUDIO_PARAM_SECTIONS in series
+    AUDIO_NODE_FILTER_BANK,     // input 0, AUDIO_PARAM_SECTIONS lowpasses summed
+    AUDIO_NODE_MODULATED_DELAY  // inputs 0 signal, 1 modulation, AUDIO_PARAM_DEPTH
+};
+
+enum {
+    AUDIO_PARAM_FREQUENCY,
+    AUDIO_PARAM_CUTOFF,
+    AUDIO_PARAM_FIRST_LEVEL,
+    AUDIO_PARAM_SECOND_LEVEL,
+    AUDIO_PARAM_DELAY,
+    AUDIO_PARAM_SECTIONS,
+    AUDIO_PARAM_DEPTH,
+    AUDIO_PARAM_WAVEFORM
+};
+
+// values of AUDIO_PARAM_WAVEFORM, saw and square are band-limited
+enum {
+    AUDIO_WAVEFORM_SINE,
+    AUDIO_WAVEFORM_SAW,
+    AUDIO_WAVEFORM_SQUARE
+};
+
+// per band parameters of a filter bank, bands are numbered from 0
+#define AUDIO_MAX_BANDS 64
+#define AUDIO_PARAM_BAND_CUTOFF(band) (0x100 + (band))
+#define AUDIO_PARAM_BAND_GAIN(band) (0x200 + (band))
+
+AudioGraphHandle *audio_graph_create(int sampleRate, int blockSize);
+void audio_graph_destroy(AudioGraphHandle *graph);
+
+// these return the node index or 0 on success, -1 on failure
+int audio_graph_add_node(AudioGraphHandle *graph, int type);
+int audio_graph_set_input(AudioGraphHandle *graph, int node, int input, int buffer);
+int audio_graph_set_output(AudioGraphHandle *graph, int node, int buffer);
+int audio_graph_set_param(AudioGraphHandle *graph, int node, int param, double value);
+int audio_graph_set_sample_file(AudioGraphHandle *graph, int node, const char *path);
+
+// parameter changes at a frame of the graph clock, safe to call from one
+// control thread while another renders. rampFrames > 0 moves there from the
+// value at that frame instead of jumping. Levels and band gains ramp every
+// sample, other parameters step once per block. A later change of the same
+// parameter cancels a ramp, frames in the past take effect with the next
+// block. Returns -1 on a bad node, a full queue or a change that would
+// allocate on the render thread: AUDIO_PARAM_SECTIONS, the depth of
+// modulated delays and delays longer than any the node was set to with
+// audio_graph_set_param, which only ever grows the line.
+enum {
+    AUDIO_RAMP_LINEAR,
+    AUDIO_RAMP_EXPONENTIAL      // linear unless both ends have the same sign
+};
+
+int audio_graph_schedule_param(AudioGraphHandle *graph, int node, int param, double value, long long frame, int rampFrames, int curve);
+
+// frames rendered so far
+long long audio_graph_get_position(AudioGraphHandle *graph);
+
+// nodes with the same key and type in a graph that replaces another on a
+// live graph take over the state of the old node, -1 (the default) opts out
+int audio_graph_set_node_key(AudioGraphHandle *graph, int node, int key);
+
+// compiled graphs in a binary file that loads without compiling the patch
+// again, in the order the nodes were added with their buffers, parameters,
+// keys and sample files. Thread settings and renderers aren't saved. save
+// returns -1 on failure, load NULL.
+int audio_graph_save(AudioGraphHandle *graph, const char *path);
+AudioGraphHandle *audio_graph_load(const char *path);
+
+int audio_graph_get_sample_rate(AudioGraphHandle *graph);
+
+// 1 renders on the calling thread (the default), more spreads independent
+// nodes over a pool of that many threads, 0 uses one thread per core
+void audio_graph_set_thread_count(AudioGraphHandle *graph, int threadCount);
+
+// scheduling of the worker threads, priority 0 is normal and 1-99 is
+// SCHED_FIFO. The thread calling render is worker 0 and keeps its own
+// settings, with firstCpu >= 0 worker thread i (from 1 on) is pinned to core
+// firstCpu + i - 1. Denormals are always flushed to zero while a graph
+// renders.
+void audio_graph_set_thread_policy(AudioGraphHandle *graph, int priority, int firstCpu);
+
+// output nodes feed the renderer instead of audio_feed_block_float, NULL
+// switches back
+void audio_graph_set_renderer(AudioGraphHandle *graph, AudioRendererHandle *renderer);
+
+void audio_graph_render(AudioGraphHandle *graph, int frames);
+
+// a patch that can be replaced while it plays. The live graph owns the graphs
+// handed to it and deletes them once they are replaced, so their handles are
+// only good for scheduling parameters until then. Swapping is done from one
+// control thread: the new graph starts at the next block boundary, with
+// crossfadeFrames > 0 both play and fade over for that long. Pending changes
+// and ramps of the old graph move over to the nodes with the same key, those
+// scheduled on the old graph after the swap may not. It returns -1 while the
+// previous swap is still running or if the sample rates differ.
+typedef struct AudioLiveGraphHandle AudioLiveGraphHandle;
+
+AudioLiveGraphHandle *audio_live_graph_create(AudioGraphHandle *graph);
+void audio_live_graph_destroy(AudioLiveGraphHandle *live);
+int audio_live_graph_swap(AudioLiveGraphHandle *live, AudioGraphHandle *graph, int crossfadeFrames);
+void audio_live_graph_set_renderer(AudioLiveGraphHandle *live, AudioRendererHandle *renderer);
+void audio_live_graph_render(AudioLiveGraphHandle *live, int frames);
+
+// many instances of one graph rendered without a device, spread over a pool
+// of threads. Instances start out as copies of the graph and can then have
+// their own parameters, sample files and output file, output goes to memory
+// otherwise. Rendering returns the aggregate samples per second.
+typedef struct AudioBatchHandle AudioBatchHandle;
+
+AudioBatchHandle *audio_batch_create(AudioGraphHandle *graph, int instanceCount);
+void audio_batch_destroy(AudioBatchHandle *batch);
+int audio_batch_set_param(AudioBatchHandle *batch, int instance, int node, int param, double value);
+int audio_batch_set_sample_file(AudioBatchHandle *batch, int instance, int node, const char *path);
+int audio_batch_set_output_file(AudioBatchHandle *batch, int instance, const char *path);
+double audio_batch_render(AudioBatchHandle *batch, int frames, int threadCount);
+const float *audio_batch_get_output(AudioBatchHandle *batch, int instance, int *count);
+
 float unpack_float(unsigned char a, unsigned char b, unsigned char c, unsigned char d);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif
@@ -0,0 +1,135 @@
+#include <algorithm>
+
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "audio.h"
+#include "batch.h"
+#include "samplefile.h"
+
+// collects the output of one instance in memory or writes it to a file
+class GraphBatch::Output : public SampleSink {
+    private:
+        std::vector<float> samples;
+        SampleFileWriter writer;
+        bool toFile;
+    public:
+        Output() : toFile(false) {
+        }
+
+        // WAV for .wav files, raw .f32 otherwise
+        bool open(const char *path, int sampleRate) {
+            size_t length = strlen(path);
+            int format = length >= 4 && strcmp(path + length - 4, ".wav") == 0 ? AUDIO_FILE_WAV : AUDIO_FILE_F32;
+
+            toFile = writer.open(path, format, sampleRate, 1, false);
+            return toFile;
+        }
+
+        // makes sure rendering doesn't have to grow the vector
+        void reserve(size_t count) {
+            if (!toFile) {
+                samples.reserve(samples.size() + count);
+            }
+        }
+
+        void write(const float *samples, size_t count) {
+            if (toFile) {
+                writer.write(samples, count);
+            } else {
+                this->samples.insert(this->samples.end(), samples, samples + count);
+            }
+        }
+
+        const float *data(size_t *count) const {
+            if (toFile) {
+                *count = 0;
+                return NULL;
+            }
+
+            *count = samples.size();
+            return samples.data();
+        }
+};
+
+GraphBatch::GraphBatch(const AudioGraph &graph, int instanceCount) : renderFrames(0) {
+    instances.resize(std::max(instanceCount, 0));
+
+    for (auto &instance : instances) {
+        instance.graph.reset(graph.clone());
+        instance.output.reset(new Output());
+
+        // the batch is what runs in parallel, not the instances
+        instance.graph->setThreadCount(1);
+        instance.graph->setSink(instance.output.get());
+    }
+}
+
+GraphBatch::~GraphBatch() {
+}
+
+int GraphBatch::getInstanceCount() const {
+    return instances.size();
+}
+
+AudioGraph *GraphBatch::getInstance(int instance) {
+    if (instance < 0 || instance >= (int)instances.size()) {
+        return NULL;
+    }
+
+    return instances[instance].graph.get();
+}
+
+bool GraphBatch::setOutputFile(int instance, const char *path) {
+    if (instance < 0 || instance >= (int)instances.size()) {
+        return false;
+    }
+
+    return instances[instance].output->open(path, instances[instance].graph->getSampleRate());
+}
+
+void GraphBatch::runTask(int task, int) {
+    instances[task].graph->render(renderFrames);
+}
+
+double GraphBatch::render(size_t frames, int threadCount) {
+    if (threadCount <= 0) {
+        threadCount = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+
+    // one output node per instance is the common case, more only grow the
+    // vectors while rendering
+    for (auto &instance : instances) {
+        instance.output->reserve(frames);
+    }
+
+    // no dependencies, every instance is ready to go
+    TaskScheduler scheduler(threadCount);
+    scheduler.setGraph(std::vector<std::vector<int>>(instances.size()));
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    renderFrames = frames;
+    scheduler.run(this);
+
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+    if (seconds <= 0.0) {
+        return 0.0;
+    }
+
+    return (double)frames * instances.size() / seconds;
+}
+
+const float *GraphBatch::getOutput(int instance, size_t *count) const {
+    if (instance < 0 || instance >= (int)instances.size()) {
+        *count = 0;
+        return NULL;
+    }
+
+    return instances[instance].output->data(count);
+}
@@ -0,0 +1,56 @@
+#ifndef __BATCH_H
+#define __BATCH_H
+
+#include <memory>
+#include <vector>
+
+#include <stddef.h>
+
+#include "graph.h"
+#include "scheduler.h"
+
+// Renders many instances of one compiled graph without a device, like
+// pre-rendering variants of a patch. The instances are cloned up front and
+// can then get their own parameters and sample files. Every instance is a
+// task of its own on a TaskScheduler, the work stealing spreads them over
+// the cores.
+//
+// Cloned stream players play their file from the sample cache, so a batch
+// maps it once. A stream file set on an instance afterwards opens a stream
+// for that instance alone, each with its own file, read-ahead chunks of 16K
+// samples and I/O thread.
+class GraphBatch : private TaskRunner {
+    private:
+        class Output;
+
+        // the output is the sink of the graph, so it goes after the graph
+        struct Instance {
+            std::unique_ptr<Output> output;
+            std::unique_ptr<AudioGraph> graph;
+        };
+
+        std::vector<Instance> instances;
+        size_t renderFrames;
+
+        void runTask(int task, int worker);
+    public:
+        GraphBatch(const AudioGraph &graph, int instanceCount);
+        ~GraphBatch();
+
+        int getInstanceCount() const;
+
+        // NULL on a bad index
+        AudioGraph *getInstance(int instance);
+
+        // output is collected in memory unless it goes to a .f32 or .wav file
+        bool setOutputFile(int instance, const char *path);
+
+        // renders the given number of frames of every instance and returns the
+        // aggregate samples per second, 0 threads uses every core
+        double render(size_t frames, int threadCount);
+
+        // everything rendered into memory so far, NULL for file output
+        const float *getOutput(int instance, size_t *count) const;
+};
+
+#endif
@@ -0,0 +1,586 @@
+// Benchmarks for the frame queue, the conversion kernels, the biquad bank,
+// the graph nodes, the demo graph of main.py alone, offline and in a batch,
+// and buffer reuse in a random patch, none of them need an audio device.
+// Build with ./b and run from the repository root, the results are written
+// as JSON to the given file (or stdout, mixed with the status messages of the
+// library) so they can be collected and compared across releases.
+//
+//     ./bench bench_output.txt
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "audio.h"
+#include "batch.h"
+#include "biquad.h"
+#include "convert.h"
+#include "graph.h"
+#include "nodes.h"
+#include "ringbuffer.h"
+
+namespace {
+
+const int sampleRate = 44100;
+const size_t blockSize = 1024;
+
+// each measurement is repeated and the fastest run is reported, which is
+// the one least disturbed by the rest of the system
+const int repeats = 5;
+
+typedef std::chrono::steady_clock Clock;
+
+double seconds(Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration<double>(end - start).count();
+}
+
+// collects the results and prints them as one JSON document
+class Report {
+    private:
+        std::vector<std::string> entries;
+    public:
+        void add(const char *group, const char *name, const char *metric, double value) {
+            char entry[256];
+            snprintf(entry, sizeof(entry), "{\"group\": \"%s\", \"name\": \"%s\", \"metric\": \"%s\", \"value\": %.6g}", group, name, metric, value);
+            entries.push_back(entry);
+        }
+
+        void print(FILE *file) const {
+            fprintf(file, "{\n");
+            fprintf(file, "  \"sample_rate\": %d,\n", sampleRate);
+            fprintf(file, "  \"block_size\": %d,\n", (int)blockSize);
+            fprintf(file, "  \"conversion_kernels\": \"%s\",\n", conversionKernelName());
+            fprintf(file, "  \"results\": [\n");
+            for (size_t i=0; i<entries.size(); ++i) {
+                fprintf(file, "    %s%s\n", entries[i].c_str(), i + 1 < entries.size() ? "," : "");
+            }
+            fprintf(file, "  ]\n");
+            fprintf(file, "}\n");
+        }
+};
+
+// uniform noise between -1 and 1 that is the same on every run
+void fillNoise(float *samples, size_t count, uint32_t seed) {
+    for (size_t i=0; i<count; ++i) {
+        seed = seed * 1664525u + 1013904223u;
+        samples[i] = (float)(seed >> 8) / 8388608.0f - 1.0f;
+    }
+}
+
+// The frame path of AudioRenderer without OpenAL: a pool of preallocated
+// frames travels from the producer to the consumer thread and back through
+// two SpscQueues, with EventSignals to wake up whoever is waiting. The
+// producer converts the float samples to int16 like pushFrame does.
+struct BenchFrame {
+    std::vector<int16_t> samples;
+    Clock::time_point pushed;
+};
+
+class FrameQueue {
+    private:
+        static const int queueCapacity = 64;
+
+        std::vector<BenchFrame> framePool;
+        SpscQueue<BenchFrame *> audioQueue;
+        SpscQueue<BenchFrame *> freeFrames;
+        EventSignal frameAvailable;
+        EventSignal frameReleased;
+
+        long frameCount;
+
+        // only one frame in flight at a time, measures the hand over
+        // instead of the queueing delay
+        bool pingPong;
+
+        std::vector<double> latencies;
+
+        static void *consumerTrampoline(void *queue) {
+            ((FrameQueue *)queue)->consume();
+            return NULL;
+        }
+
+        void consume() {
+            for (long i=0; i<frameCount; ++i) {
+                BenchFrame *frame;
+                frameAvailable.wait([&]() { return audioQueue.pop(frame); });
+
+                latencies[i] = seconds(frame->pushed, Clock::now());
+
+                freeFrames.push(frame);
+                frameReleased.signal();
+            }
+        }
+    public:
+        FrameQueue(int framesPerBuffer, long frameCount, bool pingPong) : framePool(queueCapacity), audioQueue(queueCapacity), freeFrames(queueCapacity), frameCount(frameCount), pingPong(pingPong), latencies(frameCount) {
+            for (BenchFrame &frame : framePool) {
+                frame.samples.resize(framesPerBuffer);
+                freeFrames.push(&frame);
+            }
+        }
+
+        // returns the seconds it took to get all frames through
+        double run(const float *source) {
+            pthread_t consumer;
+            pthread_create(&consumer, NULL, consumerTrampoline, this);
+
+            Clock::time_point start = Clock::now();
+            for (long i=0; i<frameCount; ++i) {
+                BenchFrame *frame;
+                if (pingPong) {
+                    // wait until all frames are back in the pool
+                    frameReleased.wait([&]() { return freeFrames.size() == (size_t)queueCapacity && freeFrames.pop(frame); });
+                } else {
+                    frameReleased.wait([&]() { return freeFrames.pop(frame); });
+                }
+
+                convertToInt16(frame->samples.data(), source, frame->samples.size());
+                frame->pushed = Clock::now();
+
+                audioQueue.push(frame);
+                frameAvailable.signal();
+            }
+
+            pthread_join(consumer, NULL);
+            return seconds(start, Clock::now());
+        }
+
+        double latencyPercentile(double percentile) {
+            std::vector<double> sorted(latencies);
+            std::sort(sorted.begin(), sorted.end());
+
+            size_t index = std::min(sorted.size() - 1, (size_t)(percentile / 100.0 * sorted.size()));
+            return sorted[index];
+        }
+};
+
+void benchFrameQueue(Report &report) {
+    const int framesPerBuffer = 1024;
+    const long frameCount = 20000;
+
+    std::vector<float> source(framesPerBuffer);
+    fillNoise(source.data(), source.size(), 1);
+
+    double best = 1e30;
+    for (int i=0; i<repeats; ++i) {
+        FrameQueue queue(framesPerBuffer, frameCount, false);
+        best = std::min(best, queue.run(source.data()));
+    }
+
+    report.add("queue", "push_pop", "frames_per_second", frameCount / best);
+    report.add("queue", "push_pop", "samples_per_second", frameCount * (double)framesPerBuffer / best);
+
+    FrameQueue queue(framesPerBuffer, frameCount, true);
+    queue.run(source.data());
+
+    report.add("queue", "hand_over_latency", "p50_microseconds", queue.latencyPercentile(50.0) * 1e6);
+    report.add("queue", "hand_over_latency", "p99_microseconds", queue.latencyPercentile(99.0) * 1e6);
+    report.add("queue", "hand_over_latency", "max_microseconds", queue.latencyPercentile(100.0) * 1e6);
+}
+
+// runs kernel over the whole buffer until about count samples went through
+template <typename Kernel>
+double samplesPerSecond(Kernel kernel, size_t bufferSize, size_t count) {
+    size_t passes = std::max((size_t)1, count / bufferSize);
+
+    double best = 1e30;
+    for (int i=0; i<repeats; ++i) {
+        Clock::time_point start = Clock::now();
+        for (size_t pass=0; pass<passes; ++pass) {
+            kernel();
+        }
+        best = std::min(best, seconds(start, Clock::now()));
+    }
+
+    return passes * (double)bufferSize / best;
+}
+
+void benchConversion(Report &report) {
+    // a buffer that stays in the cache, so the numbers are about the kernels
+    const size_t count = 4096;
+    const size_t total = 200000000;
+
+    std::vector<float> floats(count * 2);
+    std::vector<double> doubles(count);
+    std::vector<int16_t> shorts(count);
+    std::vector<float> left(count), right(count);
+    std::vector<float> output(count * 2);
+
+    fillNoise(floats.data(), floats.size(), 2);
+    for (size_t i=0; i<count; ++i) {
+        doubles[i] = floats[i];
+        shorts[i] = (int16_t)(floats[i] * 32767.0f);
+    }
+    fillNoise(left.data(), count, 3);
+    fillNoise(right.data(), count, 4);
+
+    report.add("conversion", "float_to_int16", "samples_per_second", samplesPerSecond([&]() { convertToInt16(shorts.data(), floats.data(), count); }, count, total));
+    report.add("conversion", "double_to_int16", "samples_per_second", samplesPerSecond([&]() { convertToInt16(shorts.data(), doubles.data(), count); }, count, total));
+    report.add("conversion", "double_to_float", "samples_per_second", samplesPerSecond([&]() { convertToFloat(output.data(), doubles.data(), count); }, count, total));
+    report.add("conversion", "int16_to_float", "samples_per_second", samplesPerSecond([&]() { convertToFloat(output.data(), shorts.data(), count); }, count, total));
+    report.add("conversion", "duplicate_mono_to_stereo", "frames_per_second", samplesPerSecond([&]() { duplicateMonoToStereo(output.data(), left.data(), count); }, count, total));
+    report.add("conversion", "interleave_stereo", "frames_per_second", samplesPerSecond([&]() { interleaveStereo(output.data(), left.data(), right.data(), count); }, count, total));
+    report.add("conversion", "deinterleave_stereo", "frames_per_second", samplesPerSecond([&]() { deinterleaveStereo(left.data(), right.data(), floats.data(), count); }, count, total));
+}
+
+struct NodeSetup {
+    const char *name;
+    int type;
+    int param;
+    double value;
+};
+
+void benchNodes(Report &report) {
+    const size_t total = 50000000;
+
+    // three blocks of noise, the mix input of the mixer gets the third one
+    std::vector<float> input(blockSize * 3);
+    fillNoise(input.data(), input.size(), 5);
+    const float *inputs[GraphNode::maxInputs] = {&input[0], &input[blockSize], &input[blockSize * 2]};
+
+    std::vector<float> output(blockSize);
+
+    // the parameters of the demo graph where there is one
+    const NodeSetup setups[] = {
+        {"oscillator_sine", AUDIO_NODE_OSCILLATOR, AUDIO_PARAM_FREQUENCY, 0.1},
+        {"oscillator_saw", AUDIO_NODE_OSCILLATOR, AUDIO_PARAM_WAVEFORM, AUDIO_WAVEFORM_SAW},
+        {"low_pass", AUDIO_NODE_LOW_PASS, AUDIO_PARAM_CUTOFF, 800.0},
+        {"delay", AUDIO_NODE_DELAY, AUDIO_PARAM_DELAY, 0.3},
+        {"modulated_delay", AUDIO_NODE_MODULATED_DELAY, AUDIO_PARAM_DELAY, 0.01},
+        {"mixer", AUDIO_NODE_MIXER, -1, 0.0},
+        {"combiner", AUDIO_NODE_COMBINER, AUDIO_PARAM_SECOND_LEVEL, 0.7},
+    };
+
+    for (const NodeSetup &setup : setups) {
+        std::unique_ptr<GraphNode> node(createGraphNode(setup.type, sampleRate, blockSize));
+        if (setup.param >= 0) {
+            node->setParam(setup.param, setup.value);
+        }
+
+        double rate = samplesPerSecond([&]() { node->process(inputs, output.data(), blockSize); }, blockSize, total);
+        report.add("node", setup.name, "samples_per_second", rate);
+    }
+}
+
+// 32 lowpasses on one input like a filter bank node, in SIMD lanes and one
+// filter at a time, rates are filter samples per second
+void benchBiquads(Report &report) {
+    const size_t filterCount = 32;
+    const size_t total = 200000000;
+
+    std::vector<float> input(blockSize);
+    fillNoise(input.data(), input.size(), 6);
+
+    std::vector<float> output(blockSize * filterCount);
+    std::vector<const float *> inputs(filterCount, input.data());
+    std::vector<float *> outputs(filterCount);
+    for (size_t i=0; i<filterCount; ++i) {
+        outputs[i] = &output[i * blockSize];
+    }
+
+    BiquadBank bank(filterCount);
+    std::vector<BiquadBank> singles(filterCount, BiquadBank(1));
+    for (size_t i=0; i<filterCount; ++i) {
+        BiquadCoefficients coefficients = lowPassCoefficients(100.0 * (i + 1), sampleRate);
+        bank.setCoefficients(i, coefficients);
+        singles[i].setCoefficients(0, coefficients);
+    }
+
+    double banked = samplesPerSecond([&]() { bank.process(inputs.data(), outputs.data(), blockSize); }, blockSize * filterCount, total);
+    double single = samplesPerSecond([&]() {
+        for (size_t i=0; i<filterCount; ++i) {
+            singles[i].process(&inputs[i], &outputs[i], blockSize);
+        }
+    }, blockSize * filterCount, total);
+
+    report.add("biquad", "bank_32", "samples_per_second", banked);
+    report.add("biquad", "one_at_a_time_32", "samples_per_second", single);
+    report.add("biquad", "bank_32", "speedup", banked / single);
+}
+
+// throws away whatever the output device gets
+class NullSink : public SampleSink {
+    public:
+        void write(const float *, size_t) {
+        }
+};
+
+// the graph entry_point in main.py builds, in the order its render program
+// runs the nodes, or NULL without music.f32
+AudioGraph *createDemoGraph() {
+    AudioGraph *graph = new AudioGraph(sampleRate, blockSize);
+
+    int oscillator = graph->addNode(AUDIO_NODE_OSCILLATOR);
+    int samplePlayer = graph->addNode(AUDIO_NODE_SAMPLE_PLAYER);
+    int lowPass = graph->addNode(AUDIO_NODE_LOW_PASS);
+    int mixer = graph->addNode(AUDIO_NODE_MIXER);
+    int delay = graph->addNode(AUDIO_NODE_DELAY);
+    int combiner = graph->addNode(AUDIO_NODE_COMBINER);
+    int outputDevice = graph->addNode(AUDIO_NODE_OUTPUT_DEVICE);
+
+    graph->setParam(oscillator, AUDIO_PARAM_FREQUENCY, 0.1);
+    graph->setParam(lowPass, AUDIO_PARAM_CUTOFF, 800.0);
+    graph->setParam(delay, AUDIO_PARAM_DELAY, 0.3);
+    graph->setParam(combiner, AUDIO_PARAM_FIRST_LEVEL, 1.0);
+    graph->setParam(combiner, AUDIO_PARAM_SECOND_LEVEL, 0.7);
+
+    if (!graph->setSampleFile(samplePlayer, "music.f32")) {
+        delete graph;
+        return nullptr;
+    }
+
+    // 0 oscillator, 1 samples, 2 lowpass, 3 mixer, 4 delay, 5 combiner
+    graph->setOutput(oscillator, 0);
+    graph->setOutput(samplePlayer, 1);
+    graph->setInput(lowPass, 0, 1);
+    graph->setOutput(lowPass, 2);
+    graph->setInput(mixer, 0, 1);
+    graph->setInput(mixer, 1, 2);
+    graph->setInput(mixer, 2, 0);
+    graph->setOutput(mixer, 3);
+    graph->setInput(delay, 0, 3);
+    graph->setOutput(delay, 4);
+    graph->setInput(combiner, 0, 3);
+    graph->setInput(combiner, 1, 4);
+    graph->setOutput(combiner, 5);
+    graph->setInput(outputDevice, 0, 5);
+
+    return graph;
+}
+
+void benchDemoGraph(Report &report) {
+    const size_t frames = 60 * sampleRate;
+
+    std::unique_ptr<AudioGraph> graph(createDemoGraph());
+    if (!graph) {
+        fprintf(stderr, "bench: music.f32 not found, skipping the demo graph\n");
+        return;
+    }
+
+    NullSink sink;
+    graph->setSink(&sink);
+
+    double best = 1e30;
+    for (int i=0; i<repeats; ++i) {
+        Clock::time_point start = Clock::now();
+        graph->render(frames);
+        best = std::min(best, seconds(start, Clock::now()));
+    }
+
+    report.add("graph", "demo", "samples_per_second", frames / best);
+    report.add("graph", "demo", "real_time_factor", frames / best / sampleRate);
+
+    // the whole way through the feed API and the offline renderer, like
+    // main.py --offline, first with the file writes going nowhere and then
+    // into a WAV file that bypasses the page cache where it can
+    graph->setSink(nullptr);
+
+    std::string path = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+    path += "/bench_offline.wav";
+
+    struct OfflineSetup {
+        const char *name;
+        const char *path;
+        int format;
+        int direct;
+    };
+
+    const OfflineSetup setups[] = {
+        {"demo_offline", "/dev/null", AUDIO_FILE_F32, 0},
+        {"demo_offline_wav", path.c_str(), AUDIO_FILE_WAV, 1},
+    };
+
+    for (const OfflineSetup &setup : setups) {
+        best = 1e30;
+        for (int i=0; i<repeats; ++i) {
+            if (!audio_init_offline(NULL, setup.path, setup.format, setup.direct)) {
+                fprintf(stderr, "bench: can't open %s, skipping the offline render\n", setup.path);
+                return;
+            }
+
+            // the time to a complete file, including the last write
+            Clock::time_point start = Clock::now();
+            graph->render(frames);
+            audio_deinit();
+            best = std::min(best, seconds(start, Clock::now()));
+        }
+
+        report.add("graph", setup.name, "samples_per_second", frames / best);
+        report.add("graph", setup.name, "real_time_factor", frames / best / sampleRate);
+        report.add("graph", setup.name, "milliseconds_for_60_seconds", best * 1e3);
+    }
+
+    remove(path.c_str());
+}
+
+// six 60 second variants of the demo graph with different mixer LFO rates,
+// like main.py --batch 6, on one core and on all of them
+void benchBatch(Report &report) {
+    const size_t frames = 60 * sampleRate;
+    const int instanceCount = 6;
+
+    std::unique_ptr<AudioGraph> graph(createDemoGraph());
+    if (!graph) {
+        fprintf(stderr, "bench: music.f32 not found, skipping the batch render\n");
+        return;
+    }
+
+    for (int threads : {1, 0}) {
+        double best = 0.0;
+        for (int i=0; i<repeats; ++i) {
+            // a fresh batch every time, output collects in memory
+            GraphBatch batch(*graph, instanceCount);
+            for (int instance=0; instance<instanceCount; ++instance) {
+                batch.getInstance(instance)->setParam(0, AUDIO_PARAM_FREQUENCY, 0.1 * (instance + 1));
+            }
+
+            best = std::max(best, batch.render(frames, threads));
+        }
+
+        report.add("batch", threads == 1 ? "demo_6_one_thread" : "demo_6_all_cores", "samples_per_second", best);
+    }
+}
+
+// A random patch of 200 nodes: a few oscillators feeding mixers,
+// combiners, low passes and delays that read the outputs of recent nodes.
+// With reuse the buffers are assigned the way compile_native in main.py
+// does it, an output gets a free buffer and the buffer is free again once
+// its last reader has been added. Without, every output gets its own.
+AudioGraph *createRandomGraph(bool reuse, int &bufferCount) {
+    const int nodeCount = 200;
+    const int oscillatorCount = 8;
+    const int window = 16;
+
+    const int types[] = {AUDIO_NODE_MIXER, AUDIO_NODE_COMBINER, AUDIO_NODE_LOW_PASS, AUDIO_NODE_DELAY};
+    const int inputCounts[] = {3, 2, 1, 1};
+
+    // the same patch for both assignments
+    uint32_t seed = 7;
+    auto random = [&](int range) {
+        seed = seed * 1664525u + 1013904223u;
+        return (int)((seed >> 8) % (uint32_t)range);
+    };
+
+    std::vector<int> nodeTypes(nodeCount + 1);
+    std::vector<std::vector<int>> sources(nodeCount + 1);
+    for (int i=0; i<nodeCount; ++i) {
+        if (i < oscillatorCount) {
+            nodeTypes[i] = AUDIO_NODE_OSCILLATOR;
+            continue;
+        }
+
+        int kind = random(4);
+        nodeTypes[i] = types[kind];
+        for (int input=0; input<inputCounts[kind]; ++input) {
+            sources[i].push_back(i - 1 - random(std::min(i, window)));
+        }
+    }
+    nodeTypes[nodeCount] = AUDIO_NODE_OUTPUT_DEVICE;
+    sources[nodeCount].push_back(nodeCount - 1);
+
+    std::vector<int> lastUse(nodeCount + 1, -1);
+    for (int i=0; i<=nodeCount; ++i) {
+        for (int source : sources[i]) {
+            lastUse[source] = i;
+        }
+    }
+
+    AudioGraph *graph = new AudioGraph(sampleRate, blockSize);
+    std::vector<int> buffers(nodeCount + 1, -1);
+    std::vector<int> freeBuffers;
+    bufferCount = 0;
+
+    for (int i=0; i<=nodeCount; ++i) {
+        int node = graph->addNode(nodeTypes[i]);
+        for (size_t input=0; input<sources[i].size(); ++input) {
+            graph->setInput(node, (int)input, buffers[sources[i][input]]);
+        }
+
+        if (nodeTypes[i] == AUDIO_NODE_OSCILLATOR) {
+            graph->setParam(node, AUDIO_PARAM_FREQUENCY, 110.0 * (i + 1));
+        } else if (nodeTypes[i] == AUDIO_NODE_DELAY) {
+            graph->setParam(node, AUDIO_PARAM_DELAY, 0.01);
+        }
+
+        if (nodeTypes[i] != AUDIO_NODE_OUTPUT_DEVICE && (!reuse || lastUse[i] >= 0)) {
+            if (reuse && !freeBuffers.empty()) {
+                buffers[i] = freeBuffers.back();
+                freeBuffers.pop_back();
+            } else {
+                buffers[i] = bufferCount++;
+            }
+            graph->setOutput(node, buffers[i]);
+        }
+
+        if (reuse) {
+            for (int source : sources[i]) {
+                if (lastUse[source] == i && buffers[source] >= 0) {
+                    freeBuffers.push_back(buffers[source]);
+                    buffers[source] = -1;
+                }
+            }
+        }
+    }
+
+    return graph;
+}
+
+void benchBufferReuse(Report &report) {
+    const size_t frames = 10 * sampleRate;
+
+    // outlives the graphs, which let go of it when they are deleted
+    NullSink sink;
+
+    for (bool reuse : {false, true}) {
+        const char *name = reuse ? "random_200_reused_buffers" : "random_200_buffer_per_port";
+
+        int bufferCount;
+        std::unique_ptr<AudioGraph> graph(createRandomGraph(reuse, bufferCount));
+        graph->setSink(&sink);
+
+        double best = 1e30;
+        for (int i=0; i<repeats; ++i) {
+            Clock::time_point start = Clock::now();
+            graph->render(frames);
+            best = std::min(best, seconds(start, Clock::now()));
+        }
+
+        report.add("graph", name, "buffers", bufferCount);
+        report.add("graph", name, "samples_per_second", frames / best);
+    }
+}
+
+}
+
+int main(int argc, char **argv) {
+    FILE *file = stdout;
+    if (argc > 1 && !(file = fopen(argv[1], "w"))) {
+        fprintf(stderr, "bench: can't write %s\n", argv[1]);
+        return 1;
+    }
+
+    Report report;
+
+    benchFrameQueue(report);
+    benchConversion(report);
+    benchNodes(report);
+    benchBiquads(report);
+    benchDemoGraph(report);
+    benchBatch(report);
+    benchBufferReuse(report);
+
+    report.print(file);
+    if (file != stdout) {
+        fclose(file);
+    }
+
+    return 0;
+}
@@ -0,0 +1,226 @@
+#include <algorithm>
+
+#include <math.h>
+
+#include "biquad.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BIQUAD_SSE2 1
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#define BIQUAD_NEON 1
+#include <arm_neon.h>
+#endif
+
+BiquadCoefficients lowPassCoefficients(double cutoff, int sampleRate) {
+    double omega = 2.0 * M_PI * cutoff / sampleRate;
+    double cosOmega = cos(omega);
+    double alpha = sin(omega) / (2.0 * 7.0);
+    double scale = 1.0 / (1.0 + alpha);
+
+    BiquadCoefficients coefficients;
+    coefficients.a1 = -scale * 2.0 * cosOmega;
+    coefficients.a2 = -scale * (alpha - 1.0);
+    coefficients.b1 = scale * (1.0 - cosOmega);
+    coefficients.b0 = coefficients.b1 * 0.5f;
+    coefficients.b2 = coefficients.b0;
+
+    return coefficients;
+}
+
+BiquadBank::BiquadBank(size_t filterCount) : filterCount(0) {
+    resize(filterCount);
+}
+
+void BiquadBank::resize(size_t filterCount) {
+    size_t padded = (filterCount + lanes - 1) / lanes * lanes;
+
+    b0.resize(padded, 0.0f);
+    b1.resize(padded, 0.0f);
+    b2.resize(padded, 0.0f);
+    a1.resize(padded, 0.0f);
+    a2.resize(padded, 0.0f);
+    s1.resize(padded, 0.0f);
+    s2.resize(padded, 0.0f);
+
+    this->filterCount = filterCount;
+}
+
+size_t BiquadBank::size() const {
+    return filterCount;
+}
+
+void BiquadBank::setCoefficients(size_t filter, const BiquadCoefficients &coefficients) {
+    b0[filter] = coefficients.b0;
+    b1[filter] = coefficients.b1;
+    b2[filter] = coefficients.b2;
+    a1[filter] = coefficients.a1;
+    a2[filter] = coefficients.a2;
+}
+
+void BiquadBank::reset() {
+    std::fill(s1.begin(), s1.end(), 0.0f);
+    std::fill(s2.begin(), s2.end(), 0.0f);
+}
+
+void BiquadBank::copyState(const BiquadBank &other) {
+    reset();
+
+    size_t count = std::min(filterCount, other.filterCount);
+    std::copy(other.s1.begin(), other.s1.begin() + count, s1.begin());
+    std::copy(other.s2.begin(), other.s2.begin() + count, s2.begin());
+}
+
+// -- one filter, for the filters that don't fill a group and for cascades --
+
+static void scalarBiquad(const float *input, float *output, size_t frames, float b0, float b1, float b2, float a1, float a2, float &state1, float &state2) {
+    float s1 = state1;
+    float s2 = state2;
+
+    for (size_t i=0; i<frames; ++i) {
+        float x = input[i];
+        float y = b0 * x + s1;
+
+        s1 = b1 * x - a1 * y + s2;
+        s2 = b2 * x - a2 * y;
+
+        output[i] = y;
+    }
+
+    state1 = s1;
+    state2 = s2;
+}
+
+// -- four filters in the lanes of a vector --
+
+#if defined(BIQUAD_SSE2) || defined(BIQUAD_NEON)
+
+#if defined(BIQUAD_SSE2)
+
+typedef __m128 Lanes;
+
+static inline Lanes load(const float *source) { return _mm_loadu_ps(source); }
+static inline void store(float *destination, Lanes value) { _mm_storeu_ps(destination, value); }
+static inline Lanes add(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+static inline Lanes sub(Lanes a, Lanes b) { return _mm_sub_ps(a, b); }
+static inline Lanes mul(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+
+static inline void transpose(Lanes &r0, Lanes &r1, Lanes &r2, Lanes &r3) {
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+}
+
+#else
+
+typedef float32x4_t Lanes;
+
+static inline Lanes load(const float *source) { return vld1q_f32(source); }
+static inline void store(float *destination, Lanes value) { vst1q_f32(destination, value); }
+static inline Lanes add(Lanes a, Lanes b) { return vaddq_f32(a, b); }
+static inline Lanes sub(Lanes a, Lanes b) { return vsubq_f32(a, b); }
+static inline Lanes mul(Lanes a, Lanes b) { return vmulq_f32(a, b); }
+
+static inline void transpose(Lanes &r0, Lanes &r1, Lanes &r2, Lanes &r3) {
+    float32x4x2_t t01 = vtrnq_f32(r0, r1);
+    float32x4x2_t t23 = vtrnq_f32(r2, r3);
+
+    r0 = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+    r1 = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+    r2 = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+    r3 = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+}
+
+#endif
+
+struct LaneState {
+    Lanes b0, b1, b2, a1, a2;
+    Lanes s1, s2;
+
+    inline Lanes step(Lanes x) {
+        Lanes y = add(mul(b0, x), s1);
+
+        s1 = add(sub(mul(b1, x), mul(a1, y)), s2);
+        s2 = sub(mul(b2, x), mul(a2, y));
+
+        return y;
+    }
+};
+
+static void vectorBiquads(const float *const *inputs, float *const *outputs, size_t frames, LaneState &state) {
+    const float *in0 = inputs[0], *in1 = inputs[1], *in2 = inputs[2], *in3 = inputs[3];
+    float *out0 = outputs[0], *out1 = outputs[1], *out2 = outputs[2], *out3 = outputs[3];
+
+    size_t i = 0;
+
+    // four samples of four filters, transposed so every vector holds one
+    // sample of each filter and back again
+    for (; i + 4 <= frames; i += 4) {
+        Lanes x0 = load(in0 + i);
+        Lanes x1 = load(in1 + i);
+        Lanes x2 = load(in2 + i);
+        Lanes x3 = load(in3 + i);
+        transpose(x0, x1, x2, x3);
+
+        Lanes y0 = state.step(x0);
+        Lanes y1 = state.step(x1);
+        Lanes y2 = state.step(x2);
+        Lanes y3 = state.step(x3);
+        transpose(y0, y1, y2, y3);
+
+        store(out0 + i, y0);
+        store(out1 + i, y1);
+        store(out2 + i, y2);
+        store(out3 + i, y3);
+    }
+
+    for (; i < frames; ++i) {
+        float x[4] = {in0[i], in1[i], in2[i], in3[i]};
+        float y[4];
+        store(y, state.step(load(x)));
+
+        out0[i] = y[0];
+        out1[i] = y[1];
+        out2[i] = y[2];
+        out3[i] = y[3];
+    }
+}
+
+#endif
+
+void BiquadBank::process(const float *const *inputs, float *const *outputs, size_t frames) {
+    size_t filter = 0;
+
+#if defined(BIQUAD_SSE2) || defined(BIQUAD_NEON)
+    for (; filter + lanes <= filterCount; filter += lanes) {
+        LaneState state;
+        state.b0 = load(&b0[filter]);
+        state.b1 = load(&b1[filter]);
+        state.b2 = load(&b2[filter]);
+        state.a1 = load(&a1[filter]);
+        state.a2 = load(&a2[filter]);
+        state.s1 = load(&s1[filter]);
+        state.s2 = load(&s2[filter]);
+
+        vectorBiquads(inputs + filter, outputs + filter, frames, state);
+
+        store(&s1[filter], state.s1);
+        store(&s2[filter], state.s2);
+    }
+#endif
+
+    for (; filter < filterCount; ++filter) {
+        scalarBiquad(inputs[filter], outputs[filter], frames, b0[filter], b1[filter], b2[filter], a1[filter], a2[filter], s1[filter], s2[filter]);
+    }
+}
+
+void BiquadBank::processCascade(const float *input, float *output, size_t frames) {
+    if (filterCount == 0) {
+        std::copy(input, input + frames, output);
+        return;
+    }
+
+    // every section is one pass over the block, which stays in cache
+    for (size_t filter=0; filter<filterCount; ++filter) {
+        scalarBiquad(input, output, frames, b0[filter], b1[filter], b2[filter], a1[filter], a2[filter], s1[filter], s2[filter]);
+        input = output;
+    }
+}
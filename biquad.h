@@ -0,0 +1,52 @@
+#ifndef __BIQUAD_H
+#define __BIQUAD_H
+
+#include <vector>
+
+#include <stddef.h>
+
+struct BiquadCoefficients {
+    float b0, b1, b2;
+    float a1, a2;
+};
+
+// 12 dB lowpass with the same formulas as LowPass in main.py
+BiquadCoefficients lowPassCoefficients(double cutoff, int sampleRate);
+
+// A set of biquads in transposed direct form II. Coefficients and state are
+// stored per lane so independent filters run four at a time in SIMD lanes
+// (SSE2 on x86, NEON on ARM64), the filters that don't fill a group of four
+// and all other CPUs use plain C.
+class BiquadBank {
+    private:
+        size_t filterCount;
+
+        // structure of arrays, padded to whole groups of lanes
+        std::vector<float> b0, b1, b2;
+        std::vector<float> a1, a2;
+        std::vector<float> s1, s2;
+    public:
+        static const size_t lanes = 4;
+
+        BiquadBank(size_t filterCount = 0);
+
+        // keeps the coefficients and state of the filters that remain
+        void resize(size_t filterCount);
+        size_t size() const;
+
+        void setCoefficients(size_t filter, const BiquadCoefficients &coefficients);
+        void reset();
+
+        // state of the filters both banks have, the others are cleared
+        void copyState(const BiquadBank &other);
+
+        // filter i reads inputs[i] and writes outputs[i], which may be the
+        // same buffer but mustn't be the input of another filter
+        void process(const float *const *inputs, float *const *outputs, size_t frames);
+
+        // runs the filters one after another on a single signal, output may
+        // be the same buffer as input
+        void processCascade(const float *input, float *output, size_t frames);
+};
+
+#endif
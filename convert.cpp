@@ -0,0 +1,537 @@
+#include <string.h>
+
+#include "convert.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CONVERT_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define CONVERT_NEON 1
+#include <arm_neon.h>
+#endif
+
+struct ConversionKernels {
+    const char *name;
+
+    void (*floatToInt16)(int16_t *destination, const float *source, size_t count);
+    void (*doubleToInt16)(int16_t *destination, const double *source, size_t count);
+    void (*doubleToFloat)(float *destination, const double *source, size_t count);
+    void (*int16ToFloat)(float *destination, const int16_t *source, size_t count);
+
+    void (*monoToStereo)(float *destination, const float *source, size_t frames);
+    void (*interleave)(float *destination, const float *left, const float *right, size_t frames);
+    void (*deinterleave)(float *left, float *right, const float *source, size_t frames);
+};
+
+// -- scalar kernels, also used for the tails of the vector kernels --
+
+// the comparisons are written so NaN ends up as the lower bound, which is what
+// the SSE max instruction does as well
+template <typename T>
+static inline int16_t saturateToInt16(T sample) {
+    T value = sample * (T)32767.0;
+    value = value > (T)-32768.0 ? value : (T)-32768.0;
+    value = value < (T)32767.0 ? value : (T)32767.0;
+    return (int16_t)value;
+}
+
+static void scalarFloatToInt16(int16_t *destination, const float *source, size_t count) {
+    for (size_t i=0; i<count; ++i) {
+        destination[i] = saturateToInt16(source[i]);
+    }
+}
+
+static void scalarDoubleToInt16(int16_t *destination, const double *source, size_t count) {
+    for (size_t i=0; i<count; ++i) {
+        destination[i] = saturateToInt16(source[i]);
+    }
+}
+
+static void scalarDoubleToFloat(float *destination, const double *source, size_t count) {
+    for (size_t i=0; i<count; ++i) {
+        destination[i] = (float)source[i];
+    }
+}
+
+static void scalarInt16ToFloat(float *destination, const int16_t *source, size_t count) {
+    for (size_t i=0; i<count; ++i) {
+        destination[i] = source[i] * (1.0f / 32767.0f);
+    }
+}
+
+static void scalarMonoToStereo(float *destination, const float *source, size_t frames) {
+    for (size_t i=0; i<frames; ++i) {
+        destination[i * 2] = source[i];
+        destination[i * 2 + 1] = source[i];
+    }
+}
+
+static void scalarInterleave(float *destination, const float *left, const float *right, size_t frames) {
+    for (size_t i=0; i<frames; ++i) {
+        destination[i * 2] = left[i];
+        destination[i * 2 + 1] = right[i];
+    }
+}
+
+static void scalarDeinterleave(float *left, float *right, const float *source, size_t frames) {
+    for (size_t i=0; i<frames; ++i) {
+        left[i] = source[i * 2];
+        right[i] = source[i * 2 + 1];
+    }
+}
+
+static const ConversionKernels scalarKernels = {
+    "scalar",
+    scalarFloatToInt16,
+    scalarDoubleToInt16,
+    scalarDoubleToFloat,
+    scalarInt16ToFloat,
+    scalarMonoToStereo,
+    scalarInterleave,
+    scalarDeinterleave
+};
+
+#ifdef CONVERT_X86
+
+// -- SSE2 kernels, always available on x86_64 --
+
+static void sse2FloatToInt16(int16_t *destination, const float *source, size_t count) {
+    const __m128 scale = _mm_set1_ps(32767.0f);
+    const __m128 lower = _mm_set1_ps(-32768.0f);
+    const __m128 upper = _mm_set1_ps(32767.0f);
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128 a = _mm_mul_ps(_mm_loadu_ps(source + i), scale);
+        __m128 b = _mm_mul_ps(_mm_loadu_ps(source + i + 4), scale);
+
+        a = _mm_min_ps(_mm_max_ps(a, lower), upper);
+        b = _mm_min_ps(_mm_max_ps(b, lower), upper);
+
+        __m128i packed = _mm_packs_epi32(_mm_cvttps_epi32(a), _mm_cvttps_epi32(b));
+        _mm_storeu_si128((__m128i *)(destination + i), packed);
+    }
+
+    scalarFloatToInt16(destination + i, source + i, count - i);
+}
+
+static inline __m128i sse2DoubleToInt32(const double *source) {
+    const __m128d scale = _mm_set1_pd(32767.0);
+    const __m128d lower = _mm_set1_pd(-32768.0);
+    const __m128d upper = _mm_set1_pd(32767.0);
+
+    __m128d a = _mm_mul_pd(_mm_loadu_pd(source), scale);
+    __m128d b = _mm_mul_pd(_mm_loadu_pd(source + 2), scale);
+
+    a = _mm_min_pd(_mm_max_pd(a, lower), upper);
+    b = _mm_min_pd(_mm_max_pd(b, lower), upper);
+
+    // each conversion fills the low half of the register
+    return _mm_unpacklo_epi64(_mm_cvttpd_epi32(a), _mm_cvttpd_epi32(b));
+}
+
+static void sse2DoubleToInt16(int16_t *destination, const double *source, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i packed = _mm_packs_epi32(sse2DoubleToInt32(source + i), sse2DoubleToInt32(source + i + 4));
+        _mm_storeu_si128((__m128i *)(destination + i), packed);
+    }
+
+    scalarDoubleToInt16(destination + i, source + i, count - i);
+}
+
+static void sse2DoubleToFloat(float *destination, const double *source, size_t count) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 a = _mm_cvtpd_ps(_mm_loadu_pd(source + i));
+        __m128 b = _mm_cvtpd_ps(_mm_loadu_pd(source + i + 2));
+        _mm_storeu_ps(destination + i, _mm_movelh_ps(a, b));
+    }
+
+    scalarDoubleToFloat(destination + i, source + i, count - i);
+}
+
+static void sse2Int16ToFloat(float *destination, const int16_t *source, size_t count) {
+    const __m128 scale = _mm_set1_ps(1.0f / 32767.0f);
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i samples = _mm_loadu_si128((const __m128i *)(source + i));
+
+        // sign extend by moving each sample to the top half and shifting back
+        __m128i low = _mm_srai_epi32(_mm_unpacklo_epi16(samples, samples), 16);
+        __m128i high = _mm_srai_epi32(_mm_unpackhi_epi16(samples, samples), 16);
+
+        _mm_storeu_ps(destination + i, _mm_mul_ps(_mm_cvtepi32_ps(low), scale));
+        _mm_storeu_ps(destination + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(high), scale));
+    }
+
+    scalarInt16ToFloat(destination + i, source + i, count - i);
+}
+
+static void sse2MonoToStereo(float *destination, const float *source, size_t frames) {
+    size_t i = 0;
+    for (; i + 4 <= frames; i += 4) {
+        __m128 samples = _mm_loadu_ps(source + i);
+        _mm_storeu_ps(destination + i * 2, _mm_unpacklo_ps(samples, samples));
+        _mm_storeu_ps(destination + i * 2 + 4, _mm_unpackhi_ps(samples, samples));
+    }
+
+    scalarMonoToStereo(destination + i * 2, source + i, frames - i);
+}
+
+static void sse2Interleave(float *destination, const float *left, const float *right, size_t frames) {
+    size_t i = 0;
+    for (; i + 4 <= frames; i += 4) {
+        __m128 l = _mm_loadu_ps(left + i);
+        __m128 r = _mm_loadu_ps(right + i);
+        _mm_storeu_ps(destination + i * 2, _mm_unpacklo_ps(l, r));
+        _mm_storeu_ps(destination + i * 2 + 4, _mm_unpackhi_ps(l, r));
+    }
+
+    scalarInterleave(destination + i * 2, left + i, right + i, frames - i);
+}
+
+static void sse2Deinterleave(float *left, float *right, const float *source, size_t frames) {
+    size_t i = 0;
+    for (; i + 4 <= frames; i += 4) {
+        __m128 a = _mm_loadu_ps(source + i * 2);
+        __m128 b = _mm_loadu_ps(source + i * 2 + 4);
+        _mm_storeu_ps(left + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+        _mm_storeu_ps(right + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+
+    scalarDeinterleave(left + i, right + i, source + i * 2, frames - i);
+}
+
+static const ConversionKernels sse2Kernels = {
+    "sse2",
+    sse2FloatToInt16,
+    sse2DoubleToInt16,
+    sse2DoubleToFloat,
+    sse2Int16ToFloat,
+    sse2MonoToStereo,
+    sse2Interleave,
+    sse2Deinterleave
+};
+
+// -- AVX2 kernels, compiled for AVX2 regardless of the global flags and only
+// selected once the CPU has said it supports them --
+
+#define AVX2_KERNEL __attribute__((target("avx2")))
+
+AVX2_KERNEL static void avx2FloatToInt16(int16_t *destination, const float *source, size_t count) {
+    const __m256 scale = _mm256_set1_ps(32767.0f);
+    const __m256 lower = _mm256_set1_ps(-32768.0f);
+    const __m256 upper = _mm256_set1_ps(32767.0f);
+
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256 a = _mm256_mul_ps(_mm256_loadu_ps(source + i), scale);
+        __m256 b = _mm256_mul_ps(_mm256_loadu_ps(source + i + 8), scale);
+
+        a = _mm256_min_ps(_mm256_max_ps(a, lower), upper);
+        b = _mm256_min_ps(_mm256_max_ps(b, lower), upper);
+
+        // packing works per 128 bit lane, put the quarters back in order
+        __m256i packed = _mm256_packs_epi32(_mm256_cvttps_epi32(a), _mm256_cvttps_epi32(b));
+        packed = _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0));
+
+        _mm256_storeu_si256((__m256i *)(destination + i), packed);
+    }
+
+    sse2FloatToInt16(destination + i, source + i, count - i);
+}
+
+AVX2_KERNEL static inline __m128i avx2DoubleToInt32(const double *source) {
+    const __m256d scale = _mm256_set1_pd(32767.0);
+    const __m256d lower = _mm256_set1_pd(-32768.0);
+    const __m256d upper = _mm256_set1_pd(32767.0);
+
+    __m256d value = _mm256_mul_pd(_mm256_loadu_pd(source), scale);
+    value = _mm256_min_pd(_mm256_max_pd(value, lower), upper);
+
+    return _mm256_cvttpd_epi32(value);
+}
+
+AVX2_KERNEL static void avx2DoubleToInt16(int16_t *destination, const double *source, size_t count) {
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i a = _mm_packs_epi32(avx2DoubleToInt32(source + i), avx2DoubleToInt32(source + i + 4));
+        __m128i b = _mm_packs_epi32(avx2DoubleToInt32(source + i + 8), avx2DoubleToInt32(source + i + 12));
+
+        _mm_storeu_si128((__m128i *)(destination + i), a);
+        _mm_storeu_si128((__m128i *)(destination + i + 8), b);
+    }
+
+    sse2DoubleToInt16(destination + i, source + i, count - i);
+}
+
+AVX2_KERNEL static void avx2DoubleToFloat(float *destination, const double *source, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128 a = _mm256_cvtpd_ps(_mm256_loadu_pd(source + i));
+        __m128 b = _mm256_cvtpd_ps(_mm256_loadu_pd(source + i + 4));
+        _mm256_storeu_ps(destination + i, _mm256_insertf128_ps(_mm256_castps128_ps256(a), b, 1));
+    }
+
+    sse2DoubleToFloat(destination + i, source + i, count - i);
+}
+
+AVX2_KERNEL static void avx2Int16ToFloat(float *destination, const int16_t *source, size_t count) {
+    const __m256 scale = _mm256_set1_ps(1.0f / 32767.0f);
+
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i a = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(source + i)));
+        __m256i b = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(source + i + 8)));
+
+        _mm256_storeu_ps(destination + i, _mm256_mul_ps(_mm256_cvtepi32_ps(a), scale));
+        _mm256_storeu_ps(destination + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(b), scale));
+    }
+
+    sse2Int16ToFloat(destination + i, source + i, count - i);
+}
+
+// unpacking also works per 128 bit lane, the results are stitched back
+// together from the low and high lanes
+AVX2_KERNEL static void avx2MonoToStereo(float *destination, const float *source, size_t frames) {
+    size_t i = 0;
+    for (; i + 8 <= frames; i += 8) {
+        __m256 samples = _mm256_loadu_ps(source + i);
+        __m256 low = _mm256_unpacklo_ps(samples, samples);
+        __m256 high = _mm256_unpackhi_ps(samples, samples);
+
+        _mm256_storeu_ps(destination + i * 2, _mm256_permute2f128_ps(low, high, 0x20));
+        _mm256_storeu_ps(destination + i * 2 + 8, _mm256_permute2f128_ps(low, high, 0x31));
+    }
+
+    sse2MonoToStereo(destination + i * 2, source + i, frames - i);
+}
+
+AVX2_KERNEL static void avx2Interleave(float *destination, const float *left, const float *right, size_t frames) {
+    size_t i = 0;
+    for (; i + 8 <= frames; i += 8) {
+        __m256 l = _mm256_loadu_ps(left + i);
+        __m256 r = _mm256_loadu_ps(right + i);
+        __m256 low = _mm256_unpacklo_ps(l, r);
+        __m256 high = _mm256_unpackhi_ps(l, r);
+
+        _mm256_storeu_ps(destination + i * 2, _mm256_permute2f128_ps(low, high, 0x20));
+        _mm256_storeu_ps(destination + i * 2 + 8, _mm256_permute2f128_ps(low, high, 0x31));
+    }
+
+    sse2Interleave(destination + i * 2, left + i, right + i, frames - i);
+}
+
+AVX2_KERNEL static void avx2Deinterleave(float *left, float *right, const float *source, size_t frames) {
+    size_t i = 0;
+    for (; i + 8 <= frames; i += 8) {
+        __m256 a = _mm256_loadu_ps(source + i * 2);
+        __m256 b = _mm256_loadu_ps(source + i * 2 + 8);
+
+        // the shuffles leave the pairs in 0 2 1 3 order, swap the middle
+        __m256 l = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+        __m256 r = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+        l = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(l), _MM_SHUFFLE(3, 1, 2, 0)));
+        r = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(r), _MM_SHUFFLE(3, 1, 2, 0)));
+
+        _mm256_storeu_ps(left + i, l);
+        _mm256_storeu_ps(right + i, r);
+    }
+
+    sse2Deinterleave(left + i, right + i, source + i * 2, frames - i);
+}
+
+static const ConversionKernels avx2Kernels = {
+    "avx2",
+    avx2FloatToInt16,
+    avx2DoubleToInt16,
+    avx2DoubleToFloat,
+    avx2Int16ToFloat,
+    avx2MonoToStereo,
+    avx2Interleave,
+    avx2Deinterleave
+};
+
+#endif
+
+#ifdef CONVERT_NEON
+
+// -- NEON kernels, always available on ARM64 --
+
+// select instead of vmaxq/vminq so NaN maps to the lower bound like the other
+// implementations do
+static inline float32x4_t neonSaturate(float32x4_t value) {
+    const float32x4_t lower = vdupq_n_f32(-32768.0f);
+    const float32x4_t upper = vdupq_n_f32(32767.0f);
+
+    value = vbslq_f32(vcgtq_f32(value, lower), value, lower);
+    return vbslq_f32(vcltq_f32(value, upper), value, upper);
+}
+
+static void neonFloatToInt16(int16_t *destination, const float *source, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        float32x4_t a = neonSaturate(vmulq_n_f32(vld1q_f32(source + i), 32767.0f));
+        float32x4_t b = neonSaturate(vmulq_n_f32(vld1q_f32(source + i + 4), 32767.0f));
+
+        int16x8_t packed = vcombine_s16(vqmovn_s32(vcvtq_s32_f32(a)), vqmovn_s32(vcvtq_s32_f32(b)));
+        vst1q_s16(destination + i, packed);
+    }
+
+    scalarFloatToInt16(destination + i, source + i, count - i);
+}
+
+static inline int32x4_t neonDoubleToInt32(const double *source) {
+    const float64x2_t lower = vdupq_n_f64(-32768.0);
+    const float64x2_t upper = vdupq_n_f64(32767.0);
+
+    float64x2_t a = vmulq_n_f64(vld1q_f64(source), 32767.0);
+    float64x2_t b = vmulq_n_f64(vld1q_f64(source + 2), 32767.0);
+
+    a = vbslq_f64(vcgtq_f64(a, lower), a, lower);
+    a = vbslq_f64(vcltq_f64(a, upper), a, upper);
+    b = vbslq_f64(vcgtq_f64(b, lower), b, lower);
+    b = vbslq_f64(vcltq_f64(b, upper), b, upper);
+
+    return vcombine_s32(vmovn_s64(vcvtq_s64_f64(a)), vmovn_s64(vcvtq_s64_f64(b)));
+}
+
+static void neonDoubleToInt16(int16_t *destination, const double *source, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        int16x8_t packed = vcombine_s16(vqmovn_s32(neonDoubleToInt32(source + i)), vqmovn_s32(neonDoubleToInt32(source + i + 4)));
+        vst1q_s16(destination + i, packed);
+    }
+
+    scalarDoubleToInt16(destination + i, source + i, count - i);
+}
+
+static void neonDoubleToFloat(float *destination, const double *source, size_t count) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        float32x2_t a = vcvt_f32_f64(vld1q_f64(source + i));
+        float32x2_t b = vcvt_f32_f64(vld1q_f64(source + i + 2));
+        vst1q_f32(destination + i, vcombine_f32(a, b));
+    }
+
+    scalarDoubleToFloat(destination + i, source + i, count - i);
+}
+
+static void neonInt16ToFloat(float *destination, const int16_t *source, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        int16x8_t samples = vld1q_s16(source + i);
+        float32x4_t low = vcvtq_f32_s32(vmovl_s16(vget_low_s16(samples)));
+        float32x4_t high = vcvtq_f32_s32(vmovl_s16(vget_high_s16(samples)));
+
+        vst1q_f32(destination + i, vmulq_n_f32(low, 1.0f / 32767.0f));
+        vst1q_f32(destination + i + 4, vmulq_n_f32(high, 1.0f / 32767.0f));
+    }
+
+    scalarInt16ToFloat(destination + i, source + i, count - i);
+}
+
+// the structured loads and stores do the (de)interleaving for us
+static void neonMonoToStereo(float *destination, const float *source, size_t frames) {
+    size_t i = 0;
+    for (; i + 4 <= frames; i += 4) {
+        float32x4_t samples = vld1q_f32(source + i);
+        float32x4x2_t stereo = {{samples, samples}};
+        vst2q_f32(destination + i * 2, stereo);
+    }
+
+    scalarMonoToStereo(destination + i * 2, source + i, frames - i);
+}
+
+static void neonInterleave(float *destination, const float *left, const float *right, size_t frames) {
+    size_t i = 0;
+    for (; i + 4 <= frames; i += 4) {
+        float32x4x2_t stereo = {{vld1q_f32(left + i), vld1q_f32(right + i)}};
+        vst2q_f32(destination + i * 2, stereo);
+    }
+
+    scalarInterleave(destination + i * 2, left + i, right + i, frames - i);
+}
+
+static void neonDeinterleave(float *left, float *right, const float *source, size_t frames) {
+    size_t i = 0;
+    for (; i + 4 <= frames; i += 4) {
+        float32x4x2_t stereo = vld2q_f32(source + i * 2);
+        vst1q_f32(left + i, stereo.val[0]);
+        vst1q_f32(right + i, stereo.val[1]);
+    }
+
+    scalarDeinterleave(left + i, right + i, source + i * 2, frames - i);
+}
+
+static const ConversionKernels neonKernels = {
+    "neon",
+    neonFloatToInt16,
+    neonDoubleToInt16,
+    neonDoubleToFloat,
+    neonInt16ToFloat,
+    neonMonoToStereo,
+    neonInterleave,
+    neonDeinterleave
+};
+
+#endif
+
+static const ConversionKernels &selectKernels() {
+#if defined(CONVERT_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return avx2Kernels;
+    }
+
+    return sse2Kernels;
+#elif defined(CONVERT_NEON)
+    return neonKernels;
+#else
+    return scalarKernels;
+#endif
+}
+
+static const ConversionKernels &kernels() {
+    // initialized once, thread safe since C++11
+    static const ConversionKernels &selected = selectKernels();
+    return selected;
+}
+
+void convertToInt16(int16_t *destination, const float *source, size_t count) {
+    kernels().floatToInt16(destination, source, count);
+}
+
+void convertToInt16(int16_t *destination, const double *source, size_t count) {
+    kernels().doubleToInt16(destination, source, count);
+}
+
+void convertToFloat(float *destination, const double *source, size_t count) {
+    kernels().doubleToFloat(destination, source, count);
+}
+
+void convertToFloat(float *destination, const int16_t *source, size_t count) {
+    kernels().int16ToFloat(destination, source, count);
+}
+
+void convertToFloat(float *destination, const float *source, size_t count) {
+    memcpy(destination, source, count * sizeof(float));
+}
+
+void duplicateMonoToStereo(float *destination, const float *source, size_t frames) {
+    kernels().monoToStereo(destination, source, frames);
+}
+
+void interleaveStereo(float *destination, const float *left, const float *right, size_t frames) {
+    kernels().interleave(destination, left, right, frames);
+}
+
+void deinterleaveStereo(float *left, float *right, const float *source, size_t frames) {
+    kernels().deinterleave(left, right, source, frames);
+}
+
+const char *conversionKernelName() {
+    return kernels().name;
+}
@@ -0,0 +1,29 @@
+#ifndef __CONVERT_H
+#define __CONVERT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Sample format conversion kernels. The first call picks the fastest
+// implementation the CPU supports (AVX2 or SSE2 on x86, NEON on ARM64, plain
+// C everywhere else).
+
+// -1 to 1 range to int16, saturating and truncating like a plain cast does
+void convertToInt16(int16_t *destination, const float *source, size_t count);
+void convertToInt16(int16_t *destination, const double *source, size_t count);
+
+// int16 samples are scaled back to the -1 to 1 range, converting from float
+// is a plain copy so templated callers can treat all input types the same
+void convertToFloat(float *destination, const double *source, size_t count);
+void convertToFloat(float *destination, const int16_t *source, size_t count);
+void convertToFloat(float *destination, const float *source, size_t count);
+
+// stereo helpers, all counts are in sample frames
+void duplicateMonoToStereo(float *destination, const float *source, size_t frames);
+void interleaveStereo(float *destination, const float *left, const float *right, size_t frames);
+void deinterleaveStereo(float *left, float *right, const float *source, size_t frames);
+
+// name of the selected kernel set, for diagnostics and benchmarks
+const char *conversionKernelName();
+
+#endif
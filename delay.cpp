@@ -0,0 +1,68 @@
+#include <algorithm>
+
+#include <string.h>
+
+#include "delay.h"
+
+DelayLine::DelayLine() : buffer(1, 0.0f), mask(0), writePosition(0), blockPosition(0) {
+}
+
+void DelayLine::setCapacity(size_t maxDelay, size_t blockSize) {
+    // interpolated reads look one sample further back
+    size_t needed = maxDelay + blockSize + 1;
+
+    size_t size = 1;
+    while (size < needed) {
+        size <<= 1;
+    }
+
+    buffer.assign(size, 0.0f);
+    mask = size - 1;
+    writePosition = 0;
+    blockPosition = 0;
+}
+
+void DelayLine::clear() {
+    std::fill(buffer.begin(), buffer.end(), 0.0f);
+}
+
+void DelayLine::write(const float *input, size_t frames) {
+    size_t start = writePosition & mask;
+    size_t first = std::min(frames, buffer.size() - start);
+
+    memcpy(buffer.data() + start, input, first * sizeof(float));
+    memcpy(buffer.data(), input + first, (frames - first) * sizeof(float));
+
+    blockPosition = writePosition;
+    writePosition += frames;
+}
+
+void DelayLine::read(float *output, size_t frames, size_t delay) const {
+    size_t start = (blockPosition - delay) & mask;
+    size_t first = std::min(frames, buffer.size() - start);
+
+    memcpy(output, buffer.data() + start, first * sizeof(float));
+    memcpy(output + first, buffer.data(), (frames - first) * sizeof(float));
+}
+
+bool DelayLine::fits(size_t maxDelay, size_t blockSize) const {
+    return maxDelay + blockSize + 1 <= buffer.size();
+}
+
+void DelayLine::copyHistory(const DelayLine &other) {
+    clear();
+
+    writePosition = other.writePosition;
+    blockPosition = other.blockPosition;
+
+    // positions count up forever, the newest samples end up in the same
+    // place relative to them
+    size_t count = std::min(buffer.size(), other.buffer.size());
+    for (size_t i=1; i<=count; ++i) {
+        buffer[(writePosition - i) & mask] = other.buffer[(writePosition - i) & other.mask];
+    }
+}
+
+size_t DelayLine::getMaxDelay() const {
+    return buffer.size() - 1;
+}
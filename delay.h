@@ -0,0 +1,86 @@
+#ifndef __DELAY_H
+#define __DELAY_H
+
+#include <vector>
+
+#include <stddef.h>
+
+// Ring buffer of past samples with a power-of-two size, so positions wrap
+// with a mask. A block is written first and then read back at some delay,
+// whole blocks move with at most two memcpy calls each.
+class DelayLine {
+    private:
+        std::vector<float> buffer;
+        size_t mask;
+
+        // where the next block will be written, wraps through the mask
+        size_t writePosition;
+
+        // start of the block that was written last
+        size_t blockPosition;
+    public:
+        DelayLine();
+
+        // room for delays of up to maxDelay samples behind blocks of up to
+        // blockSize frames, clears the line
+        void setCapacity(size_t maxDelay, size_t blockSize);
+        void clear();
+
+        // whether the line already has room for the delay
+        bool fits(size_t maxDelay, size_t blockSize) const;
+
+        // continues with the history of another line, as much as fits
+        void copyHistory(const DelayLine &other);
+
+        void write(const float *input, size_t frames);
+
+        // the last written block delayed by a whole number of samples, 0 gives
+        // the block itself
+        void read(float *output, size_t frames, size_t delay) const;
+
+        // one sample of the last written block at a fractional delay, linearly
+        // interpolated, delay has to be within the capacity
+        inline float readInterpolated(size_t frame, double delay) const {
+            size_t whole = (size_t)delay;
+            float fraction = (float)(delay - whole);
+
+            size_t position = blockPosition + frame - whole;
+            float newer = buffer[position & mask];
+            float older = buffer[(position - 1) & mask];
+
+            return newer + (older - newer) * fraction;
+        }
+
+        size_t getMaxDelay() const;
+
+        // A block written and read one sample at a time, for fused loops.
+        // Gives the same samples as write() followed by read(), the position
+        // goes back into the line with store().
+        class Cursor {
+            private:
+                DelayLine &line;
+                float *buffer;
+                size_t mask;
+
+                size_t start;
+                size_t position;
+            public:
+                Cursor(DelayLine &line) : line(line), buffer(line.buffer.data()), mask(line.mask), start(line.writePosition), position(line.writePosition) {
+                }
+
+                inline float tick(float input, size_t delay) {
+                    buffer[position & mask] = input;
+                    float output = buffer[(position - delay) & mask];
+                    ++position;
+
+                    return output;
+                }
+
+                void store() {
+                    line.blockPosition = start;
+                    line.writePosition = position;
+                }
+        };
+};
+
+#endif
@@ -0,0 +1,819 @@
+#include <algorithm>
+#include <unordered_map>
+
+#include <math.h>
+
+#include "audio.h"
+#include "graph.h"
+#include "nodes.h"
+
+bool GraphNode::setParam(int, double) {
+    return false;
+}
+
+bool GraphNode::getParam(int, double &) const {
+    return false;
+}
+
+void GraphNode::copyState(const GraphNode &) {
+}
+
+bool GraphNode::canSchedule(int, double) const {
+    return true;
+}
+
+bool GraphNode::canRamp(int) const {
+    return false;
+}
+
+bool GraphNode::rampParam(int, double, double, size_t) {
+    return false;
+}
+
+bool GraphNode::setSampleFile(const char *) {
+    return false;
+}
+
+const char *GraphNode::getSampleFile() const {
+    return nullptr;
+}
+
+bool GraphNode::isSerial() const {
+    return false;
+}
+
+void GraphNode::setSink(SampleSink *) {
+}
+
+double AudioGraph::ParamRamp::valueAt(int64_t frame) const {
+    if (frame >= endFrame) {
+        return target;
+    }
+
+    double progress = std::max((double)(frame - startFrame) / (endFrame - startFrame), 0.0);
+
+    // exponential ramps need both ends on the same side of zero
+    if (curve == AUDIO_RAMP_EXPONENTIAL && start * target > 0.0) {
+        return start * pow(target / start, progress);
+    }
+
+    return start + (target - start) * progress;
+}
+
+AudioGraph::Automation::Automation(size_t blockSize) : queue(maxEvents) {
+    pending.reserve(maxEvents);
+    block.reserve(maxChanges + maxRamps * (blockSize / rampInterval + 2));
+    ramps.reserve(maxRamps);
+}
+
+void AudioGraph::Automation::insertByFrame(std::vector<ParamEvent> &events, const ParamEvent &event) {
+    auto position = std::upper_bound(events.begin(), events.end(), event, [](const ParamEvent &a, const ParamEvent &b) {
+        return a.frame < b.frame;
+    });
+
+    events.insert(position, event);
+}
+
+AudioGraph::Step::Step() : type(-1), output(-1), key(-1), previous(-1), paramEvents(false), fusedInto(-1) {
+    std::fill(inputs, inputs + GraphNode::maxInputs, -1);
+}
+
+AudioGraph::AudioGraph(int sampleRate, size_t blockSize) : sampleRate(sampleRate), blockSize(blockSize), bufferCount(0), silence(blockSize, 0.0f), discards(1, std::vector<float>(blockSize)), scheduleChanged(true), blockFrames(0), automation(nullptr), blockStart(0), position(0), sink(nullptr) {
+    threadPolicy.flushDenormals = true;
+}
+
+AudioGraph::~AudioGraph() {
+    delete automation.load();
+
+    if (sink) {
+        sink->release();
+    }
+}
+
+const float *AudioGraph::inputBuffer(int buffer) const {
+    if (buffer < 0) {
+        return silence.data();
+    }
+
+    return buffers.data() + buffer * blockSize;
+}
+
+float *AudioGraph::outputBuffer(int buffer, int worker) {
+    if (buffer < 0) {
+        return discards[worker].data();
+    }
+
+    return buffers.data() + buffer * blockSize;
+}
+
+int AudioGraph::addNode(int type) {
+    GraphNode *node = createGraphNode(type, sampleRate, blockSize);
+    if (!node) {
+        return -1;
+    }
+
+    Step step;
+    step.node.reset(node);
+    step.type = type;
+    step.node->setSink(sink);
+
+    steps.push_back(std::move(step));
+    scheduleChanged = true;
+
+    return (int)steps.size() - 1;
+}
+
+AudioGraph *AudioGraph::clone() const {
+    AudioGraph *graph = new AudioGraph(sampleRate, blockSize);
+
+    for (const auto &step : steps) {
+        Step copy;
+        copy.node.reset(step.node->clone());
+        copy.type = step.type;
+        std::copy(step.inputs, step.inputs + GraphNode::maxInputs, copy.inputs);
+        copy.output = step.output;
+        copy.key = step.key;
+
+        graph->steps.push_back(std::move(copy));
+    }
+
+    graph->bufferCount = bufferCount;
+    graph->buffers.resize(buffers.size(), 0.0f);
+    graph->threadPolicy = threadPolicy;
+    graph->setThreadCount(getThreadCount());
+
+    return graph;
+}
+
+void AudioGraph::setSink(SampleSink *sink) {
+    if (sink == this->sink) {
+        return;
+    }
+
+    if (sink) {
+        sink->retain();
+    }
+    if (this->sink) {
+        this->sink->release();
+    }
+    this->sink = sink;
+
+    for (auto &step : steps) {
+        step.node->setSink(sink);
+    }
+}
+
+bool AudioGraph::setInput(int node, int input, int buffer) {
+    if (node < 0 || node >= (int)steps.size() || input < 0 || input >= GraphNode::maxInputs || buffer >= bufferCount) {
+        return false;
+    }
+
+    steps[node].inputs[input] = std::max(buffer, -1);
+    scheduleChanged = true;
+
+    return true;
+}
+
+bool AudioGraph::setOutput(int node, int buffer) {
+    if (node < 0 || node >= (int)steps.size()) {
+        return false;
+    }
+
+    // buffers are numbered by the compiler, grow the storage to fit so it is
+    // all allocated before rendering starts
+    if (buffer >= bufferCount) {
+        bufferCount = buffer + 1;
+        buffers.resize(bufferCount * blockSize, 0.0f);
+    }
+
+    steps[node].output = std::max(buffer, -1);
+    scheduleChanged = true;
+
+    return true;
+}
+
+bool AudioGraph::setParam(int node, int param, double value) {
+    if (node < 0 || node >= (int)steps.size()) {
+        return false;
+    }
+
+    return steps[node].node->setParam(param, value);
+}
+
+bool AudioGraph::scheduleParam(int node, int param, double value, int64_t frame, int64_t rampFrames, int curve) {
+    if (node < 0 || node >= (int)steps.size() || !steps[node].node->canSchedule(param, value)) {
+        return false;
+    }
+
+    // the render thread only looks at it once it is published
+    Automation *current = automation.load(std::memory_order_acquire);
+    if (!current) {
+        current = new Automation(blockSize);
+        automation.store(current, std::memory_order_release);
+    }
+
+    ParamEvent event = {node, param, value, frame, std::max(rampFrames, (int64_t)0), curve, 0.0};
+    return current->queue.push(event);
+}
+
+int64_t AudioGraph::getPosition() const {
+    return position.load(std::memory_order_acquire);
+}
+
+bool AudioGraph::setNodeKey(int node, int key) {
+    if (node < 0 || node >= (int)steps.size()) {
+        return false;
+    }
+
+    steps[node].key = std::max(key, -1);
+    return true;
+}
+
+void AudioGraph::prepare() {
+    if (!scheduleChanged) {
+        return;
+    }
+
+    updateFusion();
+    if (scheduler) {
+        updateSchedule();
+    }
+
+    scheduleChanged = false;
+}
+
+void AudioGraph::prepareTakeOver(const AudioGraph &previous) {
+    // the first node with a key and type wins, like the search it replaces
+    std::unordered_map<int64_t, int> nodes;
+    nodes.reserve(previous.steps.size());
+    for (int i=0; i<(int)previous.steps.size(); ++i) {
+        const Step &old = previous.steps[i];
+        if (old.key >= 0) {
+            nodes.emplace(((int64_t)old.key << 32) | (uint32_t)old.type, i);
+        }
+    }
+
+    successors.assign(previous.steps.size(), -1);
+    for (int i=0; i<(int)steps.size(); ++i) {
+        Step &step = steps[i];
+        step.previous = -1;
+        if (step.key < 0) {
+            continue;
+        }
+
+        auto match = nodes.find(((int64_t)step.key << 32) | (uint32_t)step.type);
+        if (match != nodes.end()) {
+            step.previous = match->second;
+            if (successors[match->second] < 0) {
+                successors[match->second] = i;
+            }
+        }
+    }
+
+    // room for the automation of the previous graph, which the control
+    // thread set up if there is any
+    if (previous.automation.load(std::memory_order_acquire) && !automation.load(std::memory_order_relaxed)) {
+        automation.store(new Automation(blockSize), std::memory_order_release);
+    }
+}
+
+void AudioGraph::takeOver(AudioGraph &previous) {
+    for (auto &step : steps) {
+        if (step.previous >= 0 && step.previous < (int)previous.steps.size()) {
+            step.node->copyState(*previous.steps[step.previous].node);
+        }
+    }
+
+    Automation *from = previous.automation.load(std::memory_order_acquire);
+    Automation *to = automation.load(std::memory_order_relaxed);
+    if (from && to && successors.size() == previous.steps.size()) {
+        // changes scheduled on the previous graph until now count as well,
+        // they stay its own like the rest
+        ParamEvent event;
+        while (from->pending.size() < Automation::maxEvents && from->queue.pop(event)) {
+            Automation::insertByFrame(from->pending, event);
+        }
+
+        for (const auto &event : from->pending) {
+            int node = successors[event.node];
+            if (node >= 0 && to->pending.size() < Automation::maxEvents) {
+                ParamEvent moved = event;
+                moved.node = node;
+                Automation::insertByFrame(to->pending, moved);
+            }
+        }
+
+        for (const auto &ramp : from->ramps) {
+            int node = successors[ramp.node];
+            if (node >= 0 && to->ramps.size() < Automation::maxRamps) {
+                ParamRamp moved = ramp;
+                moved.node = node;
+                to->ramps.push_back(moved);
+            }
+        }
+    }
+
+    blockStart = previous.blockStart;
+    position.store(blockStart, std::memory_order_release);
+}
+
+int AudioGraph::getNodeCount(int type) const {
+    int count = 0;
+    for (const auto &step : steps) {
+        if (step.type == type) {
+            ++count;
+        }
+    }
+
+    return count;
+}
+
+int AudioGraph::getNodeCount() const {
+    return (int)steps.size();
+}
+
+int AudioGraph::getNodeType(int node) const {
+    return node >= 0 && node < (int)steps.size() ? steps[node].type : -1;
+}
+
+int AudioGraph::getNodeKey(int node) const {
+    return node >= 0 && node < (int)steps.size() ? steps[node].key : -1;
+}
+
+int AudioGraph::getInput(int node, int input) const {
+    if (node < 0 || node >= (int)steps.size() || input < 0 || input >= GraphNode::maxInputs) {
+        return -1;
+    }
+
+    return steps[node].inputs[input];
+}
+
+int AudioGraph::getOutput(int node) const {
+    return node >= 0 && node < (int)steps.size() ? steps[node].output : -1;
+}
+
+bool AudioGraph::getParam(int node, int param, double &value) const {
+    if (node < 0 || node >= (int)steps.size()) {
+        return false;
+    }
+
+    return steps[node].node->getParam(param, value);
+}
+
+const char *AudioGraph::getSampleFile(int node) const {
+    if (node < 0 || node >= (int)steps.size()) {
+        return nullptr;
+    }
+
+    return steps[node].node->getSampleFile();
+}
+
+bool AudioGraph::setSampleFile(int node, const char *path) {
+    if (node < 0 || node >= (int)steps.size()) {
+        return false;
+    }
+
+    return steps[node].node->setSampleFile(path);
+}
+
+void AudioGraph::setThreadCount(int threadCount) {
+    threadCount = std::max(threadCount, 1);
+
+    scheduler.reset(threadCount > 1 ? new TaskScheduler(threadCount, threadPolicy) : nullptr);
+    discards.resize(threadCount, std::vector<float>(blockSize));
+    scheduleChanged = true;
+}
+
+int AudioGraph::getThreadCount() const {
+    return scheduler ? scheduler->getThreadCount() : 1;
+}
+
+void AudioGraph::setThreadPolicy(const ThreadPolicy &policy) {
+    threadPolicy = policy;
+    threadPolicy.flushDenormals = true;
+
+    // the workers only apply it when they start
+    setThreadCount(getThreadCount());
+}
+
+void AudioGraph::gatherInputs(const Step &step, const float **inputs) const {
+    for (int i=0; i<GraphNode::maxInputs; ++i) {
+        inputs[i] = inputBuffer(step.inputs[i]);
+    }
+}
+
+void AudioGraph::runNode(int index, int worker, size_t frames) {
+    Step &step = steps[index];
+
+    const float *inputs[GraphNode::maxInputs];
+    gatherInputs(step, inputs);
+
+    float *output = outputBuffer(step.output, worker);
+
+    if (!step.paramEvents) {
+        step.node->process(inputs, output, frames);
+        return;
+    }
+
+    // process up to every change of the node and apply it there
+    const float *segmentInputs[GraphNode::maxInputs];
+    size_t done = 0;
+
+    auto processUntil = [&](size_t end) {
+        if (end <= done) {
+            return;
+        }
+
+        for (int i=0; i<GraphNode::maxInputs; ++i) {
+            segmentInputs[i] = inputs[i] + done;
+        }
+
+        step.node->process(segmentInputs, output + done, end - done);
+        done = end;
+    };
+
+    for (const auto &event : automation.load(std::memory_order_relaxed)->block) {
+        if (event.node != index) {
+            continue;
+        }
+
+        processUntil((size_t)(event.frame - blockStart));
+        if (event.rampFrames > 0) {
+            step.node->rampParam(event.param, event.value, event.step, (size_t)event.rampFrames);
+        } else {
+            step.node->setParam(event.param, event.value);
+        }
+    }
+
+    processUntil(frames);
+}
+
+void AudioGraph::runStep(int index, int worker, size_t frames) {
+    Step &step = steps[index];
+
+    // runs along with the node it is fused into
+    if (step.fusedInto >= 0) {
+        return;
+    }
+
+    if (step.fused) {
+        int count = (int)step.fusedNodes.size();
+        bool paramEvents = step.paramEvents;
+        for (int node : step.fusedNodes) {
+            paramEvents = paramEvents || steps[node].paramEvents;
+        }
+
+        if (!paramEvents) {
+            const float *inputs[FusedChain::maxNodes][GraphNode::maxInputs];
+            const float *const *chainInputs[FusedChain::maxNodes];
+            for (int i=0; i<count; ++i) {
+                gatherInputs(steps[step.fusedNodes[i]], inputs[i]);
+                chainInputs[i] = inputs[i];
+            }
+            gatherInputs(step, inputs[count]);
+            chainInputs[count] = inputs[count];
+
+            step.fused->process(chainInputs, outputBuffer(step.output, worker), frames);
+            return;
+        }
+
+        // changes land between samples, which the fused loop can't do
+        for (int node : step.fusedNodes) {
+            runNode(node, worker, frames);
+        }
+    }
+
+    runNode(index, worker, frames);
+}
+
+void AudioGraph::runTask(int task, int worker) {
+    runStep(task, worker, blockFrames);
+}
+
+bool AudioGraph::currentValue(const Automation *automation, int node, int param, int64_t frame, double &value) const {
+    // a change earlier in the block hasn't reached the node yet, the block
+    // only has changes of the parameter up to the frame
+    for (auto event = automation->block.rbegin(); event != automation->block.rend(); ++event) {
+        if (event->node == node && event->param == param) {
+            value = event->value + event->step * std::min(frame - event->frame, event->rampFrames);
+            return true;
+        }
+    }
+
+    return steps[node].node->getParam(param, value);
+}
+
+void AudioGraph::startAutomation(Automation *automation, size_t frames) {
+    int64_t blockEnd = blockStart + frames;
+
+    std::vector<ParamEvent> &pending = automation->pending;
+    std::vector<ParamEvent> &block = automation->block;
+    std::vector<ParamRamp> &ramps = automation->ramps;
+
+    for (const auto &event : block) {
+        steps[event.node].paramEvents = false;
+    }
+    block.clear();
+
+    ParamEvent event;
+    while (pending.size() < Automation::maxEvents && automation->queue.pop(event)) {
+        Automation::insertByFrame(pending, event);
+    }
+
+    // the reserve covers every change a block can have, the check only
+    // keeps a miscount from allocating on the render thread
+    auto addChange = [&](int node, int param, double value, int64_t frame) {
+        if (block.size() == block.capacity()) {
+            return;
+        }
+
+        ParamEvent change = {node, param, value, frame, 0, AUDIO_RAMP_LINEAR, 0.0};
+        Automation::insertByFrame(block, change);
+        steps[node].paramEvents = true;
+    };
+
+    // the part of a ramp in this block up to the frame: one linear piece
+    // for a node that interpolates the parameter, pieces of rampInterval
+    // frames for exponential curves, and a single step for nodes that can't
+    // interpolate, whose parameters are often expensive to change like
+    // filter cutoffs. A block out of room gets a single step.
+    auto addRamp = [&](const ParamRamp &ramp, int64_t frame) {
+        int64_t from = std::max(ramp.startFrame, blockStart);
+        int64_t to = std::min(frame, ramp.endFrame);
+        if (from >= to) {
+            return;
+        }
+
+        bool interpolates = steps[ramp.node].node->canRamp(ramp.param);
+        int64_t interval = interpolates && ramp.curve == AUDIO_RAMP_EXPONENTIAL ? Automation::rampInterval : to - from;
+        if (block.size() + (size_t)((to - from + interval - 1) / interval) + Automation::maxChanges > block.capacity()) {
+            addChange(ramp.node, ramp.param, ramp.valueAt(from), from);
+            return;
+        }
+
+        for (int64_t start=from; start<to; start+=interval) {
+            int64_t end = std::min(start + interval, to);
+            double value = ramp.valueAt(start);
+
+            if (!interpolates) {
+                addChange(ramp.node, ramp.param, value, start);
+                continue;
+            }
+
+            ParamEvent piece = {ramp.node, ramp.param, value, start, end - start, ramp.curve, (ramp.valueAt(end) - value) / (end - start)};
+            Automation::insertByFrame(block, piece);
+            steps[ramp.node].paramEvents = true;
+        }
+    };
+
+    // ramps that end before the frame finish exactly, the others stop where
+    // they are
+    auto cancelRamps = [&](int node, int param, int64_t frame) {
+        for (size_t i=0; i<ramps.size(); ) {
+            ParamRamp &ramp = ramps[i];
+            if (ramp.node != node || ramp.param != param) {
+                ++i;
+                continue;
+            }
+
+            addRamp(ramp, frame);
+            if (ramp.endFrame <= frame) {
+                addChange(ramp.node, ramp.param, ramp.target, ramp.endFrame);
+            }
+
+            ramp = ramps.back();
+            ramps.pop_back();
+        }
+    };
+
+    size_t due = 0;
+    for (; due<pending.size() && pending[due].frame < blockEnd; ++due) {
+        ParamEvent event = pending[due];
+        event.frame = std::max(event.frame, blockStart);
+
+        cancelRamps(event.node, event.param, event.frame);
+
+        double start;
+        if (event.rampFrames > 0 && ramps.size() < Automation::maxRamps && currentValue(automation, event.node, event.param, event.frame, start)) {
+            ParamRamp ramp = {event.node, event.param, start, event.value, event.frame, event.frame + event.rampFrames, event.curve};
+            ramps.push_back(ramp);
+        } else {
+            addChange(event.node, event.param, event.value, event.frame);
+        }
+    }
+    pending.erase(pending.begin(), pending.begin() + due);
+
+    // the running ramps go through the block and land on their target if
+    // they end inside it
+    for (size_t i=0; i<ramps.size(); ) {
+        ParamRamp &ramp = ramps[i];
+        addRamp(ramp, blockEnd);
+
+        if (ramp.endFrame >= blockEnd) {
+            ++i;
+            continue;
+        }
+
+        addChange(ramp.node, ramp.param, ramp.target, ramp.endFrame);
+        ramp = ramps.back();
+        ramps.pop_back();
+    }
+}
+
+void AudioGraph::updateFusion() {
+    for (auto &step : steps) {
+        step.fusedNodes.clear();
+        step.fusedInto = -1;
+        step.fused.reset();
+    }
+
+    int count = (int)steps.size();
+
+    // whether the value the source writes to the buffer is only read by the
+    // given input of the target, blocks wrap around to the start
+    auto onlyReader = [&](int source, int buffer, int target, int input) {
+        for (int i=(source + 1) % count; i!=source; i=(i + 1) % count) {
+            const Step &step = steps[i];
+
+            for (int j=0; j<GraphNode::maxInputs; ++j) {
+                if (step.inputs[j] == buffer && (i != target || j != input)) {
+                    return false;
+                }
+            }
+
+            if (step.output == buffer) {
+                break;
+            }
+        }
+
+        return true;
+    };
+
+    // the fused chain reads the inputs of the source when the target runs,
+    // nothing in between may overwrite them
+    auto inputsKept = [&](int source, int target) {
+        for (int i=source + 1; i<target; ++i) {
+            for (int input : steps[source].inputs) {
+                if (input >= 0 && steps[i].output == input) {
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    };
+
+    std::vector<int> writers(bufferCount, -1);
+
+    for (int i=0; i<count; ++i) {
+        Step &step = steps[i];
+
+        for (int input=0; input<GraphNode::maxInputs && !step.fused; ++input) {
+            int buffer = step.inputs[input];
+            int source = buffer >= 0 ? writers[buffer] : -1;
+            if (source < 0 || steps[source].fusedInto >= 0) {
+                continue;
+            }
+
+            // the source may be the end of a pair, which grows into a chain
+            std::vector<int> chain = steps[source].fusedNodes;
+            chain.push_back(source);
+            if ((int)chain.size() >= FusedChain::maxNodes || !onlyReader(source, buffer, i, input)) {
+                continue;
+            }
+
+            bool kept = true;
+            for (int node : chain) {
+                kept = kept && inputsKept(node, i);
+            }
+            if (!kept) {
+                continue;
+            }
+
+            GraphNode *nodes[FusedChain::maxNodes];
+            int types[FusedChain::maxNodes];
+            for (size_t j=0; j<chain.size(); ++j) {
+                nodes[j] = steps[chain[j]].node.get();
+                types[j] = steps[chain[j]].type;
+            }
+            nodes[chain.size()] = step.node.get();
+            types[chain.size()] = step.type;
+
+            step.fused.reset(createFusedChain(nodes, types, (int)chain.size() + 1, input));
+            if (step.fused) {
+                for (int node : chain) {
+                    steps[node].fusedInto = i;
+                }
+                steps[source].fusedNodes.clear();
+                steps[source].fused.reset();
+                step.fusedNodes = chain;
+            }
+        }
+
+        if (step.output >= 0) {
+            writers[step.output] = i;
+        }
+    }
+}
+
+void AudioGraph::updateSchedule() {
+    std::vector<std::vector<int>> dependencies(steps.size());
+
+    // last node that wrote each buffer and the nodes that read it since
+    std::vector<int> writers(bufferCount, -1);
+    std::vector<std::vector<int>> readers(bufferCount);
+    int lastSerial = -1;
+
+    auto dependOn = [&](int node, int dependency) {
+        std::vector<int> &list = dependencies[node];
+        if (dependency >= 0 && dependency != node && std::find(list.begin(), list.end(), dependency) == list.end()) {
+            list.push_back(dependency);
+        }
+    };
+
+    auto readBuffer = [&](int node, int buffer) {
+        if (buffer >= 0) {
+            dependOn(node, writers[buffer]);
+            readers[buffer].push_back(node);
+        }
+    };
+
+    for (int i=0; i<(int)steps.size(); ++i) {
+        Step &step = steps[i];
+
+        for (int input : step.inputs) {
+            readBuffer(i, input);
+        }
+
+        // a fused node also reads the inputs of the nodes it took in
+        for (int node : step.fusedNodes) {
+            for (int input : steps[node].inputs) {
+                readBuffer(i, input);
+            }
+        }
+
+        if (step.output >= 0) {
+            // the previous contents have to be written and read completely
+            // before we overwrite them
+            dependOn(i, writers[step.output]);
+            for (int reader : readers[step.output]) {
+                dependOn(i, reader);
+            }
+
+            writers[step.output] = i;
+            readers[step.output].clear();
+        }
+
+        if (step.node->isSerial()) {
+            dependOn(i, lastSerial);
+            lastSerial = i;
+        }
+    }
+
+    scheduler->setGraph(dependencies);
+}
+
+void AudioGraph::render(size_t frames) {
+    prepare();
+
+    // decaying filters and feedback loops would otherwise crawl through
+    // denormals, worker threads flush them for good
+    DenormalGuard denormalGuard;
+
+    for (size_t offset=0; offset<frames; offset+=blockSize) {
+        size_t count = std::min(blockSize, frames - offset);
+
+        Automation *current = automation.load(std::memory_order_acquire);
+        if (current) {
+            startAutomation(current, count);
+        }
+
+        if (scheduler) {
+            blockFrames = count;
+            scheduler->run(this);
+        } else {
+            for (int i=0; i<(int)steps.size(); ++i) {
+                runStep(i, 0, count);
+            }
+        }
+
+        blockStart += count;
+        position.store(blockStart, std::memory_order_release);
+    }
+}
+
+const float *AudioGraph::getBuffer(int buffer) const {
+    if (buffer < 0 || buffer >= bufferCount) {
+        return NULL;
+    }
+
+    return inputBuffer(buffer);
+}
+
+size_t AudioGraph::getBlockSize() const {
+    return blockSize;
+}
+
+int AudioGraph::getSampleRate() const {
+    return sampleRate;
+}
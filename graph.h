@@ -0,0 +1,327 @@
+#ifndef __GRAPH_H
+#define __GRAPH_H
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ringbuffer.h"
+#include "scheduler.h"
+
+// Where the OutputDevice nodes of a graph send their blocks when it isn't
+// feeding the renderer.
+class SampleSink {
+    public:
+        virtual ~SampleSink() {}
+
+        virtual void write(const float *samples, size_t count) = 0;
+
+        // graphs hold a reference to their sink, sinks with an owner of
+        // their own like the captures of a live graph ignore these
+        virtual void retain() {}
+        virtual void release() {}
+};
+
+// A node of the native graph runtime. Every call processes a whole block,
+// inputs that aren't connected point at a block of silence.
+class GraphNode {
+    public:
+        static const int maxInputs = 3;
+
+        virtual ~GraphNode() {}
+
+        virtual void process(const float *const *inputs, float *output, size_t frames) = 0;
+
+        // a fresh node with the same parameters and sample file
+        virtual GraphNode *clone() const = 0;
+
+        // carries over the running state of a node of the same type, like
+        // phases and filter histories, when a graph replaces another. The
+        // parameters stay those of this node.
+        virtual void copyState(const GraphNode &other);
+
+        // all of these return false if the node doesn't take the parameter
+        virtual bool setParam(int param, double value);
+        virtual bool getParam(int param, double &value) const;
+        virtual bool setSampleFile(const char *path);
+
+        // whether the render thread can apply the change with setParam
+        // without allocating, asked by the control thread before it
+        // schedules one. Parameters that resize the node never qualify.
+        virtual bool canSchedule(int param, double value) const;
+
+        // ramps of parameters the node can interpolate itself: from value,
+        // moving by step every frame for the next frames frames process()
+        // runs, a setParam of the parameter stops it. The others get plain
+        // changes every few frames instead.
+        virtual bool canRamp(int param) const;
+        virtual bool rampParam(int param, double value, double step, size_t frames);
+
+        // path of the file playing, NULL for none
+        virtual const char *getSampleFile() const;
+
+        // nodes with effects outside the graph, like feeding the renderer,
+        // keep their program order when the graph runs in parallel
+        virtual bool isSerial() const;
+
+        // NULL goes back to feeding the renderer, only output nodes care
+        virtual void setSink(SampleSink *sink);
+};
+
+// Up to maxNodes nodes run as one loop, each one's output goes straight into
+// an input of the next without a trip through a port buffer. Made by
+// createFusedChain from the nodes themselves, which keep their parameters.
+class FusedChain {
+    public:
+        static const int maxNodes = 3;
+
+        virtual ~FusedChain() {}
+
+        // the inputs of every node of the chain in order
+        virtual void process(const float *const *const *inputs, float *output, size_t frames) = 0;
+};
+
+// Runs a compiled render program block by block. Nodes run in the order they
+// were added, which has to be a topological order, and communicate through
+// numbered block buffers the compiler assigns to their ports. Every stream
+// gets its own graph, nothing in here is shared.
+//
+// With more than one thread the program is turned back into a DAG from the
+// buffer assignments: a node depends on the last writer of the buffers it
+// reads, and since buffers get reused also on the readers of the previous
+// contents of the buffer it writes. Independent nodes of a block then run on
+// a work-stealing TaskScheduler, the block ends when all of them are done.
+//
+// Parameters can also be scheduled ahead from a control thread. The events go
+// through a lock-free queue and are picked up at the start of every block:
+// a change lands on its exact frame by splitting the block of its node there.
+// Ramps of parameters the node can interpolate, like levels and band gains,
+// move every sample: in one linear piece per block, or in 32 frame pieces
+// for exponential curves. The others, like filter cutoffs, step once per
+// block so their coefficients are only recomputed once per block.
+//
+// Where a node's output only feeds one input of a later node and both have
+// per-sample kernels, the pair runs fused at the position of the later node,
+// chains of three fuse through a low pass or delay in the middle. The
+// intermediate buffers aren't written then. Blocks with parameter changes for
+// any node of a chain run its nodes separately.
+class AudioGraph : public CacheAligned, private TaskRunner {
+    private:
+        struct Step {
+            std::unique_ptr<GraphNode> node;
+            int type;
+            int inputs[GraphNode::maxInputs];
+            int output;
+
+            // identifies the node across recompiles of a patch, -1 for none
+            int key;
+
+            // node of the graph taken over from with the same key and type,
+            // -1 for none
+            int previous;
+
+            // has changes in the current block
+            bool paramEvents;
+
+            // the earlier nodes of a fused chain are skipped, the last one
+            // runs them all through fused. fusedNodes has the earlier ones
+            // in order.
+            std::vector<int> fusedNodes;
+            int fusedInto;
+            std::unique_ptr<FusedChain> fused;
+
+            Step();
+        };
+
+        // inside a block rampFrames > 0 is a piece of a ramp handed to
+        // rampParam, moving by step every frame
+        struct ParamEvent {
+            int node;
+            int param;
+            double value;
+            int64_t frame;
+            int64_t rampFrames;
+            int curve;
+            double step;
+        };
+
+        struct ParamRamp {
+            int node;
+            int param;
+            double start;
+            double target;
+            int64_t startFrame;
+            int64_t endFrame;
+            int curve;
+
+            double valueAt(int64_t frame) const;
+        };
+
+        // the queue is filled by the control thread, the rest belongs to the
+        // render thread. It is only allocated once something gets scheduled
+        // so batches of clones don't pay for it.
+        struct Automation : CacheAligned {
+            static const size_t maxEvents = 1024;
+            static const size_t maxRamps = 256;
+
+            // room in block kept for single changes: every due event makes
+            // one, and every ramp that is cancelled or runs through a block
+            // makes two at most (a fallback step and its end). A block takes
+            // at most maxEvents events and maxRamps + maxEvents ramps.
+            static const size_t maxChanges = 3 * maxEvents + 2 * maxRamps;
+
+            // length of the linear pieces exponential ramps are made of
+            static const int64_t rampInterval = 32;
+
+            SpscQueue<ParamEvent> queue;
+
+            // sorted by frame, in scheduling order for the same frame
+            std::vector<ParamEvent> pending;
+
+            // changes and ramp pieces inside the current block, pieces leave
+            // maxChanges free so the changes always fit
+            std::vector<ParamEvent> block;
+
+            std::vector<ParamRamp> ramps;
+
+            Automation(size_t blockSize);
+
+            // into the reserved capacity, so it doesn't allocate
+            static void insertByFrame(std::vector<ParamEvent> &events, const ParamEvent &event);
+        };
+
+        int sampleRate;
+        size_t blockSize;
+
+        std::vector<Step> steps;
+
+        // all port buffers back to back, blockSize floats each
+        std::vector<float> buffers;
+        int bufferCount;
+
+        // read by unconnected inputs, unconnected outputs write to the
+        // discard block of the worker running them
+        std::vector<float> silence;
+        std::vector<std::vector<float>> discards;
+
+        std::unique_ptr<TaskScheduler> scheduler;
+        ThreadPolicy threadPolicy;
+        bool scheduleChanged;
+        size_t blockFrames;
+
+        std::atomic<Automation *> automation;
+
+        // first frame of the current block, position is the same for other
+        // threads and only updated between blocks
+        int64_t blockStart;
+        std::atomic<int64_t> position;
+
+        // retained while set, NULL feeds the renderer
+        SampleSink *sink;
+
+        // by node of the graph given to prepareTakeOver, the first node here
+        // that takes over from it or -1
+        std::vector<int> successors;
+
+        const float *inputBuffer(int buffer) const;
+        float *outputBuffer(int buffer, int worker);
+
+        void gatherInputs(const Step &step, const float **inputs) const;
+        void runNode(int index, int worker, size_t frames);
+        void runStep(int index, int worker, size_t frames);
+        void runTask(int task, int worker);
+        void updateFusion();
+        void updateSchedule();
+
+        void startAutomation(Automation *automation, size_t frames);
+        bool currentValue(const Automation *automation, int node, int param, int64_t frame, double &value) const;
+    public:
+        AudioGraph(int sampleRate, size_t blockSize);
+        ~AudioGraph();
+
+        // returns the index of the new node, -1 for an unknown type
+        int addNode(int type);
+
+        // copy of the whole program with its nodes in their initial state,
+        // for rendering many instances of the same patch
+        AudioGraph *clone() const;
+
+        // redirects the output nodes and holds a reference to the sink, NULL
+        // feeds the renderer again
+        void setSink(SampleSink *sink);
+
+        // buffer -1 disconnects, all of these return false on bad indices
+        bool setInput(int node, int input, int buffer);
+        bool setOutput(int node, int buffer);
+        bool setParam(int node, int param, double value);
+        bool setSampleFile(int node, const char *path);
+
+        // changes a parameter at a graph frame from one control thread while
+        // another renders, false on a bad node, a full queue or a change the
+        // node can't make without allocating (see canSchedule). rampFrames > 0
+        // moves there from the value at that frame over as many frames with an
+        // AUDIO_RAMP_* curve, a later change of the parameter cancels the ramp.
+        // Nodes that can interpolate the parameter ramp it every sample, the
+        // others step once per block. Frames in the past take effect with the
+        // next block.
+        bool scheduleParam(int node, int param, double value, int64_t frame, int64_t rampFrames, int curve);
+
+        // frames rendered so far, the clock of scheduleParam
+        int64_t getPosition() const;
+
+        // nodes with the same key and type count as the same node when a
+        // graph takes over from another one, keys are -1 otherwise
+        bool setNodeKey(int node, int key);
+
+        // works out the schedule ahead of the first render, which then
+        // doesn't allocate
+        void prepare();
+
+        // matches the nodes up with those of another graph by key and type,
+        // on the control thread since it allocates
+        void prepareTakeOver(const AudioGraph &previous);
+
+        // continues where the graph given to prepareTakeOver is: copies the
+        // state of the matched nodes and carries on with its clock. Changes
+        // still pending and running ramps move over to the matched nodes too,
+        // those of nodes without a match are dropped. The previous graph
+        // keeps its own, so it plays on unchanged through a crossfade. Both
+        // graphs must be between blocks, it doesn't allocate.
+        void takeOver(AudioGraph &previous);
+
+        int getNodeCount(int type) const;
+
+        // the program as it was built, for saving it. Bad indices read as
+        // -1, false and NULL.
+        int getNodeCount() const;
+        int getNodeType(int node) const;
+        int getNodeKey(int node) const;
+        int getInput(int node, int input) const;
+        int getOutput(int node) const;
+        bool getParam(int node, int param, double &value) const;
+        const char *getSampleFile(int node) const;
+
+        // 1 runs the program on the calling thread, more adds worker threads
+        void setThreadCount(int threadCount);
+        int getThreadCount() const;
+
+        // scheduling of the worker threads, takes effect right away
+        void setThreadPolicy(const ThreadPolicy &policy);
+
+        // runs the program for the given number of frames, splitting it up
+        // into blocks. The first call after the graph changed works out the
+        // schedule, which allocates.
+        void render(size_t frames);
+
+        // contents of a buffer after the last block, NULL on a bad index.
+        // Buffers between fused nodes aren't kept up to date.
+        const float *getBuffer(int buffer) const;
+
+        size_t getBlockSize() const;
+        int getSampleRate() const;
+};
+
+#endif
@@ -0,0 +1,289 @@
+#include <exception>
+#include <vector>
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "audio.h"
+#include "graphfile.h"
+
+// header, nodes, parameters and then the NUL terminated sample file paths,
+// every section starts 8 byte aligned
+struct GraphFileHeader {
+    char magic[4];
+    uint32_t version;
+    int32_t sampleRate;
+    uint32_t blockSize;
+    uint32_t nodeCount;
+    uint32_t paramCount;
+    uint32_t stringSize;
+    uint32_t reserved;
+};
+
+struct GraphFileNode {
+    int32_t type;
+    int32_t key;
+    int32_t inputs[GraphNode::maxInputs];
+    int32_t output;
+
+    // range in the parameter section
+    uint32_t firstParam;
+    uint32_t paramCount;
+
+    // offset in the string section, -1 for none
+    int32_t sampleFile;
+    uint32_t reserved;
+};
+
+struct GraphFileParam {
+    int32_t param;
+    uint32_t reserved;
+    double value;
+};
+
+static_assert(sizeof(GraphFileHeader) == 32 && sizeof(GraphFileNode) == 40 && sizeof(GraphFileParam) == 16, "graph file layout");
+
+static const char graphFileMagic[4] = {'A', 'G', 'R', 'F'};
+static const uint32_t graphFileVersion = 1;
+
+// anything bigger is a broken file rather than a real block size
+static const uint32_t maxBlockSize = 1 << 20;
+
+// parameters go into the file in this order, so the band count of a filter
+// bank is set before its bands
+static std::vector<int> savedParams() {
+    std::vector<int> params;
+    for (int param=AUDIO_PARAM_FREQUENCY; param<=AUDIO_PARAM_WAVEFORM; ++param) {
+        params.push_back(param);
+    }
+
+    for (int band=0; band<AUDIO_MAX_BANDS; ++band) {
+        params.push_back(AUDIO_PARAM_BAND_CUTOFF(band));
+        params.push_back(AUDIO_PARAM_BAND_GAIN(band));
+    }
+
+    return params;
+}
+
+bool saveGraphFile(const AudioGraph &graph, const char *path) {
+    std::vector<GraphFileNode> nodes;
+    std::vector<GraphFileParam> params;
+    std::vector<char> strings;
+
+    std::vector<int> candidates = savedParams();
+
+    for (int i=0; i<graph.getNodeCount(); ++i) {
+        GraphFileNode node;
+        memset(&node, 0, sizeof(node));
+
+        node.type = graph.getNodeType(i);
+        node.key = graph.getNodeKey(i);
+        for (int input=0; input<GraphNode::maxInputs; ++input) {
+            node.inputs[input] = graph.getInput(i, input);
+        }
+        node.output = graph.getOutput(i);
+
+        node.firstParam = params.size();
+        for (int param : candidates) {
+            GraphFileParam saved;
+            memset(&saved, 0, sizeof(saved));
+
+            if (graph.getParam(i, param, saved.value)) {
+                saved.param = param;
+                params.push_back(saved);
+            }
+        }
+        node.paramCount = params.size() - node.firstParam;
+
+        node.sampleFile = -1;
+        const char *sampleFile = graph.getSampleFile(i);
+        if (sampleFile) {
+            node.sampleFile = strings.size();
+            strings.insert(strings.end(), sampleFile, sampleFile + strlen(sampleFile) + 1);
+        }
+
+        nodes.push_back(node);
+    }
+
+    GraphFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, graphFileMagic, sizeof(header.magic));
+    header.version = graphFileVersion;
+    header.sampleRate = graph.getSampleRate();
+    header.blockSize = graph.getBlockSize();
+    header.nodeCount = nodes.size();
+    header.paramCount = params.size();
+    header.stringSize = strings.size();
+
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        printf("saveGraphFile: can't create %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+    written = written && fwrite(nodes.data(), sizeof(GraphFileNode), nodes.size(), file) == nodes.size();
+    written = written && fwrite(params.data(), sizeof(GraphFileParam), params.size(), file) == params.size();
+    written = written && fwrite(strings.data(), 1, strings.size(), file) == strings.size();
+
+    if (fclose(file) != 0 || !written) {
+        printf("saveGraphFile: can't write %s\n", path);
+        return false;
+    }
+
+    return true;
+}
+
+// checks every count and offset against the size of the file before any of
+// it is used
+static bool validGraphFile(const char *data, size_t size) {
+    if (size < sizeof(GraphFileHeader)) {
+        return false;
+    }
+
+    const GraphFileHeader *header = (const GraphFileHeader *)data;
+    if (memcmp(header->magic, graphFileMagic, sizeof(header->magic)) != 0 || header->version != graphFileVersion) {
+        return false;
+    }
+
+    if (header->sampleRate <= 0 || header->blockSize == 0 || header->blockSize > maxBlockSize) {
+        return false;
+    }
+
+    uint64_t expected = sizeof(GraphFileHeader) + (uint64_t)header->nodeCount * sizeof(GraphFileNode) + (uint64_t)header->paramCount * sizeof(GraphFileParam) + header->stringSize;
+    if (expected != size) {
+        return false;
+    }
+
+    const GraphFileNode *nodes = (const GraphFileNode *)(header + 1);
+    const char *strings = data + size - header->stringSize;
+
+    if (header->stringSize > 0 && strings[header->stringSize - 1] != '\0') {
+        return false;
+    }
+
+    // a node has one output at most, so there are never more buffers than
+    // nodes
+    for (uint32_t i=0; i<header->nodeCount; ++i) {
+        const GraphFileNode &node = nodes[i];
+        if ((uint64_t)node.firstParam + node.paramCount > header->paramCount) {
+            return false;
+        }
+
+        if (node.output < -1 || node.output >= (int64_t)header->nodeCount) {
+            return false;
+        }
+
+        for (int input=0; input<GraphNode::maxInputs; ++input) {
+            if (node.inputs[input] < -1 || node.inputs[input] >= (int64_t)header->nodeCount) {
+                return false;
+            }
+        }
+
+        if (node.sampleFile < -1 || node.sampleFile >= (int64_t)header->stringSize) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// adds the nodes in order, their inputs only refer to buffers that earlier
+// outputs have allocated
+static bool buildGraph(AudioGraph &graph, const GraphFileHeader *header, const GraphFileNode *nodes, const GraphFileParam *params, const char *strings) {
+    bool loaded = true;
+
+    for (uint32_t i=0; i<header->nodeCount && loaded; ++i) {
+        const GraphFileNode &node = nodes[i];
+
+        int index = graph.addNode(node.type);
+        loaded = index >= 0 && graph.setNodeKey(index, node.key);
+
+        for (int input=0; input<GraphNode::maxInputs && loaded; ++input) {
+            loaded = graph.setInput(index, input, node.inputs[input]);
+        }
+        loaded = loaded && graph.setOutput(index, node.output);
+
+        for (uint32_t p=0; p<node.paramCount && loaded; ++p) {
+            const GraphFileParam &param = params[node.firstParam + p];
+            loaded = graph.setParam(index, param.param, param.value);
+        }
+
+        if (loaded && node.sampleFile >= 0) {
+            loaded = graph.setSampleFile(index, strings + node.sampleFile);
+        }
+    }
+
+    return loaded;
+}
+
+AudioGraph *loadGraphFile(const char *path) {
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        printf("loadGraphFile: can't open %s: %s\n", path, strerror(errno));
+        return nullptr;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        printf("loadGraphFile: can't stat %s\n", path);
+        ::close(fd);
+        return nullptr;
+    }
+
+    size_t size = info.st_size;
+    void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+
+    if (mapped == MAP_FAILED) {
+        printf("loadGraphFile: can't map %s: %s\n", path, strerror(errno));
+        return nullptr;
+    }
+
+    const char *data = (const char *)mapped;
+    if (!validGraphFile(data, size)) {
+        printf("loadGraphFile: %s is damaged or from another version\n", path);
+        munmap(mapped, size);
+        return nullptr;
+    }
+
+    const GraphFileHeader *header = (const GraphFileHeader *)data;
+    const GraphFileNode *nodes = (const GraphFileNode *)(header + 1);
+    const GraphFileParam *params = (const GraphFileParam *)(nodes + header->nodeCount);
+    const char *strings = data + size - header->stringSize;
+
+    AudioGraph *graph = nullptr;
+    bool loaded = true;
+
+    // a file that passes the checks can still ask for more memory than
+    // there is
+    try {
+        graph = new AudioGraph(header->sampleRate, header->blockSize);
+        loaded = buildGraph(*graph, header, nodes, params, strings);
+
+        // so the first render doesn't have to
+        if (loaded) {
+            graph->prepare();
+        }
+    } catch (const std::exception &error) {
+        printf("loadGraphFile: %s\n", error.what());
+        loaded = false;
+    }
+
+    munmap(mapped, size);
+
+    if (!loaded) {
+        printf("loadGraphFile: can't build the graph in %s\n", path);
+        delete graph;
+        return nullptr;
+    }
+
+    return graph;
+}
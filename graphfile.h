@@ -0,0 +1,18 @@
+#ifndef __GRAPHFILE_H
+#define __GRAPHFILE_H
+
+#include "graph.h"
+
+// Compiled graphs saved in a compact binary file, so a large patch starts
+// without building and sorting it in Python again. The file holds the
+// program in execution order with the node types, keys, buffer assignments,
+// parameters and sample file paths in native byte order, only the thread
+// count and renderer are left to the caller. Loading maps the file and adds
+// the nodes in order, sample files are resolved like setSampleFile does.
+bool saveGraphFile(const AudioGraph &graph, const char *path);
+
+// NULL if the file can't be read, is from another version or references a
+// sample file that can't be opened
+AudioGraph *loadGraphFile(const char *path);
+
+#endif
@@ -0,0 +1,203 @@
+#include <algorithm>
+
+#include "audio.h"
+#include "livegraph.h"
+
+// the output of one graph during a crossfade, laid out like a block of the
+// new graph: the frames of every output node in turn. A graph with smaller
+// blocks writes several rounds of its output nodes into that.
+class LiveGraph::Capture : public SampleSink {
+    private:
+        int outputs;
+        size_t frames;
+        size_t writes;
+        size_t roundOffset;
+    public:
+        std::vector<float> samples;
+
+        Capture() : outputs(1), frames(0), writes(0), roundOffset(0) {
+        }
+
+        // control thread, before the graph writes into it
+        void reserve(int outputs, size_t frames) {
+            this->outputs = std::max(outputs, 1);
+            samples.resize(this->outputs * frames);
+        }
+
+        void start(size_t frames) {
+            this->frames = frames;
+            writes = 0;
+            roundOffset = 0;
+        }
+
+        // samples written, nothing for a graph without output nodes
+        size_t size() const {
+            return writes > 0 ? outputs * frames : 0;
+        }
+
+        // output nodes write in program order, once in every block. Anything
+        // past the room reserve() made is dropped.
+        void write(const float *input, size_t count) {
+            size_t output = writes % outputs;
+            size_t position = std::min(output * frames + roundOffset, samples.size());
+
+            count = std::min(count, samples.size() - position);
+            std::copy(input, input + count, samples.begin() + position);
+
+            writes++;
+            if (output == (size_t)outputs - 1) {
+                roundOffset += count;
+            }
+        }
+};
+
+LiveGraph::LiveGraph(AudioGraph *graph) : current(graph), fading(nullptr), fadeFrames(0), fadePosition(0), next(nullptr), nextFadeFrames(0), swapping(false), retired(nullptr), sink(nullptr), fadingOutput(new Capture()), currentOutput(new Capture()) {
+}
+
+LiveGraph::~LiveGraph() {
+    delete current;
+    delete fading;
+    delete next.load();
+    delete retired.load();
+
+    if (sink) {
+        sink->release();
+    }
+}
+
+bool LiveGraph::swap(AudioGraph *graph, size_t crossfadeFrames) {
+    if (swapping.load(std::memory_order_acquire) || graph->getSampleRate() != current->getSampleRate()) {
+        return false;
+    }
+
+    delete retired.exchange(nullptr, std::memory_order_relaxed);
+
+    graph->prepare();
+
+    // current only changes hands while a swap is pending
+    graph->prepareTakeOver(*current);
+
+    // crossfades render in blocks of the new graph, each capture has room
+    // for the output nodes of its graph
+    if (crossfadeFrames > 0) {
+        int fadingOutputs = current->getNodeCount(AUDIO_NODE_OUTPUT_DEVICE);
+        int outputs = graph->getNodeCount(AUDIO_NODE_OUTPUT_DEVICE);
+
+        fadingOutput->reserve(fadingOutputs, graph->getBlockSize());
+        currentOutput->reserve(outputs, graph->getBlockSize());
+        mixed.resize(std::max(std::max(fadingOutputs, outputs), 1) * graph->getBlockSize());
+    }
+
+    // the render thread only ever drops references the live graph holds as
+    // well, the one the new graph may have brought along goes here
+    graph->setSink(crossfadeFrames > 0 ? currentOutput.get() : sink);
+
+    nextFadeFrames = crossfadeFrames;
+    swapping.store(true, std::memory_order_relaxed);
+    next.store(graph, std::memory_order_release);
+
+    return true;
+}
+
+void LiveGraph::setSink(SampleSink *sink) {
+    if (sink) {
+        sink->retain();
+    }
+    if (this->sink) {
+        this->sink->release();
+    }
+    this->sink = sink;
+
+    // a crossfade hands it on when it's done
+    if (!fading) {
+        current->setSink(sink);
+    }
+
+    AudioGraph *graph = next.load(std::memory_order_relaxed);
+    if (graph && nextFadeFrames == 0) {
+        graph->setSink(sink);
+    }
+}
+
+void LiveGraph::startSwap(AudioGraph *graph) {
+    graph->takeOver(*current);
+
+    // swap() has already pointed the new graph at the sink or the capture
+    if (nextFadeFrames == 0) {
+        AudioGraph *old = current;
+        current = graph;
+        finishSwap(old);
+
+        return;
+    }
+
+    fading = current;
+    current = graph;
+    fadeFrames = nextFadeFrames;
+    fadePosition = 0;
+
+    fading->setSink(fadingOutput.get());
+}
+
+void LiveGraph::finishSwap(AudioGraph *old) {
+    retired.store(old, std::memory_order_relaxed);
+    swapping.store(false, std::memory_order_release);
+}
+
+void LiveGraph::renderFade(size_t frames) {
+    Capture &from = *fadingOutput;
+    Capture &to = *currentOutput;
+
+    from.start(frames);
+    to.start(frames);
+    fading->render(frames);
+    current->render(frames);
+
+    // the blocks of several output nodes follow each other, a graph with
+    // fewer of them fades against silence
+    size_t length = std::max(from.size(), to.size());
+    for (size_t i=0; i<length; ++i) {
+        float first = i < from.size() ? from.samples[i] : 0.0f;
+        float second = i < to.size() ? to.samples[i] : 0.0f;
+        float mix = std::min((float)(fadePosition + i % frames + 1) / fadeFrames, 1.0f);
+
+        mixed[i] = first + (second - first) * mix;
+    }
+
+    output(mixed.data(), length);
+
+    fadePosition += frames;
+    if (fadePosition >= fadeFrames) {
+        current->setSink(sink);
+
+        AudioGraph *old = fading;
+        fading = nullptr;
+        finishSwap(old);
+    }
+}
+
+void LiveGraph::output(const float *samples, size_t count) {
+    if (sink) {
+        sink->write(samples, count);
+    } else {
+        audio_feed_block_float(samples, (int)count);
+    }
+}
+
+void LiveGraph::render(size_t frames) {
+    for (size_t offset=0; offset<frames; ) {
+        AudioGraph *graph = next.exchange(nullptr, std::memory_order_acquire);
+        if (graph) {
+            startSwap(graph);
+        }
+
+        size_t count = std::min(current->getBlockSize(), frames - offset);
+        if (fading) {
+            renderFade(count);
+        } else {
+            current->render(count);
+        }
+
+        offset += count;
+    }
+}
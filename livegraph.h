@@ -0,0 +1,71 @@
+#ifndef __LIVEGRAPH_H
+#define __LIVEGRAPH_H
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include <stddef.h>
+
+#include "graph.h"
+#include "ringbuffer.h"
+
+// Plays one compiled graph at a time and replaces it with a newly compiled
+// one at a block boundary, so a patch can change without stopping the
+// renderer. The control thread prepares the new graph and hands it over, the
+// render thread picks it up before its next block: nodes take over the state
+// of the nodes with the same key in the old graph and the clock carries on.
+// Scheduled changes and ramps of those nodes carry on as well, the ones of
+// nodes the new graph doesn't have are dropped.
+//
+// With a crossfade both graphs keep rendering for that many frames, their
+// output nodes write into capture blocks that get mixed before they go on to
+// the sink. The old graph is handed back to the control thread afterwards,
+// deleting it joins its worker threads which the render thread mustn't wait
+// for.
+class LiveGraph : public CacheAligned {
+    private:
+        class Capture;
+
+        // render thread only
+        AudioGraph *current;
+        AudioGraph *fading;
+        size_t fadeFrames;
+        size_t fadePosition;
+
+        // published by swap(), which is refused until the previous swap
+        // is done
+        std::atomic<AudioGraph *> next;
+        size_t nextFadeFrames;
+        std::atomic<bool> swapping;
+
+        // a replaced graph waiting for the control thread to delete it
+        std::atomic<AudioGraph *> retired;
+
+        SampleSink *sink;
+
+        // sized by swap() while no crossfade runs
+        std::unique_ptr<Capture> fadingOutput;
+        std::unique_ptr<Capture> currentOutput;
+        std::vector<float> mixed;
+
+        void startSwap(AudioGraph *graph);
+        void finishSwap(AudioGraph *old);
+        void renderFade(size_t frames);
+        void output(const float *samples, size_t count);
+    public:
+        // takes over the graph
+        LiveGraph(AudioGraph *graph);
+        ~LiveGraph();
+
+        // takes over the graph once it returns true, false while the previous
+        // swap hasn't finished or if the sample rates differ
+        bool swap(AudioGraph *graph, size_t crossfadeFrames);
+
+        // NULL feeds the renderer, only between renders
+        void setSink(SampleSink *sink);
+
+        void render(size_t frames);
+};
+
+#endif
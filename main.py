@@ -21,30 +21,99 @@ platform.platform = Darwin_x86_64()
 
 # -- rffi imports --
 
-eci = ExternalCompilationInfo(libraries=["c++"], separate_module_files=["audio.cpp"], includes=["audio.h"], include_dirs=[os.getcwd()], frameworks=["OpenAL"], use_cpp_linker=True, platform=Darwin_x86_64())
+eci = ExternalCompilationInfo(libraries=["c++"], separate_module_files=["audio.cpp", "convert.cpp", "resample.cpp", "samplefile.cpp", "samplecache.cpp", "samplestream.cpp", "graph.cpp", "graphfile.cpp", "nodes.cpp", "scheduler.cpp", "batch.cpp", "offline.cpp", "biquad.cpp", "delay.cpp", "wavetable.cpp", "realtime.cpp", "livegraph.cpp"], includes=["audio.h"], include_dirs=[os.getcwd()], frameworks=["OpenAL"], use_cpp_linker=True, platform=Darwin_x86_64())
 #link_extra=["-stdlib=libc++", "-mmacosx-version-min=10.10"]
 
 audio_init = rffi.llexternal("audio_init", [], lltype.Void, compilation_info=eci)
+audio_init_rate = rffi.llexternal("audio_init_rate", [rffi.INT], rffi.INT, compilation_info=eci)
+audio_init_offline = rffi.llexternal("audio_init_offline", [rffi.VOIDP, rffi.CCHARP, rffi.INT, rffi.INT], rffi.INT, compilation_info=eci)
 audio_deinit = rffi.llexternal("audio_deinit", [], lltype.Void, compilation_info=eci)
 audio_feed_sample = rffi.llexternal("audio_feed_sample", [lltype.Float], lltype.Void, compilation_info=eci)
+audio_feed_block = rffi.llexternal("audio_feed_block", [rffi.DOUBLEP, rffi.INT], lltype.Void, compilation_info=eci)
+audio_get_buffer_size = rffi.llexternal("audio_get_buffer_size", [], rffi.INT, compilation_info=eci)
 audio_sleep = rffi.llexternal("audio_sleep", [lltype.Float], lltype.Void, compilation_info=eci)
-unpack_float = rffi.llexternal("unpack_float", [lltype.Char, lltype.Char, lltype.Char, lltype.Char], lltype.Float, compilation_info=eci)
+audio_samples_acquire = rffi.llexternal("audio_samples_acquire", [rffi.CCHARP, rffi.INT], rffi.VOIDP, compilation_info=eci)
+audio_samples_get_count = rffi.llexternal("audio_samples_get_count", [rffi.VOIDP], rffi.INT, compilation_info=eci)
+audio_samples_get_doubles = rffi.llexternal("audio_samples_get_doubles", [rffi.VOIDP], rffi.DOUBLEP, compilation_info=eci)
+audio_stream_open = rffi.llexternal("audio_stream_open", [rffi.CCHARP, rffi.INT, rffi.INT], rffi.VOIDP, compilation_info=eci)
+audio_stream_read = rffi.llexternal("audio_stream_read", [rffi.VOIDP, rffi.DOUBLEP, rffi.INT], rffi.INT, compilation_info=eci)
+audio_stream_close = rffi.llexternal("audio_stream_close", [rffi.VOIDP], lltype.Void, compilation_info=eci)
+audio_graph_create = rffi.llexternal("audio_graph_create", [rffi.INT, rffi.INT], rffi.VOIDP, compilation_info=eci)
+audio_graph_destroy = rffi.llexternal("audio_graph_destroy", [rffi.VOIDP], lltype.Void, compilation_info=eci)
+audio_graph_add_node = rffi.llexternal("audio_graph_add_node", [rffi.VOIDP, rffi.INT], rffi.INT, compilation_info=eci)
+audio_graph_set_input = rffi.llexternal("audio_graph_set_input", [rffi.VOIDP, rffi.INT, rffi.INT, rffi.INT], rffi.INT, compilation_info=eci)
+audio_graph_set_output = rffi.llexternal("audio_graph_set_output", [rffi.VOIDP, rffi.INT, rffi.INT], rffi.INT, compilation_info=eci)
+audio_graph_set_param = rffi.llexternal("audio_graph_set_param", [rffi.VOIDP, rffi.INT, rffi.INT, lltype.Float], rffi.INT, compilation_info=eci)
+audio_graph_set_sample_file = rffi.llexternal("audio_graph_set_sample_file", [rffi.VOIDP, rffi.INT, rffi.CCHARP], rffi.INT, compilation_info=eci)
+audio_graph_schedule_param = rffi.llexternal("audio_graph_schedule_param", [rffi.VOIDP, rffi.INT, rffi.INT, lltype.Float, rffi.LONGLONG, rffi.INT, rffi.INT], rffi.INT, compilation_info=eci)
+audio_graph_get_position = rffi.llexternal("audio_graph_get_position", [rffi.VOIDP], rffi.LONGLONG, compilation_info=eci)
+audio_graph_set_node_key = rffi.llexternal("audio_graph_set_node_key", [rffi.VOIDP, rffi.INT, rffi.INT], rffi.INT, compilation_info=eci)
+audio_graph_save = rffi.llexternal("audio_graph_save", [rffi.VOIDP, rffi.CCHARP], rffi.INT, compilation_info=eci)
+audio_graph_load = rffi.llexternal("audio_graph_load", [rffi.CCHARP], rffi.VOIDP, compilation_info=eci)
+audio_graph_get_sample_rate = rffi.llexternal("audio_graph_get_sample_rate", [rffi.VOIDP], rffi.INT, compilation_info=eci)
+audio_graph_set_thread_count = rffi.llexternal("audio_graph_set_thread_count", [rffi.VOIDP, rffi.INT], lltype.Void, compilation_info=eci)
+audio_graph_render = rffi.llexternal("audio_graph_render", [rffi.VOIDP, rffi.INT], lltype.Void, compilation_info=eci)
+audio_live_graph_create = rffi.llexternal("audio_live_graph_create", [rffi.VOIDP], rffi.VOIDP, compilation_info=eci)
+audio_live_graph_destroy = rffi.llexternal("audio_live_graph_destroy", [rffi.VOIDP], lltype.Void, compilation_info=eci)
+audio_live_graph_swap = rffi.llexternal("audio_live_graph_swap", [rffi.VOIDP, rffi.VOIDP, rffi.INT], rffi.INT, compilation_info=eci)
+audio_live_graph_render = rffi.llexternal("audio_live_graph_render", [rffi.VOIDP, rffi.INT], lltype.Void, compilation_info=eci)
+audio_batch_create = rffi.llexternal("audio_batch_create", [rffi.VOIDP, rffi.INT], rffi.VOIDP, compilation_info=eci)
+audio_batch_destroy = rffi.llexternal("audio_batch_destroy", [rffi.VOIDP], lltype.Void, compilation_info=eci)
+audio_batch_set_param = rffi.llexternal("audio_batch_set_param", [rffi.VOIDP, rffi.INT, rffi.INT, rffi.INT, lltype.Float], rffi.INT, compilation_info=eci)
+audio_batch_set_output_file = rffi.llexternal("audio_batch_set_output_file", [rffi.VOIDP, rffi.INT, rffi.CCHARP], rffi.INT, compilation_info=eci)
+audio_batch_render = rffi.llexternal("audio_batch_render", [rffi.VOIDP, rffi.INT, rffi.INT], lltype.Float, compilation_info=eci)
+
+# node types, file formats and parameters of the native runtime, these have
+# to match the enums in audio.h
+NODE_OUTPUT_DEVICE = 0
+NODE_SAMPLE_PLAYER = 1
+NODE_STREAM_PLAYER = 2
+NODE_OSCILLATOR = 3
+NODE_MIXER = 4
+NODE_COMBINER = 5
+NODE_DELAY = 6
+NODE_LOW_PASS = 7
+NODE_LOW_PASS_CASCADE = 8
+NODE_FILTER_BANK = 9
+NODE_MODULATED_DELAY = 10
+
+FILE_F32 = 0
+FILE_WAV = 1
+
+PARAM_FREQUENCY = 0
+PARAM_CUTOFF = 1
+PARAM_FIRST_LEVEL = 2
+PARAM_SECOND_LEVEL = 3
+PARAM_DELAY = 4
+PARAM_SECTIONS = 5
+PARAM_DEPTH = 6
+PARAM_WAVEFORM = 7
+
+WAVEFORM_SINE = 0
+WAVEFORM_SAW = 1
+WAVEFORM_SQUARE = 2
+
+RAMP_LINEAR = 0
+RAMP_EXPONENTIAL = 1
+
+MAX_BANDS = 64
+PARAM_BAND_CUTOFF = 0x100 # plus the band number
+PARAM_BAND_GAIN = 0x200
 
 # -- helpers --
 
-from rpython.rlib import streamio
-import array
-import struct
+# shares a .f32 file through the native sample cache, decoded to doubles once
+# however many players use it. Returns the handle that keeps the samples
+# alive, the samples and their count.
+def acquire_samples(filename):
+    handle = audio_samples_acquire(filename, 1)
+    if not handle:
+        raise RuntimeError("Can't read samples!")
 
-def slicer(iterator):
-    while True:
-        yield (iterator.next(), iterator.next(), iterator.next(), iterator.next())
+    samples = audio_samples_get_doubles(handle)
+    count = rffi.cast(lltype.Signed, audio_samples_get_count(handle))
 
-def read_samples(filename):
-    stream = streamio.open_file_as_stream(filename)
-    data = stream.readall()
-
-    return [unpack_float(a, b, c, d) for a, b, c, d in slicer(iter(data))]
+    return handle, samples, count
 
 # -- class structure --
 
@@ -52,8 +121,14 @@ class Graph:
     def __init__(self):
         self.nodes = []
         self.connections = []
+        self.next_key = 0
 
+    # the key stays with the node when the graph is compiled again, so a
+    # swapped in native graph knows which of its nodes were there before
     def add_node(self, node):
+        node.key = self.next_key
+        self.next_key += 1
+
         self.nodes.append(node)
 
     def connect(self, source_port, destination_port):
@@ -89,13 +164,101 @@ class Graph:
         print(result)
         return result
 
+    # builds a native graph that runs the render program a block at a time.
+    # Port buffers are allocated like registers: a buffer goes back on the
+    # free list once the last node reading it has run, so the working set is
+    # the widest cut through the graph rather than the number of ports. With
+    # more than one thread independent branches render in parallel, 0 uses
+    # every core.
+    def compile_native(self, render_program, sample_rate, block_size, thread_count=1):
+        native = audio_graph_create(sample_rate, block_size)
+        if thread_count != 1:
+            audio_graph_set_thread_count(native, thread_count)
+
+        # position in the program of the last node reading each output
+        last_use = {}
+        for position in range(len(render_program)):
+            for port in render_program[position].native_inputs():
+                last_use[port.mapped_output_port] = position
+
+        buffers = {}
+        free_buffers = []
+        buffer_count = 0
+
+        for position in range(len(render_program)):
+            node = render_program[position]
+
+            index = rffi.cast(lltype.Signed, audio_graph_add_node(native, node.native_type))
+            if index < 0:
+                raise RuntimeError("Node has no native version!")
+
+            audio_graph_set_node_key(native, index, node.key)
+
+            inputs = node.native_inputs()
+            for i in range(len(inputs)):
+                # unconnected inputs aren't in the map and stay silent
+                buffer = buffers.get(inputs[i].mapped_output_port, -1)
+                audio_graph_set_input(native, index, i, buffer)
+
+            # outputs nobody reads are left unconnected. The output is given
+            # a buffer before the inputs are released so nodes never have to
+            # cope with processing in place.
+            output = node.native_output()
+            if output is not None and output in last_use:
+                if free_buffers:
+                    buffer = free_buffers.pop()
+                else:
+                    buffer = buffer_count
+                    buffer_count += 1
+
+                buffers[output] = buffer
+                audio_graph_set_output(native, index, buffer)
+
+            for port in inputs:
+                source = port.mapped_output_port
+                if source in buffers and last_use[source] == position:
+                    free_buffers.append(buffers[source])
+                    del buffers[source]
+
+            node.native_setup(native, index)
+
+        return native
+
+    # compiles the patch again and plays it on a live graph from its next
+    # block on, nodes that are still there keep their state. Returns False
+    # while the previous swap is still crossfading.
+    def swap_native(self, live, sample_rate, block_size, crossfade_frames, thread_count=1):
+        native = self.compile_native(self.compile_render_program(), sample_rate, block_size, thread_count)
+        if rffi.cast(lltype.Signed, audio_live_graph_swap(live, native, crossfade_frames)) < 0:
+            audio_graph_destroy(native)
+            return False
+
+        return True
+
 class Node:
+    # one of the NODE_* types for the native runtime
+    native_type = -1
+
+    # set by Graph.add_node
+    key = -1
+
     def __init__(self):
         pass
 
     def render(self):
         pass
 
+    # ports in the order the native node numbers them
+    def native_inputs(self):
+        return []
+
+    def native_output(self):
+        return None
+
+    # passes parameters on to the native node
+    def native_setup(self, native, index):
+        pass
+
 class InputPort:
     def __init__(self, owner):
         self.owner = owner
@@ -113,37 +276,155 @@ class Connection:
 
 # -- some nodes --
 
+# collects samples into a block so they cross into C in a single call
 class OutputDevice(Node):
+    SAMPLE_RATE = 44100
+    BLOCK_SIZE = 1024
+
+    native_type = NODE_OUTPUT_DEVICE
+
     def __init__(self):
         self.input = InputPort(weakref.ref(self))
 
+        self.block = lltype.malloc(rffi.DOUBLEP.TO, OutputDevice.BLOCK_SIZE, flavor="raw")
+        self.position = 0
+
     def render(self):
-        audio_feed_sample(self.input.mapped_output_port.value)
+        self.block[self.position] = self.input.mapped_output_port.value
+        self.position += 1
+
+        if self.position == OutputDevice.BLOCK_SIZE:
+            audio_feed_block(self.block, OutputDevice.BLOCK_SIZE)
+            self.position = 0
+
+    def native_inputs(self):
+        return [self.input]
 
 class SamplePlayer(Node):
+    native_type = NODE_SAMPLE_PLAYER
+
     def __init__(self, filename):
         self.output = OutputPort(weakref.ref(self))
 
-        self.samples = read_samples(filename)
-        self.length = len(self.samples)
+        # players here and native ones share the file through the sample
+        # cache, only acquire it when rendering here
+        self.filename = filename
+        self.handle = lltype.nullptr(rffi.VOIDP.TO)
+        self.samples = lltype.nullptr(rffi.DOUBLEP.TO)
+        self.length = 0
         self.position = 0
 
     def render(self):
+        if not self.samples:
+            self.handle, self.samples, self.length = acquire_samples(self.filename)
+
         self.output.value = self.samples[self.position]
         self.position = (self.position + 1) % self.length
 
+    def native_output(self):
+        return self.output
+
+    def native_setup(self, native, index):
+        if rffi.cast(lltype.Signed, audio_graph_set_sample_file(native, index, self.filename)) < 0:
+            raise RuntimeError("Can't read samples!")
+
+# like SamplePlayer but streams the file from disk, for files too large to
+# keep in memory
+class StreamPlayer(Node):
+    BLOCK_SIZE = 1024
+
+    native_type = NODE_STREAM_PLAYER
+
+    def __init__(self, filename):
+        self.output = OutputPort(weakref.ref(self))
+
+        # the native node opens a stream of its own, only open one when
+        # rendering here
+        self.filename = filename
+        self.stream = lltype.nullptr(rffi.VOIDP.TO)
+
+        self.block = lltype.malloc(rffi.DOUBLEP.TO, StreamPlayer.BLOCK_SIZE, flavor="raw")
+        self.position = StreamPlayer.BLOCK_SIZE
+
+    def render(self):
+        if not self.stream:
+            self.stream = audio_stream_open(self.filename, 0, 0)
+            if not self.stream:
+                raise RuntimeError("Can't open stream!")
+
+        if self.position == StreamPlayer.BLOCK_SIZE:
+            audio_stream_read(self.stream, self.block, StreamPlayer.BLOCK_SIZE)
+            self.position = 0
+
+        self.output.value = self.block[self.position]
+        self.position += 1
+
+    def native_output(self):
+        return self.output
+
+    def native_setup(self, native, index):
+        if rffi.cast(lltype.Signed, audio_graph_set_sample_file(native, index, self.filename)) < 0:
+            raise RuntimeError("Can't open stream!")
+
+# number of harmonics of a band-limited saw or square, as many as fit below
+# Nyquist rounded down to a power of two, at most 1024, like the wavetables of
+# the native oscillator
+def oscillator_harmonics(frequency):
+    if frequency == 0.0:
+        return 1024
+
+    allowed = 22050.0 / abs(frequency)
+    harmonics = 1
+    while harmonics < 1024 and harmonics * 2 <= allowed:
+        harmonics = harmonics * 2
+
+    return harmonics
+
 class Oscillator(Node):
-    def __init__(self, frequency):
+    native_type = NODE_OSCILLATOR
+
+    def __init__(self, frequency, waveform=WAVEFORM_SINE):
         self.output = OutputPort(weakref.ref(self))
 
-        self.t = 0.0
-        self.omega = 2.0 * math.pi * frequency / 44100.0
+        self.frequency = frequency
+        self.waveform = waveform
+        self.harmonics = oscillator_harmonics(frequency)
+
+        # fraction of a cycle, kept between 0 and 1 so it never loses precision
+        self.phase = 0.0
+        self.increment = frequency / 44100.0
 
     def render(self):
-        self.output.value = math.sin(self.omega * self.t)
-        self.t = self.t + 1.0
+        x = 2.0 * math.pi * self.phase
+
+        if self.waveform == WAVEFORM_SAW:
+            value = 0.0
+            for k in range(1, self.harmonics + 1):
+                value = value + math.sin(k * x) / k
+            value = -2.0 / math.pi * value
+        elif self.waveform == WAVEFORM_SQUARE:
+            value = 0.0
+            for k in range(1, self.harmonics + 1, 2):
+                value = value + math.sin(k * x) / k
+            value = 4.0 / math.pi * value
+        else:
+            value = math.sin(x)
+
+        self.output.value = value
+
+        self.phase = self.phase + self.increment
+        self.phase = self.phase - math.floor(self.phase)
+
+    def native_output(self):
+        return self.output
+
+    def native_setup(self, native, index):
+        audio_graph_set_param(native, index, PARAM_WAVEFORM, self.waveform)
+        audio_graph_set_param(native, index, PARAM_FREQUENCY, self.frequency)
 
 class Mixer(Node):
+    native_type = NODE_MIXER
+
     def __init__(self):
         self.first = InputPort(weakref.ref(self))
         self.second = InputPort(weakref.ref(self))
@@ -155,8 +436,16 @@ class Mixer(Node):
         mix = self.mix.mapped_output_port.value * 0.5 + 0.5
         self.output.value = self.first.mapped_output_port.value * (1.0 - mix) + self.second.mapped_output_port.value * mix
 
+    def native_inputs(self):
+        return [self.first, self.second, self.mix]
+
+    def native_output(self):
+        return self.output
+
 # Combine and attenuate two signals
 class Combiner(Node):
+    native_type = NODE_COMBINER
+
     def __init__(self, first_level, second_level):
         self.first = InputPort(weakref.ref(self))
         self.second = InputPort(weakref.ref(self))
@@ -168,12 +457,25 @@ class Combiner(Node):
     def render(self):
         self.output.value = self.first_level * self.first.mapped_output_port.value + self.second_level * self.second.mapped_output_port.value
 
+    def native_inputs(self):
+        return [self.first, self.second]
+
+    def native_output(self):
+        return self.output
+
+    def native_setup(self, native, index):
+        audio_graph_set_param(native, index, PARAM_FIRST_LEVEL, self.first_level)
+        audio_graph_set_param(native, index, PARAM_SECOND_LEVEL, self.second_level)
+
 # delay the signal by a given number of seconds
 class Delay(Node):
+    native_type = NODE_DELAY
+
     def __init__(self, delay):
         self.input = InputPort(weakref.ref(self))
         self.output = OutputPort(weakref.ref(self))
 
+        self.seconds = delay
         self.delay = int(delay * 44100.0)
         self.buffer = [0.0] * self.delay
         self.position = 0
@@ -183,12 +485,68 @@ class Delay(Node):
         self.output.value = self.buffer[self.position]
         self.position = (self.position + 1) % self.delay
 
+    def native_inputs(self):
+        return [self.input]
+
+    def native_output(self):
+        return self.output
+
+    def native_setup(self, native, index):
+        audio_graph_set_param(native, index, PARAM_DELAY, self.seconds)
+
+# delay with a fractional delay time, modulation between -1 and 1 moves it by
+# up to depth seconds around delay, for chorus and flanger effects
+class ModulatedDelay(Node):
+    native_type = NODE_MODULATED_DELAY
+
+    def __init__(self, delay, depth):
+        self.input = InputPort(weakref.ref(self))
+        self.modulation = InputPort(weakref.ref(self))
+        self.output = OutputPort(weakref.ref(self))
+
+        self.delay = delay
+        self.depth = depth
+
+        self.max_delay = (delay + abs(depth)) * 44100.0
+        self.length = int(self.max_delay) + 2
+        self.buffer = [0.0] * self.length
+        self.position = 0
+
+    def render(self):
+        self.buffer[self.position] = self.input.mapped_output_port.value
+
+        current = (self.delay + self.depth * self.modulation.mapped_output_port.value) * 44100.0
+        current = min(max(current, 0.0), self.max_delay)
+
+        # linear interpolation between the two samples around the delay
+        whole = int(current)
+        fraction = current - whole
+        newer = self.buffer[(self.position - whole) % self.length]
+        older = self.buffer[(self.position - whole - 1) % self.length]
+
+        self.output.value = newer + (older - newer) * fraction
+        self.position = (self.position + 1) % self.length
+
+    def native_inputs(self):
+        return [self.input, self.modulation]
+
+    def native_output(self):
+        return self.output
+
+    def native_setup(self, native, index):
+        audio_graph_set_param(native, index, PARAM_DELAY, self.delay)
+        audio_graph_set_param(native, index, PARAM_DEPTH, self.depth)
+
 # 12 dB biquad lowpass filter
 class LowPass(Node):
+    native_type = NODE_LOW_PASS
+
     def __init__(self, cutoff):
         self.input = InputPort(weakref.ref(self))
         self.output = OutputPort(weakref.ref(self))
 
+        self.cutoff = cutoff
+
         # compute coefficients
         omega = 2.0 * math.pi * cutoff * (1.0 / 44100.0)
         cos_omega = math.cos(omega)
@@ -218,11 +576,140 @@ class LowPass(Node):
 
         self.output.value = y0
 
+    def native_inputs(self):
+        return [self.input]
+
+    def native_output(self):
+        return self.output
+
+    def native_setup(self, native, index):
+        audio_graph_set_param(native, index, PARAM_CUTOFF, self.cutoff)
+
+# computes the coefficients of LowPass above as a (b0, b1, b2, a1, a2) tuple
+def low_pass_coefficients(cutoff):
+    omega = 2.0 * math.pi * cutoff * (1.0 / 44100.0)
+    cos_omega = math.cos(omega)
+    alpha = math.sin(omega) / (2.0 * 7.0)
+    scale = 1.0 / (1.0 + alpha)
+
+    b1 = scale * (1.0 - cos_omega)
+    return (b1 * 0.5, b1, b1 * 0.5, -scale * 2.0 * cos_omega, -scale * (alpha - 1.0))
+
+# one transposed direct form 2 section, the native filter nodes use the
+# same form
+class Biquad:
+    def __init__(self, cutoff):
+        self.b0, self.b1, self.b2, self.a1, self.a2 = low_pass_coefficients(cutoff)
+        self.s1 = 0.0
+        self.s2 = 0.0
+
+    def process(self, x):
+        y = self.b0 * x + self.s1
+        self.s1 = self.b1 * x - self.a1 * y + self.s2
+        self.s2 = self.b2 * x - self.a2 * y
+        return y
+
+# LowPass sections in series, 12 dB per section
+class LowPassCascade(Node):
+    native_type = NODE_LOW_PASS_CASCADE
+
+    def __init__(self, cutoff, sections):
+        self.input = InputPort(weakref.ref(self))
+        self.output = OutputPort(weakref.ref(self))
+
+        self.cutoff = cutoff
+        self.sections = [Biquad(cutoff) for i in range(sections)]
+
+    def render(self):
+        value = self.input.mapped_output_port.value
+        for section in self.sections:
+            value = section.process(value)
+
+        self.output.value = value
+
+    def native_inputs(self):
+        return [self.input]
+
+    def native_output(self):
+        return self.output
+
+    def native_setup(self, native, index):
+        audio_graph_set_param(native, index, PARAM_CUTOFF, self.cutoff)
+        audio_graph_set_param(native, index, PARAM_SECTIONS, float(len(self.sections)))
+
+# resonant lowpasses at their own cutoffs on the same input, summed with a
+# gain each
+class FilterBank(Node):
+    native_type = NODE_FILTER_BANK
+
+    def __init__(self, cutoffs, gains):
+        if len(cutoffs) != len(gains) or len(cutoffs) > MAX_BANDS:
+            raise RuntimeError("Bad filter bank bands!")
+
+        self.input = InputPort(weakref.ref(self))
+        self.output = OutputPort(weakref.ref(self))
+
+        self.cutoffs = cutoffs
+        self.gains = gains
+        self.bands = [Biquad(cutoff) for cutoff in cutoffs]
+
+    def render(self):
+        value = self.input.mapped_output_port.value
+
+        total = 0.0
+        for i in range(len(self.bands)):
+            total += self.gains[i] * self.bands[i].process(value)
+
+        self.output.value = total
+
+    def native_inputs(self):
+        return [self.input]
+
+    def native_output(self):
+        return self.output
+
+    def native_setup(self, native, index):
+        audio_graph_set_param(native, index, PARAM_SECTIONS, float(len(self.bands)))
+        for i in range(len(self.bands)):
+            audio_graph_set_param(native, index, PARAM_BAND_CUTOFF + i, self.cutoffs[i])
+            audio_graph_set_param(native, index, PARAM_BAND_GAIN + i, self.gains[i])
+
 # -- bootstrapping --
 
+# plays a native graph on the device at the rate of the graph, then frees
+# it
+def play_native(native, seconds):
+    sample_rate = rffi.cast(lltype.Signed, audio_graph_get_sample_rate(native))
+
+    # start audio
+    if not rffi.cast(lltype.Signed, audio_init_rate(sample_rate)):
+        audio_graph_destroy(native)
+        return 1
+
+    # render
+    audio_graph_render(native, seconds * sample_rate)
+    audio_graph_destroy(native)
+
+    # the frame queue is bounded so rendering is paced by playback, wait
+    # for whatever is still buffered to play out, counted at the render rate
+    audio_sleep(rffi.cast(lltype.Signed, audio_get_buffer_size()) / float(sample_rate))
+
+    return 0
+
 def entry_point(argv):
     print(argv)
 
+    seconds = 60
+
+    # "--load FILE" plays a patch saved with --save, without building and
+    # compiling it here first
+    if len(argv) > 2 and argv[1] == "--load":
+        native = audio_graph_load(argv[2])
+        if not native:
+            return 1
+
+        return play_native(native, seconds)
+
     # build graph
     graph = Graph()
 
@@ -259,20 +746,48 @@ def entry_point(argv):
 
     # compile render program
     render_program = graph.compile_render_program()
-
-    # start audio
-    print(audio_init())
-
-    # render
-    seconds = 60
-
-    for x in range(seconds * 44100):
-        for node in render_program:
-            node.render()
-
-    audio_sleep(seconds)
-
-    return 0
+    native = graph.compile_native(render_program, OutputDevice.SAMPLE_RATE, OutputDevice.BLOCK_SIZE)
+    frames = seconds * rffi.cast(lltype.Signed, audio_graph_get_sample_rate(native))
+
+    # "--save FILE" writes the compiled patch for --load instead of playing
+    # it
+    if len(argv) > 2 and argv[1] == "--save":
+        saved = rffi.cast(lltype.Signed, audio_graph_save(native, argv[2]))
+        audio_graph_destroy(native)
+        return 0 if saved == 0 else 1
+
+    # "--batch N" renders N variants of the patch with different mixer
+    # oscillator rates into out-N.f32 files instead of playing it
+    if len(argv) > 2 and argv[1] == "--batch":
+        instances = int(argv[2])
+        batch = audio_batch_create(native, instances)
+
+        oscillator_index = render_program.index(oscillator)
+        for i in range(instances):
+            audio_batch_set_param(batch, i, oscillator_index, PARAM_FREQUENCY, 0.1 * (i + 1))
+            audio_batch_set_output_file(batch, i, "out-%d.f32" % i)
+
+        print(audio_batch_render(batch, frames, 0))
+
+        audio_batch_destroy(batch)
+        audio_graph_destroy(native)
+        return 0
+
+    # "--offline FILE" renders to a .wav or .f32 file as fast as possible
+    # instead of playing it
+    if len(argv) > 2 and argv[1] == "--offline":
+        path = argv[2]
+        file_format = FILE_WAV if path.endswith(".wav") else FILE_F32
+
+        if not rffi.cast(lltype.Signed, audio_init_offline(lltype.nullptr(rffi.VOIDP.TO), path, file_format, 1)):
+            return 1
+
+        audio_graph_render(native, frames)
+        audio_graph_destroy(native)
+        audio_deinit()
+        return 0
+
+    return play_native(native, seconds)
 
 def target(*args):
     return entry_point, None
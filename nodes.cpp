@@ -0,0 +1,1091 @@
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <math.h>
+
+#include "audio.h"
+#include "biquad.h"
+#include "delay.h"
+#include "nodes.h"
+#include "samplecache.h"
+#include "samplestream.h"
+#include "wavetable.h"
+
+// hands its input to the renderer or the sink of the graph
+class OutputDeviceNode : public GraphNode {
+    private:
+        SampleSink *sink;
+    public:
+        OutputDeviceNode() : sink(nullptr) {
+        }
+
+        void process(const float *const *inputs, float *, size_t frames) {
+            if (sink) {
+                sink->write(inputs[0], frames);
+            } else {
+                audio_feed_block_float(inputs[0], (int)frames);
+            }
+        }
+
+        GraphNode *clone() const {
+            return new OutputDeviceNode();
+        }
+
+        bool isSerial() const {
+            return true;
+        }
+
+        void setSink(SampleSink *sink) {
+            this->sink = sink;
+        }
+};
+
+// loops a .f32 file from the sample cache
+class SamplePlayerNode : public GraphNode {
+    private:
+        std::string path;
+        SampleRef samples;
+        size_t position;
+    public:
+        SamplePlayerNode() : position(0) {
+        }
+
+        bool setSampleFile(const char *path) {
+            SampleRef cached = sampleCache().acquire(path, false);
+            if (!cached) {
+                return false;
+            }
+
+            this->path = path;
+            samples = cached;
+            position = 0;
+
+            return true;
+        }
+
+        const char *getSampleFile() const {
+            return samples ? path.c_str() : nullptr;
+        }
+
+        // copies play the same mapping
+        GraphNode *clone() const {
+            SamplePlayerNode *node = new SamplePlayerNode();
+            node->path = path;
+            node->samples = samples;
+
+            return node;
+        }
+
+        // keeps playing from the same place, wrapped for a different file
+        void copyState(const GraphNode &other) {
+            if (samples) {
+                position = static_cast<const SamplePlayerNode &>(other).position % samples->size();
+            }
+        }
+
+        void process(const float *const *, float *output, size_t frames) {
+            if (!samples) {
+                std::fill(output, output + frames, 0.0f);
+                return;
+            }
+
+            const float *data = samples->data();
+            size_t length = samples->size();
+
+            size_t done = 0;
+            while (done < frames) {
+                size_t count = std::min(frames - done, length - position);
+                std::copy(data + position, data + position + count, output + done);
+
+                done += count;
+                position = (position + count) % length;
+            }
+        }
+};
+
+// loops a .f32 file streamed from disk. Every stream has its own file,
+// chunks and I/O thread, so clones for a batch play the mapping from the
+// sample cache instead, one for the whole batch.
+class StreamPlayerNode : public GraphNode {
+    private:
+        std::string path;
+        std::unique_ptr<SampleStream> stream;
+        SamplePlayerNode mapped;
+    public:
+        bool setSampleFile(const char *path) {
+            std::unique_ptr<SampleStream> opened(new SampleStream(4096, 4));
+            if (!opened->open(path)) {
+                return false;
+            }
+
+            this->path = path;
+            stream = std::move(opened);
+            mapped = SamplePlayerNode();
+
+            return true;
+        }
+
+        const char *getSampleFile() const {
+            return stream ? path.c_str() : mapped.getSampleFile();
+        }
+
+        // streams only if the file can't be mapped
+        GraphNode *clone() const {
+            StreamPlayerNode *node = new StreamPlayerNode();
+            const char *file = getSampleFile();
+            if (file && !node->mapped.setSampleFile(file)) {
+                node->setSampleFile(file);
+            }
+
+            return node;
+        }
+
+        // plays on where the other node is if it streams the same file. The
+        // other stream keeps playing too, as it does through a crossfade.
+        void copyState(const GraphNode &other) {
+            const StreamPlayerNode &node = static_cast<const StreamPlayerNode &>(other);
+            if (stream && node.stream && path == node.path) {
+                stream->continueFrom(*node.stream);
+            } else if (!stream && !node.stream) {
+                mapped.copyState(node.mapped);
+            }
+        }
+
+        void process(const float *const *inputs, float *output, size_t frames) {
+            if (!stream) {
+                mapped.process(inputs, output, frames);
+                return;
+            }
+
+            stream->read(output, frames);
+        }
+};
+
+class OscillatorNode : public GraphNode {
+    private:
+        int sampleRate;
+        WavetableOscillator oscillator;
+    public:
+        OscillatorNode(int sampleRate) : sampleRate(sampleRate), oscillator(sampleRate) {
+        }
+
+        bool setParam(int param, double value) {
+            switch (param) {
+                case AUDIO_PARAM_FREQUENCY:
+                    oscillator.setFrequency(value);
+                    return true;
+                case AUDIO_PARAM_WAVEFORM:
+                    return oscillator.setWaveform((int)value);
+                default:
+                    return false;
+            }
+        }
+
+        bool getParam(int param, double &value) const {
+            switch (param) {
+                case AUDIO_PARAM_FREQUENCY:
+                    value = oscillator.getFrequency();
+                    return true;
+                case AUDIO_PARAM_WAVEFORM:
+                    value = oscillator.getWaveform();
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        GraphNode *clone() const {
+            OscillatorNode *node = new OscillatorNode(sampleRate);
+            node->oscillator.setWaveform(oscillator.getWaveform());
+            node->oscillator.setFrequency(oscillator.getFrequency());
+
+            return node;
+        }
+
+        void copyState(const GraphNode &other) {
+            oscillator.copyPhase(static_cast<const OscillatorNode &>(other).oscillator);
+        }
+
+        void process(const float *const *, float *output, size_t frames) {
+            oscillator.process(output, frames);
+        }
+};
+
+// inputs are first, second and mix, mix goes from -1 (first) to 1 (second)
+class MixerNode : public GraphNode {
+    public:
+        // one sample at a time, for process() and fused chains
+        class Kernel {
+            public:
+                static const int inputs = 3;
+
+                Kernel(MixerNode &) {
+                }
+
+                float tick(float first, float second, float mix) {
+                    mix = mix * 0.5f + 0.5f;
+                    return first * (1.0f - mix) + second * mix;
+                }
+
+                void store() {
+                }
+        };
+
+        GraphNode *clone() const {
+            return new MixerNode();
+        }
+
+        void process(const float *const *inputs, float *output, size_t frames) {
+            const float *first = inputs[0];
+            const float *second = inputs[1];
+            const float *mixes = inputs[2];
+
+            Kernel kernel(*this);
+            for (size_t i=0; i<frames; ++i) {
+                output[i] = kernel.tick(first[i], second[i], mixes[i]);
+            }
+        }
+};
+
+// a level that moves by a step every frame for a while, so ramps of gains
+// don't step from block to block
+class LevelRamp {
+    private:
+        float step;
+        size_t frames;
+    public:
+        LevelRamp() : step(0.0f), frames(0) {
+        }
+
+        void start(float &level, double value, double step, size_t frames) {
+            level = value;
+            this->step = step;
+            this->frames = frames;
+        }
+
+        void stop() {
+            frames = 0;
+        }
+
+        bool running() const {
+            return frames > 0;
+        }
+
+        // the level for this frame, moving it on for the next one
+        float tick(float &level) {
+            float current = level;
+            if (frames > 0) {
+                level += step;
+                frames--;
+            }
+
+            return current;
+        }
+};
+
+// inputs are first and second, each with its own level
+class CombinerNode : public GraphNode {
+    private:
+        float firstLevel;
+        float secondLevel;
+        LevelRamp firstRamp;
+        LevelRamp secondRamp;
+    public:
+        class Kernel {
+            private:
+                float firstLevel;
+                float secondLevel;
+            public:
+                static const int inputs = 2;
+
+                Kernel(CombinerNode &node) : firstLevel(node.firstLevel), secondLevel(node.secondLevel) {
+                }
+
+                float tick(float first, float second, float) {
+                    return firstLevel * first + secondLevel * second;
+                }
+
+                void store() {
+                }
+        };
+
+        CombinerNode() : firstLevel(1.0f), secondLevel(1.0f) {
+        }
+
+        bool setParam(int param, double value) {
+            switch (param) {
+                case AUDIO_PARAM_FIRST_LEVEL:
+                    firstLevel = value;
+                    firstRamp.stop();
+                    return true;
+                case AUDIO_PARAM_SECOND_LEVEL:
+                    secondLevel = value;
+                    secondRamp.stop();
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        bool canRamp(int param) const {
+            return param == AUDIO_PARAM_FIRST_LEVEL || param == AUDIO_PARAM_SECOND_LEVEL;
+        }
+
+        bool rampParam(int param, double value, double step, size_t frames) {
+            switch (param) {
+                case AUDIO_PARAM_FIRST_LEVEL:
+                    firstRamp.start(firstLevel, value, step, frames);
+                    return true;
+                case AUDIO_PARAM_SECOND_LEVEL:
+                    secondRamp.start(secondLevel, value, step, frames);
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        bool getParam(int param, double &value) const {
+            switch (param) {
+                case AUDIO_PARAM_FIRST_LEVEL:
+                    value = firstLevel;
+                    return true;
+                case AUDIO_PARAM_SECOND_LEVEL:
+                    value = secondLevel;
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        GraphNode *clone() const {
+            CombinerNode *node = new CombinerNode();
+            node->firstLevel = firstLevel;
+            node->secondLevel = secondLevel;
+
+            return node;
+        }
+
+        void process(const float *const *inputs, float *output, size_t frames) {
+            const float *first = inputs[0];
+            const float *second = inputs[1];
+
+            if (firstRamp.running() || secondRamp.running()) {
+                for (size_t i=0; i<frames; ++i) {
+                    output[i] = firstRamp.tick(firstLevel) * first[i] + secondRamp.tick(secondLevel) * second[i];
+                }
+                return;
+            }
+
+            Kernel kernel(*this);
+            for (size_t i=0; i<frames; ++i) {
+                output[i] = kernel.tick(first[i], second[i], 0.0f);
+            }
+        }
+};
+
+// delays like the Python Delay, whose ring writes one slot behind the read
+// position and so delays by one sample less than its length
+class DelayNode : public GraphNode {
+    private:
+        int sampleRate;
+        size_t blockSize;
+
+        DelayLine line;
+        double seconds;
+        size_t delay;
+
+        size_t delayFrames(double seconds) const {
+            return std::max((int)(seconds * sampleRate), 1) - 1;
+        }
+    public:
+        // one sample at a time for fused chains, process() moves whole blocks
+        class Kernel {
+            private:
+                DelayLine::Cursor cursor;
+                size_t delay;
+            public:
+                static const int inputs = 1;
+
+                Kernel(DelayNode &node) : cursor(node.line), delay(node.delay) {
+                }
+
+                float tick(float input, float, float) {
+                    return cursor.tick(input, delay);
+                }
+
+                void store() {
+                    cursor.store();
+                }
+        };
+
+        DelayNode(int sampleRate, size_t blockSize) : sampleRate(sampleRate), blockSize(blockSize), seconds(0.0), delay(0) {
+            line.setCapacity(0, blockSize);
+        }
+
+        bool setParam(int param, double value) {
+            if (param != AUDIO_PARAM_DELAY) {
+                return false;
+            }
+
+            seconds = value;
+            delay = delayFrames(value);
+
+            // shorter delays keep the line so automation doesn't click
+            if (!line.fits(delay, blockSize)) {
+                line.setCapacity(delay, blockSize);
+            }
+
+            return true;
+        }
+
+        bool getParam(int param, double &value) const {
+            if (param != AUDIO_PARAM_DELAY) {
+                return false;
+            }
+
+            value = seconds;
+            return true;
+        }
+
+        // only delays the line already holds, growing it would allocate and
+        // clear the history. Scheduled changes never grow it either, so the
+        // capacity doesn't change under the control thread.
+        bool canSchedule(int param, double value) const {
+            return param != AUDIO_PARAM_DELAY || line.fits(delayFrames(value), blockSize);
+        }
+
+        GraphNode *clone() const {
+            DelayNode *node = new DelayNode(sampleRate, blockSize);
+            node->seconds = seconds;
+            node->delay = delay;
+            node->line.setCapacity(delay, blockSize);
+
+            return node;
+        }
+
+        void copyState(const GraphNode &other) {
+            line.copyHistory(static_cast<const DelayNode &>(other).line);
+        }
+
+        void process(const float *const *inputs, float *output, size_t frames) {
+            line.write(inputs[0], frames);
+            line.read(output, frames, delay);
+        }
+};
+
+// delay with a fractional, modulated delay time for chorus and flanger
+// effects. Inputs are the signal and a modulation between -1 and 1 that
+// moves the delay by up to AUDIO_PARAM_DEPTH seconds around
+// AUDIO_PARAM_DELAY, reads are linearly interpolated.
+class ModulatedDelayNode : public GraphNode {
+    private:
+        int sampleRate;
+        size_t blockSize;
+
+        DelayLine line;
+
+        // in samples
+        double delay;
+        double depth;
+
+        // only grows, so automating within the range keeps the line
+        void updateCapacity() {
+            size_t maxDelay = (size_t)ceil(delay + fabs(depth)) + 1;
+            if (!line.fits(maxDelay, blockSize)) {
+                line.setCapacity(maxDelay, blockSize);
+            }
+        }
+    public:
+        ModulatedDelayNode(int sampleRate, size_t blockSize) : sampleRate(sampleRate), blockSize(blockSize), delay(0.0), depth(0.0) {
+            updateCapacity();
+        }
+
+        bool setParam(int param, double value) {
+            switch (param) {
+                case AUDIO_PARAM_DELAY:
+                    delay = std::max(value, 0.0) * sampleRate;
+                    break;
+                case AUDIO_PARAM_DEPTH:
+                    depth = value * sampleRate;
+                    break;
+                default:
+                    return false;
+            }
+
+            updateCapacity();
+            return true;
+        }
+
+        bool getParam(int param, double &value) const {
+            switch (param) {
+                case AUDIO_PARAM_DELAY:
+                    value = delay / sampleRate;
+                    return true;
+                case AUDIO_PARAM_DEPTH:
+                    value = depth / sampleRate;
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        // delays that stay in the line with the depth as it is. The depth
+        // only changes with setParam, scheduling it as well could take the
+        // two together past the line.
+        bool canSchedule(int param, double value) const {
+            switch (param) {
+                case AUDIO_PARAM_DELAY:
+                    return line.fits((size_t)ceil(std::max(value, 0.0) * sampleRate + fabs(depth)) + 1, blockSize);
+                case AUDIO_PARAM_DEPTH:
+                    return false;
+                default:
+                    return true;
+            }
+        }
+
+        GraphNode *clone() const {
+            ModulatedDelayNode *node = new ModulatedDelayNode(sampleRate, blockSize);
+            node->delay = delay;
+            node->depth = depth;
+            node->updateCapacity();
+
+            return node;
+        }
+
+        void copyState(const GraphNode &other) {
+            line.copyHistory(static_cast<const ModulatedDelayNode &>(other).line);
+        }
+
+        void process(const float *const *inputs, float *output, size_t frames) {
+            const float *modulation = inputs[1];
+            double maxDelay = delay + fabs(depth);
+
+            line.write(inputs[0], frames);
+
+            for (size_t i=0; i<frames; ++i) {
+                double current = std::min(std::max(delay + depth * modulation[i], 0.0), maxDelay);
+                output[i] = line.readInterpolated(i, current);
+            }
+        }
+};
+
+// 12 dB biquad lowpass filter
+class LowPassNode : public GraphNode {
+    private:
+        int sampleRate;
+        double cutoff;
+
+        double a1, a2;
+        double b0, b1, b2;
+
+        double x1, x2;
+        double y1, y2;
+    public:
+        // direct form 1, the state lives in locals while a block runs and
+        // goes back into the node with store()
+        class Kernel {
+            private:
+                LowPassNode &node;
+
+                double a1, a2;
+                double b0, b1, b2;
+
+                double x1, x2;
+                double y1, y2;
+            public:
+                static const int inputs = 1;
+
+                Kernel(LowPassNode &node) : node(node), a1(node.a1), a2(node.a2), b0(node.b0), b1(node.b1), b2(node.b2), x1(node.x1), x2(node.x2), y1(node.y1), y2(node.y2) {
+                }
+
+                float tick(float input, float, float) {
+                    double x0 = input;
+                    double y0 = b0 * x0 + b1 * x1 + b2 * x2 - a1 * y1 - a2 * y2;
+
+                    x2 = x1;
+                    x1 = x0;
+                    y2 = y1;
+                    y1 = y0;
+
+                    return y0;
+                }
+
+                void store() {
+                    node.x1 = x1;
+                    node.x2 = x2;
+                    node.y1 = y1;
+                    node.y2 = y2;
+                }
+        };
+
+        LowPassNode(int sampleRate) : sampleRate(sampleRate), x1(0.0), x2(0.0), y1(0.0), y2(0.0) {
+            setParam(AUDIO_PARAM_CUTOFF, 1000.0);
+        }
+
+        bool setParam(int param, double value) {
+            if (param != AUDIO_PARAM_CUTOFF) {
+                return false;
+            }
+
+            cutoff = value;
+
+            // same coefficients as LowPass in main.py
+            double omega = 2.0 * M_PI * value / sampleRate;
+            double cosOmega = cos(omega);
+            double alpha = sin(omega) / (2.0 * 7.0);
+            double scale = 1.0 / (1.0 + alpha);
+
+            a1 = -scale * 2.0 * cosOmega;
+            a2 = -scale * (alpha - 1.0);
+            b1 = scale * (1.0 - cosOmega);
+            b0 = b1 * 0.5;
+            b2 = b0;
+
+            return true;
+        }
+
+        bool getParam(int param, double &value) const {
+            if (param != AUDIO_PARAM_CUTOFF) {
+                return false;
+            }
+
+            value = cutoff;
+            return true;
+        }
+
+        // same coefficients, cleared state
+        GraphNode *clone() const {
+            LowPassNode *node = new LowPassNode(*this);
+            node->x1 = node->x2 = 0.0;
+            node->y1 = node->y2 = 0.0;
+
+            return node;
+        }
+
+        void copyState(const GraphNode &other) {
+            const LowPassNode &node = static_cast<const LowPassNode &>(other);
+            x1 = node.x1;
+            x2 = node.x2;
+            y1 = node.y1;
+            y2 = node.y2;
+        }
+
+        void process(const float *const *inputs, float *output, size_t frames) {
+            const float *input = inputs[0];
+
+            Kernel kernel(*this);
+            for (size_t i=0; i<frames; ++i) {
+                output[i] = kernel.tick(input[i], 0.0f, 0.0f);
+            }
+            kernel.store();
+        }
+};
+
+// LowPass sections in series, 12 dB per section
+class LowPassCascadeNode : public GraphNode {
+    private:
+        static const int maxSections = 16;
+
+        int sampleRate;
+        double cutoff;
+        BiquadBank sections;
+
+        void updateCoefficients() {
+            BiquadCoefficients coefficients = lowPassCoefficients(cutoff, sampleRate);
+            for (size_t i=0; i<sections.size(); ++i) {
+                sections.setCoefficients(i, coefficients);
+            }
+        }
+    public:
+        LowPassCascadeNode(int sampleRate) : sampleRate(sampleRate), cutoff(1000.0), sections(1) {
+            updateCoefficients();
+        }
+
+        bool setParam(int param, double value) {
+            switch (param) {
+                case AUDIO_PARAM_CUTOFF:
+                    cutoff = value;
+                    break;
+                case AUDIO_PARAM_SECTIONS:
+                    sections.resize(std::min(std::max((int)value, 1), (int)maxSections));
+                    break;
+                default:
+                    return false;
+            }
+
+            updateCoefficients();
+            return true;
+        }
+
+        bool getParam(int param, double &value) const {
+            switch (param) {
+                case AUDIO_PARAM_CUTOFF:
+                    value = cutoff;
+                    return true;
+                case AUDIO_PARAM_SECTIONS:
+                    value = sections.size();
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        // the section count resizes the bank
+        bool canSchedule(int param, double) const {
+            return param != AUDIO_PARAM_SECTIONS;
+        }
+
+        GraphNode *clone() const {
+            LowPassCascadeNode *node = new LowPassCascadeNode(sampleRate);
+            node->cutoff = cutoff;
+            node->sections.resize(sections.size());
+            node->updateCoefficients();
+
+            return node;
+        }
+
+        void copyState(const GraphNode &other) {
+            sections.copyState(static_cast<const LowPassCascadeNode &>(other).sections);
+        }
+
+        void process(const float *const *inputs, float *output, size_t frames) {
+            sections.processCascade(inputs[0], output, frames);
+        }
+};
+
+// resonant lowpasses at their own cutoffs, all on the same input and summed
+// with a gain each. The bands are independent filters so they run in the
+// SIMD lanes of a BiquadBank.
+class FilterBankNode : public GraphNode {
+    private:
+        int sampleRate;
+        size_t blockSize;
+
+        std::vector<double> cutoffs;
+        std::vector<float> gains;
+        std::vector<LevelRamp> gainRamps;
+        BiquadBank bands;
+
+        std::vector<float> bandOutputs;
+        std::vector<const float *> inputPointers;
+        std::vector<float *> outputPointers;
+
+        void setBandCount(size_t count) {
+            cutoffs.resize(count, 1000.0);
+            gains.resize(count, 1.0f);
+            gainRamps.resize(count);
+            bands.resize(count);
+
+            bandOutputs.resize(count * blockSize);
+            inputPointers.resize(count);
+            outputPointers.resize(count);
+            for (size_t i=0; i<count; ++i) {
+                outputPointers[i] = bandOutputs.data() + i * blockSize;
+                bands.setCoefficients(i, lowPassCoefficients(cutoffs[i], sampleRate));
+            }
+        }
+    public:
+        FilterBankNode(int sampleRate, size_t blockSize) : sampleRate(sampleRate), blockSize(blockSize) {
+            setBandCount(1);
+        }
+
+        bool setParam(int param, double value) {
+            if (param == AUDIO_PARAM_SECTIONS) {
+                setBandCount(std::min(std::max((int)value, 1), AUDIO_MAX_BANDS));
+                return true;
+            }
+
+            int band = param & 0xff;
+            if (band >= (int)cutoffs.size()) {
+                return false;
+            }
+
+            if (param == AUDIO_PARAM_BAND_CUTOFF(band)) {
+                cutoffs[band] = value;
+                bands.setCoefficients(band, lowPassCoefficients(value, sampleRate));
+                return true;
+            }
+
+            if (param == AUDIO_PARAM_BAND_GAIN(band)) {
+                gains[band] = value;
+                gainRamps[band].stop();
+                return true;
+            }
+
+            return false;
+        }
+
+        bool canRamp(int param) const {
+            int band = param & 0xff;
+            return band < (int)gains.size() && param == AUDIO_PARAM_BAND_GAIN(band);
+        }
+
+        bool rampParam(int param, double value, double step, size_t frames) {
+            if (!canRamp(param)) {
+                return false;
+            }
+
+            int band = param & 0xff;
+            gainRamps[band].start(gains[band], value, step, frames);
+            return true;
+        }
+
+        bool getParam(int param, double &value) const {
+            if (param == AUDIO_PARAM_SECTIONS) {
+                value = cutoffs.size();
+                return true;
+            }
+
+            int band = param & 0xff;
+            if (band >= (int)cutoffs.size()) {
+                return false;
+            }
+
+            if (param == AUDIO_PARAM_BAND_CUTOFF(band)) {
+                value = cutoffs[band];
+                return true;
+            }
+
+            if (param == AUDIO_PARAM_BAND_GAIN(band)) {
+                value = gains[band];
+                return true;
+            }
+
+            return false;
+        }
+
+        // the band count resizes the bank and its buffers
+        bool canSchedule(int param, double) const {
+            return param != AUDIO_PARAM_SECTIONS;
+        }
+
+        GraphNode *clone() const {
+            FilterBankNode *node = new FilterBankNode(sampleRate, blockSize);
+            node->setBandCount(cutoffs.size());
+            node->cutoffs = cutoffs;
+            node->gains = gains;
+            for (size_t i=0; i<cutoffs.size(); ++i) {
+                node->bands.setCoefficients(i, lowPassCoefficients(cutoffs[i], sampleRate));
+            }
+
+            return node;
+        }
+
+        void copyState(const GraphNode &other) {
+            bands.copyState(static_cast<const FilterBankNode &>(other).bands);
+        }
+
+        void process(const float *const *inputs, float *output, size_t frames) {
+            std::fill(inputPointers.begin(), inputPointers.end(), inputs[0]);
+            bands.process(inputPointers.data(), outputPointers.data(), frames);
+
+            std::fill(output, output + frames, 0.0f);
+            for (size_t band=0; band<gains.size(); ++band) {
+                const float *samples = outputPointers[band];
+
+                if (gainRamps[band].running()) {
+                    for (size_t i=0; i<frames; ++i) {
+                        output[i] += gainRamps[band].tick(gains[band]) * samples[i];
+                    }
+                    continue;
+                }
+
+                float gain = gains[band];
+                for (size_t i=0; i<frames; ++i) {
+                    output[i] += gain * samples[i];
+                }
+            }
+        }
+};
+
+// The kernels of two nodes in one loop, Input is the input of Second that
+// reads the output of First. Intermediate samples stay in registers.
+template <typename First, typename Second, int Input>
+class FusedPair : public FusedChain {
+    private:
+        First &first;
+        Second &second;
+    public:
+        FusedPair(First &first, Second &second) : first(first), second(second) {
+        }
+
+        void process(const float *const *const *inputs, float *output, size_t frames) {
+            const float *a0 = inputs[0][0], *a1 = inputs[0][1], *a2 = inputs[0][2];
+            const float *b0 = inputs[1][0], *b1 = inputs[1][1], *b2 = inputs[1][2];
+
+            typename First::Kernel head(first);
+            typename Second::Kernel tail(second);
+
+            for (size_t i=0; i<frames; ++i) {
+                float value = head.tick(a0[i], a1[i], a2[i]);
+                output[i] = tail.tick(Input == 0 ? value : b0[i], Input == 1 ? value : b1[i], Input == 2 ? value : b2[i]);
+            }
+
+            head.store();
+            tail.store();
+        }
+};
+
+// three kernels in one loop, Second only has the one input that First feeds
+template <typename First, typename Second, typename Third, int Input>
+class FusedTriple : public FusedChain {
+    private:
+        First &first;
+        Second &second;
+        Third &third;
+    public:
+        FusedTriple(First &first, Second &second, Third &third) : first(first), second(second), third(third) {
+        }
+
+        void process(const float *const *const *inputs, float *output, size_t frames) {
+            const float *a0 = inputs[0][0], *a1 = inputs[0][1], *a2 = inputs[0][2];
+            const float *c0 = inputs[2][0], *c1 = inputs[2][1], *c2 = inputs[2][2];
+
+            typename First::Kernel head(first);
+            typename Second::Kernel middle(second);
+            typename Third::Kernel tail(third);
+
+            for (size_t i=0; i<frames; ++i) {
+                float value = middle.tick(head.tick(a0[i], a1[i], a2[i]), 0.0f, 0.0f);
+                output[i] = tail.tick(Input == 0 ? value : c0[i], Input == 1 ? value : c1[i], Input == 2 ? value : c2[i]);
+            }
+
+            head.store();
+            middle.store();
+            tail.store();
+        }
+};
+
+template <typename First, typename Second>
+static FusedChain *fusePair(GraphNode *const *nodes, int input) {
+    First &head = *static_cast<First *>(nodes[0]);
+    Second &tail = *static_cast<Second *>(nodes[1]);
+
+    switch (input < Second::Kernel::inputs ? input : -1) {
+        case 0:
+            return new FusedPair<First, Second, 0>(head, tail);
+        case 1:
+            return new FusedPair<First, Second, 1>(head, tail);
+        case 2:
+            return new FusedPair<First, Second, 2>(head, tail);
+        default:
+            return nullptr;
+    }
+}
+
+template <typename First, typename Second, typename Third>
+static FusedChain *fuseTriple(GraphNode *const *nodes, int input) {
+    First &head = *static_cast<First *>(nodes[0]);
+    Second &middle = *static_cast<Second *>(nodes[1]);
+    Third &tail = *static_cast<Third *>(nodes[2]);
+
+    switch (input < Third::Kernel::inputs ? input : -1) {
+        case 0:
+            return new FusedTriple<First, Second, Third, 0>(head, middle, tail);
+        case 1:
+            return new FusedTriple<First, Second, Third, 1>(head, middle, tail);
+        case 2:
+            return new FusedTriple<First, Second, Third, 2>(head, middle, tail);
+        default:
+            return nullptr;
+    }
+}
+
+// the middle of a triple has to have a single input, other kernels don't
+// get triples instantiated at all
+template <typename First, typename Second>
+static FusedChain *fuseThird(GraphNode *const *, const int *, int, std::false_type) {
+    return nullptr;
+}
+
+template <typename First, typename Second>
+static FusedChain *fuseThird(GraphNode *const *nodes, const int *types, int input, std::true_type) {
+    switch (types[2]) {
+        case AUDIO_NODE_MIXER:
+            return fuseTriple<First, Second, MixerNode>(nodes, input);
+        case AUDIO_NODE_COMBINER:
+            return fuseTriple<First, Second, CombinerNode>(nodes, input);
+        case AUDIO_NODE_LOW_PASS:
+            return fuseTriple<First, Second, LowPassNode>(nodes, input);
+        case AUDIO_NODE_DELAY:
+            return fuseTriple<First, Second, DelayNode>(nodes, input);
+        default:
+            return nullptr;
+    }
+}
+
+template <typename First, typename Second>
+static FusedChain *fuseChain(GraphNode *const *nodes, const int *types, int count, int input) {
+    if (count == 2) {
+        return fusePair<First, Second>(nodes, input);
+    }
+
+    return fuseThird<First, Second>(nodes, types, input, std::integral_constant<bool, Second::Kernel::inputs == 1>());
+}
+
+template <typename First>
+static FusedChain *fuseSecond(GraphNode *const *nodes, const int *types, int count, int input) {
+    switch (types[1]) {
+        case AUDIO_NODE_MIXER:
+            return fuseChain<First, MixerNode>(nodes, types, count, input);
+        case AUDIO_NODE_COMBINER:
+            return fuseChain<First, CombinerNode>(nodes, types, count, input);
+        case AUDIO_NODE_LOW_PASS:
+            return fuseChain<First, LowPassNode>(nodes, types, count, input);
+        case AUDIO_NODE_DELAY:
+            return fuseChain<First, DelayNode>(nodes, types, count, input);
+        default:
+            return nullptr;
+    }
+}
+
+FusedChain *createFusedChain(GraphNode *const *nodes, const int *types, int count, int input) {
+    if (count < 2 || count > FusedChain::maxNodes) {
+        return nullptr;
+    }
+
+    switch (types[0]) {
+        case AUDIO_NODE_MIXER:
+            return fuseSecond<MixerNode>(nodes, types, count, input);
+        case AUDIO_NODE_COMBINER:
+            return fuseSecond<CombinerNode>(nodes, types, count, input);
+        case AUDIO_NODE_LOW_PASS:
+            return fuseSecond<LowPassNode>(nodes, types, count, input);
+        case AUDIO_NODE_DELAY:
+            return fuseSecond<DelayNode>(nodes, types, count, input);
+        default:
+            return nullptr;
+    }
+}
+
+GraphNode *createGraphNode(int type, int sampleRate, size_t blockSize) {
+    switch (type) {
+        case AUDIO_NODE_OUTPUT_DEVICE:
+            return new OutputDeviceNode();
+        case AUDIO_NODE_SAMPLE_PLAYER:
+            return new SamplePlayerNode();
+        case AUDIO_NODE_STREAM_PLAYER:
+            return new StreamPlayerNode();
+        case AUDIO_NODE_OSCILLATOR:
+            return new OscillatorNode(sampleRate);
+        case AUDIO_NODE_MIXER:
+            return new MixerNode();
+        case AUDIO_NODE_COMBINER:
+            return new CombinerNode();
+        case AUDIO_NODE_DELAY:
+            return new DelayNode(sampleRate, blockSize);
+        case AUDIO_NODE_MODULATED_DELAY:
+            return new ModulatedDelayNode(sampleRate, blockSize);
+        case AUDIO_NODE_LOW_PASS:
+            return new LowPassNode(sampleRate);
+        case AUDIO_NODE_LOW_PASS_CASCADE:
+            return new LowPassCascadeNode(sampleRate);
+        case AUDIO_NODE_FILTER_BANK:
+            return new FilterBankNode(sampleRate, blockSize);
+        default:
+            return nullptr;
+    }
+}
@@ -0,0 +1,21 @@
+#ifndef __NODES_H
+#define __NODES_H
+
+#include "graph.h"
+
+// Native versions of the nodes in main.py, they produce the same output as
+// the per-sample Python render() methods but a block at a time. Types and
+// parameters are the AUDIO_NODE_* and AUDIO_PARAM_* values from audio.h.
+
+// returns NULL for an unknown type, nodes never get more than blockSize
+// frames at a time
+GraphNode *createGraphNode(int type, int sampleRate, size_t blockSize);
+
+// a chain of count nodes as a single loop, each one's output going into the
+// next one and the second to last into input of the last. NULL if there's no
+// fused kernel for the chain: mixers, combiners, low passes and delays fuse,
+// the middle of three has to be a low pass or delay. The nodes stay owned by
+// the caller.
+FusedChain *createFusedChain(GraphNode *const *nodes, const int *types, int count, int input);
+
+#endif
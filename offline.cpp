@@ -0,0 +1,145 @@
+#include <stdio.h>
+
+#include "convert.h"
+#include "offline.h"
+
+OfflineRenderer::OfflineRenderer() : writeBlockIsFloat(true), writeBlockOut(false), samplePosition(0), clockOrigin(0) {
+    audio_config_default(&config);
+}
+
+bool OfflineRenderer::start(const AudioConfig &config, const char *path, int format, bool direct) {
+    if (config.framesPerBuffer < 1 || config.sampleRate < 1 || config.renderRate < 0 || config.channelCount < 1 || config.channelCount > 2) {
+        printf("OfflineRenderer: invalid config\n");
+        return false;
+    }
+
+    if (format != AUDIO_FILE_F32 && format != AUDIO_FILE_WAV) {
+        printf("OfflineRenderer: unknown file format %d\n", format);
+        return false;
+    }
+
+    this->config = config;
+
+    if (!writer.open(path, format, config.sampleRate, config.channelCount, direct)) {
+        return false;
+    }
+
+    converter.setOutputFormat(config.sampleRate, config.channelCount);
+    converter.setQuality(config.resampleQuality);
+    converter.reserve(renderRate(config), config.framesPerBuffer);
+
+    // everything that is needed per block is allocated up front
+    size_t blockSize = config.framesPerBuffer * config.channelCount;
+    writeBlock.resize(blockSize);
+    floatWriteBlock.resize(blockSize);
+    conversionInput.reserve(blockSize);
+
+    writeBlockOut = false;
+    samplePosition = 0;
+    clockOrigin = 0;
+
+    return true;
+}
+
+void OfflineRenderer::stop() {
+    writer.close();
+}
+
+const AudioConfig &OfflineRenderer::getConfig() {
+    return config;
+}
+
+double OfflineRenderer::getOutputLatency() {
+    return 0.0;
+}
+
+void OfflineRenderer::writeFrames(const float *samples, int sampleCount, int sampleRate, int channelCount) {
+    // same conversion the OpenAL renderer does for frames in other formats
+    if (sampleRate != config.sampleRate || channelCount != config.channelCount) {
+        conversionOutput.resize(converter.maxOutputFrames(sampleCount, sampleRate) * config.channelCount);
+        sampleCount = converter.process(samples, sampleCount, sampleRate, channelCount, conversionOutput.data());
+        samples = conversionOutput.data();
+    } else {
+        converter.reset();
+    }
+
+    writer.write(samples, sampleCount * config.channelCount);
+    samplePosition += sampleCount;
+}
+
+void OfflineRenderer::pushFrame(const int16_t *samples, int sampleCount, int sampleRate, int channelCount) {
+    conversionInput.resize(sampleCount * channelCount);
+    convertToFloat(conversionInput.data(), samples, conversionInput.size());
+
+    writeFrames(conversionInput.data(), sampleCount, sampleRate, channelCount);
+}
+
+void OfflineRenderer::pushFrame(const float *samples, int sampleCount, int sampleRate, int channelCount) {
+    writeFrames(samples, sampleCount, sampleRate, channelCount);
+}
+
+bool OfflineRenderer::usesFloatOutput() {
+    return true;
+}
+
+int16_t *OfflineRenderer::acquireWriteBlock(int frames) {
+    if (writeBlockOut) {
+        return nullptr;
+    }
+
+    writeBlock.resize(frames * config.channelCount);
+    writeBlockIsFloat = false;
+    writeBlockOut = true;
+
+    return writeBlock.data();
+}
+
+float *OfflineRenderer::acquireFloatWriteBlock(int frames) {
+    if (writeBlockOut) {
+        return nullptr;
+    }
+
+    floatWriteBlock.resize(frames * config.channelCount);
+    writeBlockIsFloat = true;
+    writeBlockOut = true;
+
+    return floatWriteBlock.data();
+}
+
+void OfflineRenderer::commitWriteBlock() {
+    if (!writeBlockOut) {
+        return;
+    }
+    writeBlockOut = false;
+
+    int frames;
+
+    if (writeBlockIsFloat) {
+        frames = floatWriteBlock.size() / config.channelCount;
+        writeFrames(floatWriteBlock.data(), frames, renderRate(config), config.channelCount);
+    } else {
+        frames = writeBlock.size() / config.channelCount;
+        pushFrame(writeBlock.data(), frames, renderRate(config), config.channelCount);
+    }
+}
+
+void OfflineRenderer::releaseWriteBlock() {
+    writeBlockOut = false;
+}
+
+int64_t OfflineRenderer::getSamplePosition() {
+    return samplePosition - clockOrigin;
+}
+
+double OfflineRenderer::getSecondsPlayed() {
+    return (double)getSamplePosition() / config.sampleRate;
+}
+
+void OfflineRenderer::resetSecondsPlayed() {
+    clockOrigin = samplePosition;
+}
+
+int OfflineRenderer::getBufferSize() {
+    // nothing waits to be played
+    return 0;
+}
@@ -0,0 +1,59 @@
+#ifndef __OFFLINE_H
+#define __OFFLINE_H
+
+#include <vector>
+
+#include "resample.h"
+#include "samplefile.h"
+#include "sink.h"
+
+// Takes the place of the OpenAL renderer when rendering to a file. There is
+// no device and no audio thread, pushed samples are converted to the
+// configured format and written out right away, so rendering runs as fast as
+// the producer and the disk allow.
+class OfflineRenderer : public AudioSink {
+    private:
+        AudioConfig config;
+        SampleFileWriter writer;
+
+        FormatConverter converter;
+        std::vector<float> conversionInput;
+        std::vector<float> conversionOutput;
+
+        // the block handed out by the acquire functions
+        std::vector<int16_t> writeBlock;
+        std::vector<float> floatWriteBlock;
+        bool writeBlockIsFloat;
+        bool writeBlockOut;
+
+        int64_t samplePosition;
+        int64_t clockOrigin;
+
+        void writeFrames(const float *samples, int sampleCount, int sampleRate, int channelCount);
+    public:
+        OfflineRenderer();
+
+        bool start(const AudioConfig &config, const char *path, int format, bool direct);
+        void stop();
+
+        const AudioConfig &getConfig();
+        double getOutputLatency();
+
+        void pushFrame(const int16_t *samples, int sampleCount, int sampleRate, int channelCount);
+        void pushFrame(const float *samples, int sampleCount, int sampleRate, int channelCount);
+
+        bool usesFloatOutput();
+        int16_t *acquireWriteBlock(int frames);
+        float *acquireFloatWriteBlock(int frames);
+        void commitWriteBlock();
+        void releaseWriteBlock();
+
+        // the sample clock counts frames written to the file
+        int64_t getSamplePosition();
+        double getSecondsPlayed();
+        void resetSecondsPlayed();
+
+        int getBufferSize();
+};
+
+#endif
@@ -0,0 +1,168 @@
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define REALTIME_SSE 1
+#include <xmmintrin.h>
+#endif
+
+#ifdef __APPLE__
+#include <mach/mach.h>
+#include <mach/mach_time.h>
+#include <mach/thread_policy.h>
+#endif
+
+#include "realtime.h"
+
+// control bits that flush denormal results and treat denormal inputs as zero
+#if REALTIME_SSE
+static const unsigned long denormalBits = 0x8040;
+#elif defined(__aarch64__)
+static const unsigned long denormalBits = 1ul << 24;
+#endif
+
+static unsigned long floatingPointMode() {
+#if REALTIME_SSE
+    return _mm_getcsr();
+#elif defined(__aarch64__)
+    unsigned long mode;
+    __asm__ __volatile__("mrs %0, fpcr" : "=r"(mode));
+    return mode;
+#else
+    return 0;
+#endif
+}
+
+static void setFloatingPointMode(unsigned long mode) {
+#if REALTIME_SSE
+    _mm_setcsr((unsigned int)mode);
+#elif defined(__aarch64__)
+    __asm__ __volatile__("msr fpcr, %0" : : "r"(mode));
+#else
+    (void)mode;
+#endif
+}
+
+static bool flushDenormals() {
+#if REALTIME_SSE || defined(__aarch64__)
+    setFloatingPointMode(floatingPointMode() | denormalBits);
+    return true;
+#else
+    return false;
+#endif
+}
+
+DenormalGuard::DenormalGuard() : savedMode(floatingPointMode()) {
+    flushDenormals();
+}
+
+DenormalGuard::~DenormalGuard() {
+    setFloatingPointMode(savedMode);
+}
+
+static bool setPriority(const ThreadPolicy &policy) {
+#ifdef __APPLE__
+    // the scheduler guarantees a share of every period instead of a priority
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    double ticksPerSecond = 1e9 * timebase.denom / timebase.numer;
+
+    thread_time_constraint_policy_data_t constraint;
+    constraint.period = (uint32_t)(policy.period * ticksPerSecond);
+    constraint.computation = (uint32_t)(policy.period * 0.5 * ticksPerSecond);
+    constraint.constraint = (uint32_t)(policy.period * ticksPerSecond);
+    constraint.preemptible = 1;
+
+    kern_return_t result = thread_policy_set(pthread_mach_thread_np(pthread_self()), THREAD_TIME_CONSTRAINT_POLICY, (thread_policy_t)&constraint, THREAD_TIME_CONSTRAINT_POLICY_COUNT);
+    if (result != KERN_SUCCESS) {
+        printf("realtime: can't set the time constraint policy (%d)\n", result);
+        return false;
+    }
+
+    return true;
+#else
+    struct sched_param parameters;
+    memset(&parameters, 0, sizeof(parameters));
+    parameters.sched_priority = policy.priority;
+
+    int result = pthread_setschedparam(pthread_self(), SCHED_FIFO, &parameters);
+    if (result != 0) {
+        printf("realtime: can't set SCHED_FIFO priority %d: %s\n", policy.priority, strerror(result));
+        return false;
+    }
+
+    return true;
+#endif
+}
+
+static bool setAffinity(int cpu) {
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+
+    int result = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (result != 0) {
+        printf("realtime: can't pin the thread to core %d: %s\n", cpu, strerror(result));
+        return false;
+    }
+
+    return true;
+#elif defined(__APPLE__)
+    // only a hint, threads with different tags are kept apart
+    thread_affinity_policy_data_t affinity;
+    affinity.affinity_tag = cpu + 1;
+
+    kern_return_t result = thread_policy_set(pthread_mach_thread_np(pthread_self()), THREAD_AFFINITY_POLICY, (thread_policy_t)&affinity, THREAD_AFFINITY_POLICY_COUNT);
+    return result == KERN_SUCCESS;
+#else
+    return false;
+#endif
+}
+
+bool applyThreadPolicy(const ThreadPolicy &policy) {
+    bool result = true;
+
+    if (policy.flushDenormals) {
+        result &= flushDenormals();
+    }
+
+    if (policy.priority > 0) {
+        result &= setPriority(policy);
+    }
+
+    if (policy.cpu >= 0) {
+        result &= setAffinity(policy.cpu % processorCount());
+    }
+
+    return result;
+}
+
+bool lockMemory() {
+    // with a memlock limit future allocations would start failing once they
+    // reach it, only lock them when there is no limit that applies
+    int flags = MCL_CURRENT;
+
+    struct rlimit limit;
+    if (geteuid() == 0 || (getrlimit(RLIMIT_MEMLOCK, &limit) == 0 && limit.rlim_cur == RLIM_INFINITY)) {
+        flags |= MCL_FUTURE;
+    }
+
+    if (mlockall(flags) != 0) {
+        printf("realtime: can't lock memory: %s\n", strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+int processorCount() {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+}
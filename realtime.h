@@ -0,0 +1,49 @@
+#ifndef __REALTIME_H
+#define __REALTIME_H
+
+// Hardening for the threads on the audio path. Everything here is best
+// effort, a failure prints a warning and the thread carries on as it was.
+
+struct ThreadPolicy {
+    // 0 keeps normal scheduling, 1 to 99 is a SCHED_FIFO priority on Linux,
+    // on Mac OS X any of them selects the time constraint policy
+    int priority;
+
+    // core to pin the thread to, -1 lets it float
+    int cpu;
+
+    // flush denormals to zero (FTZ and DAZ on x86, FZ on ARM64)
+    bool flushDenormals;
+
+    // how often the thread has to deliver, in seconds, for the time
+    // constraint policy on Mac OS X
+    double period;
+
+    ThreadPolicy() : priority(0), cpu(-1), flushDenormals(false), period(0.01) {
+    }
+};
+
+// applies the policy to the calling thread, returns false if any part of it
+// could not be applied
+bool applyThreadPolicy(const ThreadPolicy &policy);
+
+// Flushes denormals on the calling thread while it exists and restores the
+// previous floating point mode afterwards, for code that runs on threads it
+// doesn't own.
+class DenormalGuard {
+    private:
+        unsigned long savedMode;
+    public:
+        DenormalGuard();
+        ~DenormalGuard();
+};
+
+// locks the pages of the process into memory so the hot path never takes a
+// page fault. Pages allocated later are only locked too when RLIMIT_MEMLOCK
+// is unlimited or the process is privileged, otherwise allocations would
+// start failing at the limit.
+bool lockMemory();
+
+int processorCount();
+
+#endif
@@ -0,0 +1,359 @@
+#include <algorithm>
+
+#include <math.h>
+#include <string.h>
+
+#include "audio.h"
+#include "convert.h"
+#include "resample.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define RESAMPLE_SSE2 1
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#define RESAMPLE_NEON 1
+#include <arm_neon.h>
+#endif
+
+// kernel length at the output rate, passband edge as a fraction of the
+// lower Nyquist frequency and Kaiser window shape for each quality
+struct SincQuality {
+    int taps;
+    double passband;
+    double beta;
+};
+
+static const SincQuality sincQualities[] = {
+    {16, 0.85, 6.0},    // AUDIO_RESAMPLE_FAST, about 60 dB stopband
+    {32, 0.90, 8.6},    // AUDIO_RESAMPLE_MEDIUM, about 90 dB
+    {64, 0.94, 10.5}    // AUDIO_RESAMPLE_BEST, about 110 dB
+};
+
+// rows of the blended table, and the largest exact table in floats
+static const int blendedPhases = 256;
+static const int64_t maxExactTable = 1 << 18;
+
+static int64_t greatestCommonDivisor(int64_t a, int64_t b) {
+    while (b) {
+        int64_t rest = a % b;
+        a = b;
+        b = rest;
+    }
+
+    return a;
+}
+
+// zeroth order modified Bessel function of the first kind, for the window
+static double besselI0(double x) {
+    double sum = 1.0;
+    double term = 1.0;
+
+    for (int k=1; k<50; ++k) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-12) {
+            break;
+        }
+    }
+
+    return sum;
+}
+
+static float dotProduct(const float *samples, const float *coefficients, int count) {
+#if defined(RESAMPLE_SSE2)
+    // two accumulators hide the latency of the adds
+    __m128 first = _mm_setzero_ps();
+    __m128 second = _mm_setzero_ps();
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        first = _mm_add_ps(first, _mm_mul_ps(_mm_loadu_ps(samples + i), _mm_loadu_ps(coefficients + i)));
+        second = _mm_add_ps(second, _mm_mul_ps(_mm_loadu_ps(samples + i + 4), _mm_loadu_ps(coefficients + i + 4)));
+    }
+    for (; i < count; i += 4) {
+        first = _mm_add_ps(first, _mm_mul_ps(_mm_loadu_ps(samples + i), _mm_loadu_ps(coefficients + i)));
+    }
+
+    __m128 sum = _mm_add_ps(first, second);
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+
+    return _mm_cvtss_f32(sum);
+#elif defined(RESAMPLE_NEON)
+    float32x4_t first = vdupq_n_f32(0.0f);
+    float32x4_t second = vdupq_n_f32(0.0f);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        first = vmlaq_f32(first, vld1q_f32(samples + i), vld1q_f32(coefficients + i));
+        second = vmlaq_f32(second, vld1q_f32(samples + i + 4), vld1q_f32(coefficients + i + 4));
+    }
+    for (; i < count; i += 4) {
+        first = vmlaq_f32(first, vld1q_f32(samples + i), vld1q_f32(coefficients + i));
+    }
+
+    return vaddvq_f32(vaddq_f32(first, second));
+#else
+    float sum = 0.0f;
+    for (int i=0; i<count; ++i) {
+        sum += samples[i] * coefficients[i];
+    }
+
+    return sum;
+#endif
+}
+
+SincResampler::SincResampler() : taps(0), phases(0), exact(true), step(1), denominator(1), position(0), inputRate(0), outputRate(0), quality(-1) {
+}
+
+void SincResampler::configure(int inputRate, int outputRate, int quality) {
+    quality = std::min(std::max(quality, (int)AUDIO_RESAMPLE_FAST), (int)AUDIO_RESAMPLE_BEST);
+
+    if (inputRate != this->inputRate || outputRate != this->outputRate || quality != this->quality) {
+        this->inputRate = inputRate;
+        this->outputRate = outputRate;
+        this->quality = quality;
+
+        const SincQuality &settings = sincQualities[quality - AUDIO_RESAMPLE_FAST];
+
+        int64_t divisor = greatestCommonDivisor(inputRate, outputRate);
+        step = inputRate / divisor;
+        denominator = outputRate / divisor;
+
+        // when going down the cutoff follows the output rate and the kernel
+        // gets longer to keep the same transition band
+        double ratio = std::min((double)outputRate / inputRate, 1.0);
+        double cutoff = ratio * settings.passband;
+        taps = std::min(((int)ceil(settings.taps / ratio) + 3) & ~3, 512);
+
+        exact = denominator * taps <= maxExactTable;
+        phases = exact ? (int)denominator : blendedPhases;
+
+        // blended tables have an extra row for the fraction 1.0
+        int rows = exact ? phases : phases + 1;
+        table.assign((size_t)rows * taps, 0.0f);
+        blended.assign(taps, 0.0f);
+
+        double halfWidth = taps / 2;
+        double windowScale = 1.0 / besselI0(settings.beta);
+
+        for (int row=0; row<rows; ++row) {
+            double fraction = (double)row / phases;
+            float *coefficients = table.data() + (size_t)row * taps;
+
+            // tap k sits at k - (taps / 2 - 1) - fraction from the output
+            // frame, each row is normalized to unity gain
+            double sum = 0.0;
+            for (int k=0; k<taps; ++k) {
+                double x = k - (halfWidth - 1.0) - fraction;
+                double argument = M_PI * cutoff * x;
+                double sinc = fabs(argument) < 1e-9 ? 1.0 : sin(argument) / argument;
+
+                double edge = x / halfWidth;
+                double window = fabs(edge) >= 1.0 ? 0.0 : besselI0(settings.beta * sqrt(1.0 - edge * edge)) * windowScale;
+
+                coefficients[k] = (float)(sinc * window);
+                sum += coefficients[k];
+            }
+
+            for (int k=0; k<taps; ++k) {
+                coefficients[k] = (float)(coefficients[k] / sum);
+            }
+        }
+    }
+
+    reset();
+}
+
+void SincResampler::reset() {
+    position = 0;
+
+    for (auto &channel : history) {
+        channel.assign(std::max(taps - 1, 0), 0.0f);
+    }
+}
+
+const float *SincResampler::kernel(int64_t fraction) {
+    if (exact) {
+        return table.data() + (size_t)fraction * taps;
+    }
+
+    int64_t scaled = fraction * phases;
+    int row = (int)(scaled / denominator);
+    float blend = (float)(scaled % denominator) / denominator;
+
+    const float *first = table.data() + (size_t)row * taps;
+    const float *second = first + taps;
+    for (int k=0; k<taps; ++k) {
+        blended[k] = first[k] + (second[k] - first[k]) * blend;
+    }
+
+    return blended.data();
+}
+
+void SincResampler::reserve(int inputFrames) {
+    for (auto &channel : history) {
+        channel.reserve(std::max(taps - 1, 0) + inputFrames);
+    }
+}
+
+int SincResampler::process(const float *input, int inputFrames, int channelCount, float *output) {
+    size_t kept = taps - 1;
+    size_t length = kept + inputFrames;
+
+    for (int c=0; c<channelCount; ++c) {
+        std::vector<float> &samples = history[c];
+        samples.resize(length);
+
+        for (int i=0; i<inputFrames; ++i) {
+            samples[kept + i] = input[i * channelCount + c];
+        }
+    }
+
+    int outputFrames = 0;
+    while (true) {
+        int64_t start = position / denominator;
+        if (start + taps > (int64_t)length) {
+            break;
+        }
+
+        const float *coefficients = kernel(position % denominator);
+        for (int c=0; c<channelCount; ++c) {
+            output[outputFrames * channelCount + c] = dotProduct(history[c].data() + start, coefficients, taps);
+        }
+
+        outputFrames++;
+        position += step;
+    }
+
+    // the last taps - 1 frames are the history of the next call
+    size_t consumed = length - kept;
+    position -= (int64_t)consumed * denominator;
+
+    for (int c=0; c<channelCount; ++c) {
+        std::vector<float> &samples = history[c];
+        memmove(samples.data(), samples.data() + consumed, kept * sizeof(float));
+        samples.resize(kept);
+    }
+
+    return outputFrames;
+}
+
+FormatConverter::FormatConverter() : outputRate(44100), outputChannels(1), quality(AUDIO_RESAMPLE_MEDIUM), inputRate(0), primed(false), position(0) {
+}
+
+void FormatConverter::setOutputFormat(int sampleRate, int channelCount) {
+    outputRate = sampleRate;
+    outputChannels = channelCount;
+
+    reset();
+}
+
+void FormatConverter::setQuality(int quality) {
+    this->quality = quality;
+
+    reset();
+}
+
+void FormatConverter::reset() {
+    primed = false;
+    position = 0;
+}
+
+void FormatConverter::reserve(int inputRate, int maxFrames) {
+    mapped.reserve(maxFrames * outputChannels);
+
+    // the table takes a while to build, the first frame at this rate then
+    // finds it done
+    if (inputRate != outputRate && quality != AUDIO_RESAMPLE_LINEAR) {
+        resampler.configure(inputRate, outputRate, quality);
+        resampler.reserve(maxFrames);
+    }
+}
+
+int FormatConverter::maxOutputFrames(int inputFrames, int inputRate) {
+    // one extra input frame of history, rounded up, plus one for the
+    // fractional part of the position carried over from the previous call
+    return (int)ceil((inputFrames + 1) * (double)outputRate / inputRate) + 1;
+}
+
+int FormatConverter::processLinear(const float *samples, int inputFrames, float *output) {
+    // the frame before the first one of this call is the last one of the
+    // previous call
+    const double step = (double)inputRate / outputRate;
+
+    int outputFrames = 0;
+    while (position < inputFrames - 1) {
+        int index = (int)floor(position);
+        float fraction = (float)(position - index);
+
+        for (int c=0; c<outputChannels; ++c) {
+            float a = index < 0 ? previous[c] : samples[index * outputChannels + c];
+            float b = samples[(index + 1) * outputChannels + c];
+
+            output[outputFrames * outputChannels + c] = a + (b - a) * fraction;
+        }
+
+        outputFrames++;
+        position += step;
+    }
+
+    position -= inputFrames;
+
+    return outputFrames;
+}
+
+int FormatConverter::process(const float *input, int inputFrames, int inputRate, int inputChannels, float *output) {
+    if (inputFrames <= 0) {
+        return 0;
+    }
+
+    // map the channels first so the resampler only ever sees the output
+    // layout, mono is duplicated and stereo is averaged down
+    const float *samples = input;
+    if (inputChannels != outputChannels) {
+        mapped.resize(inputFrames * outputChannels);
+
+        if (outputChannels == 2) {
+            duplicateMonoToStereo(mapped.data(), input, inputFrames);
+        } else {
+            for (int i=0; i<inputFrames; ++i) {
+                mapped[i] = (input[i * 2] + input[i * 2 + 1]) * 0.5f;
+            }
+        }
+
+        samples = mapped.data();
+    }
+
+    // a rate change restarts the conversion from the current frame
+    if (!primed || inputRate != this->inputRate) {
+        this->inputRate = inputRate;
+        position = 0;
+
+        for (int c=0; c<outputChannels; ++c) {
+            previous[c] = samples[c];
+        }
+
+        if (inputRate != outputRate && quality != AUDIO_RESAMPLE_LINEAR) {
+            resampler.configure(inputRate, outputRate, quality);
+        }
+
+        primed = true;
+    }
+
+    int outputFrames;
+    if (inputRate == outputRate) {
+        memcpy(output, samples, inputFrames * outputChannels * sizeof(float));
+        outputFrames = inputFrames;
+    } else if (quality == AUDIO_RESAMPLE_LINEAR) {
+        outputFrames = processLinear(samples, inputFrames, output);
+    } else {
+        outputFrames = resampler.process(samples, inputFrames, outputChannels, output);
+    }
+
+    for (int c=0; c<outputChannels; ++c) {
+        previous[c] = samples[(inputFrames - 1) * outputChannels + c];
+    }
+
+    return outputFrames;
+}
@@ -0,0 +1,103 @@
+#ifndef __RESAMPLE_H
+#define __RESAMPLE_H
+
+#include <vector>
+
+#include <stdint.h>
+
+// Windowed-sinc resampler for a fixed pair of rates, on deinterleaved
+// history per channel. The kernel for every output frame comes from a
+// polyphase table: one row per phase when the reduced rate ratio has few of
+// them (44.1 <-> 48 kHz, 2x oversampling and the like), otherwise rows at
+// fixed steps with the two nearest blended together. Positions are kept as
+// exact fractions so long streams don't drift. The output lags the input by
+// half the kernel length.
+class SincResampler {
+    private:
+        // taps per row are a multiple of the SIMD width
+        int taps;
+        int phases;
+        bool exact;
+        std::vector<float> table;
+        std::vector<float> blended;
+
+        // output frames advance the position by step / denominator input
+        // frames
+        int64_t step;
+        int64_t denominator;
+
+        // position of the kernel start in the history, in 1 / denominator
+        // input frames
+        int64_t position;
+
+        // taps - 1 frames from earlier calls followed by the current input
+        std::vector<float> history[2];
+
+        int inputRate;
+        int outputRate;
+        int quality;
+
+        const float *kernel(int64_t fraction);
+    public:
+        SincResampler();
+
+        // rebuilds the table if anything changed and clears the history
+        void configure(int inputRate, int outputRate, int quality);
+        void reset();
+
+        // room in the history for calls of up to inputFrames frames
+        void reserve(int inputFrames);
+
+        // returns the number of frames written, at most about inputFrames
+        // times the rate ratio plus one
+        int process(const float *input, int inputFrames, int channelCount, float *output);
+};
+
+// Brings interleaved float frames of any sample rate and channel count to a
+// fixed output format. State is kept between calls so consecutive frames
+// join up without clicks, call reset() when the stream is interrupted.
+class FormatConverter {
+    private:
+        int outputRate;
+        int outputChannels;
+        int quality;
+
+        // input format the state below belongs to
+        int inputRate;
+        bool primed;
+
+        // state of the linear interpolation: read position in input frames
+        // relative to the first frame of the next call, -1 refers to the
+        // last frame of the previous call
+        double position;
+        float previous[2];
+
+        SincResampler resampler;
+
+        // input after channel mapping
+        std::vector<float> mapped;
+
+        int processLinear(const float *samples, int inputFrames, float *output);
+    public:
+        FormatConverter();
+
+        void setOutputFormat(int sampleRate, int channelCount);
+
+        // one of AUDIO_RESAMPLE_*, restarts the conversion
+        void setQuality(int quality);
+        void reset();
+
+        // allocates ahead for frames of up to maxFrames at inputRate and
+        // builds the resampler for that rate, after setOutputFormat and
+        // setQuality. Bigger frames and other rates still work but allocate.
+        void reserve(int inputRate, int maxFrames);
+
+        // upper bound for the number of frames process() produces
+        int maxOutputFrames(int inputFrames, int inputRate);
+
+        // convert inputFrames frames into output and return the number of
+        // frames written, output needs room for maxOutputFrames() frames
+        int process(const float *input, int inputFrames, int inputRate, int inputChannels, float *output);
+};
+
+#endif
@@ -0,0 +1,207 @@
+#ifndef __RINGBUFFER_H
+#define __RINGBUFFER_H
+
+#include <atomic>
+#include <vector>
+
+#include <new>
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+// Base for classes with cache line aligned members that live on the heap,
+// plain new only honours their alignment from C++17 on.
+struct CacheAligned {
+    static void *operator new(size_t size);
+    static void operator delete(void *pointer);
+};
+
+inline void *CacheAligned::operator new(size_t size) {
+    void *pointer;
+    if (posix_memalign(&pointer, 64, size) != 0) {
+        throw std::bad_alloc();
+    }
+
+    return pointer;
+}
+
+inline void CacheAligned::operator delete(void *pointer) {
+    free(pointer);
+}
+
+// Single producer, single consumer lock-free queue with a fixed number of
+// preallocated slots. The capacity is rounded up to a power of two so the
+// head and tail indices can simply be masked.
+template <typename T>
+class SpscQueue {
+    private:
+        std::vector<T> slots;
+        size_t mask;
+
+        // head is only written by the consumer, tail only by the producer,
+        // keep them on separate cache lines so the threads don't fight
+        alignas(64) std::atomic<size_t> head;
+        alignas(64) std::atomic<size_t> tail;
+    public:
+        SpscQueue(size_t capacity);
+
+        // returns false if the queue is full
+        bool push(const T &value);
+
+        // returns false if the queue is empty
+        bool pop(T &value);
+
+        size_t size() const;
+        size_t capacity() const;
+};
+
+template <typename T>
+SpscQueue<T>::SpscQueue(size_t capacity) : head(0), tail(0) {
+    size_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+
+    slots.resize(size);
+    mask = size - 1;
+}
+
+template <typename T>
+bool SpscQueue<T>::push(const T &value) {
+    size_t currentTail = tail.load(std::memory_order_relaxed);
+    if (currentTail - head.load(std::memory_order_acquire) > mask) {
+        return false;
+    }
+
+    slots[currentTail & mask] = value;
+    tail.store(currentTail + 1, std::memory_order_release);
+
+    return true;
+}
+
+template <typename T>
+bool SpscQueue<T>::pop(T &value) {
+    size_t currentHead = head.load(std::memory_order_relaxed);
+    if (currentHead == tail.load(std::memory_order_acquire)) {
+        return false;
+    }
+
+    value = slots[currentHead & mask];
+    head.store(currentHead + 1, std::memory_order_release);
+
+    return true;
+}
+
+template <typename T>
+size_t SpscQueue<T>::size() const {
+    return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+}
+
+template <typename T>
+size_t SpscQueue<T>::capacity() const {
+    return mask + 1;
+}
+
+// Lets a thread sleep until some condition becomes true. The signalling side
+// only takes the lock when somebody is actually waiting, so a producer and
+// consumer that keep up with each other never touch the mutex.
+//
+// The mutex and condition are deliberately never destroyed, the audio thread
+// is still parked on them when the static renderer goes away at exit.
+class EventSignal {
+    private:
+        std::atomic<int> waiters;
+
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;
+    public:
+        EventSignal();
+
+        // block until ready() returns true, ready() may have side effects
+        // such as popping from a queue
+        template <typename Predicate>
+        void wait(Predicate ready);
+
+        // like wait() but gives up after the timeout (in microseconds) has
+        // passed, returns whether ready() became true
+        template <typename Predicate>
+        bool waitFor(Predicate ready, long timeout);
+
+        void signal();
+};
+
+inline EventSignal::EventSignal() : waiters(0) {
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&cond, NULL);
+}
+
+template <typename Predicate>
+void EventSignal::wait(Predicate ready) {
+    if (ready()) {
+        return;
+    }
+
+    pthread_mutex_lock(&mutex);
+
+    // announce ourselves before checking again, the fences pair up with the
+    // one in signal() so either we see the new state or signal() sees us
+    waiters.fetch_add(1);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    while (!ready()) {
+        pthread_cond_wait(&cond, &mutex);
+    }
+
+    waiters.fetch_sub(1);
+    pthread_mutex_unlock(&mutex);
+}
+
+template <typename Predicate>
+bool EventSignal::waitFor(Predicate ready, long timeout) {
+    if (ready()) {
+        return true;
+    }
+
+    // condition waits take an absolute wall clock deadline
+    struct timeval now;
+    gettimeofday(&now, NULL);
+
+    long microseconds = now.tv_usec + timeout;
+
+    struct timespec deadline;
+    deadline.tv_sec = now.tv_sec + microseconds / 1000000;
+    deadline.tv_nsec = (microseconds % 1000000) * 1000;
+
+    pthread_mutex_lock(&mutex);
+
+    waiters.fetch_add(1);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    bool result;
+    while (!(result = ready())) {
+        if (pthread_cond_timedwait(&cond, &mutex, &deadline) == ETIMEDOUT) {
+            result = ready();
+            break;
+        }
+    }
+
+    waiters.fetch_sub(1);
+    pthread_mutex_unlock(&mutex);
+
+    return result;
+}
+
+inline void EventSignal::signal() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiters.load(std::memory_order_relaxed) == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&mutex);
+    pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&mutex);
+}
+
+#endif
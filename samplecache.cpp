@@ -0,0 +1,162 @@
+#include <sys/stat.h>
+
+#include "samplecache.h"
+
+// bytes held before files nobody uses are dropped
+static const size_t defaultBudget = 512 << 20;
+
+// modification time in nanoseconds, so a rewrite within the same second
+// still counts as a change
+static int64_t modifiedTime(const struct stat &info) {
+#ifdef __APPLE__
+    return (int64_t)info.st_mtimespec.tv_sec * 1000000000 + info.st_mtimespec.tv_nsec;
+#else
+    return (int64_t)info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+#endif
+}
+
+CachedSamples::CachedSamples() : decodedData(nullptr), modified(0), fileSize(0), inode(0), lastUse(0) {
+}
+
+const float *CachedSamples::data() const {
+    return file.data();
+}
+
+size_t CachedSamples::size() const {
+    return file.size();
+}
+
+const double *CachedSamples::doubles() const {
+    return decodedData.load(std::memory_order_acquire);
+}
+
+SampleCache::SampleCache() : budget(defaultBudget), bytes(0), useCounter(0) {
+    pthread_mutex_init(&mutex, NULL);
+}
+
+SampleCache::~SampleCache() {
+    pthread_mutex_destroy(&mutex);
+}
+
+size_t SampleCache::entryBytes(const CachedSamples &entry) {
+    return entry.size() * sizeof(float) + entry.decoded.size() * sizeof(double);
+}
+
+SampleRef SampleCache::acquire(const char *path, bool decode) {
+    struct stat info;
+    bool exists = stat(path, &info) == 0;
+
+    pthread_mutex_lock(&mutex);
+
+    std::shared_ptr<CachedSamples> entry;
+
+    auto found = entries.find(path);
+    if (found != entries.end()) {
+        CachedSamples &cached = *found->second;
+        if (exists && cached.modified == modifiedTime(info) && cached.fileSize == (int64_t)info.st_size && cached.inode == (uint64_t)info.st_ino) {
+            entry = found->second;
+        } else {
+            // changed or gone, references that are still out keep the old
+            // mapping alive until they are dropped
+            if (found->second.use_count() > 1) {
+                retired.push_back(found->second);
+            } else {
+                bytes -= entryBytes(cached);
+            }
+            entries.erase(found);
+        }
+    }
+
+    if (!entry && exists) {
+        entry = std::make_shared<CachedSamples>();
+        if (entry->file.open(path)) {
+            entry->modified = modifiedTime(info);
+            entry->fileSize = info.st_size;
+            entry->inode = info.st_ino;
+
+            entries[path] = entry;
+            bytes += entryBytes(*entry);
+        } else {
+            entry.reset();
+        }
+    }
+
+    if (entry) {
+        if (decode && !entry->doubles()) {
+            // other players may hold the entry already, they only see the
+            // samples once they are all there
+            entry->decoded.assign(entry->data(), entry->data() + entry->size());
+            entry->decodedData.store(entry->decoded.data(), std::memory_order_release);
+            bytes += entry->decoded.size() * sizeof(double);
+        }
+
+        entry->lastUse = ++useCounter;
+    }
+
+    trim();
+
+    pthread_mutex_unlock(&mutex);
+
+    return entry;
+}
+
+void SampleCache::releaseRetired() {
+    // nobody can get another reference to a retired entry, so once only the
+    // cache holds it it's gone for good
+    for (size_t i=0; i<retired.size();) {
+        if (retired[i].use_count() == 1) {
+            bytes -= entryBytes(*retired[i]);
+            retired[i] = retired.back();
+            retired.pop_back();
+        } else {
+            ++i;
+        }
+    }
+}
+
+void SampleCache::trim() {
+    releaseRetired();
+
+    // a linear scan per eviction, a cache holds a few dozen files at most
+    while (bytes > budget) {
+        auto oldest = entries.end();
+
+        for (auto i=entries.begin(); i!=entries.end(); ++i) {
+            // only the cache refers to it, and nobody can get another
+            // reference without the mutex
+            if (i->second.use_count() == 1 && (oldest == entries.end() || i->second->lastUse < oldest->second->lastUse)) {
+                oldest = i;
+            }
+        }
+
+        if (oldest == entries.end()) {
+            break;
+        }
+
+        bytes -= entryBytes(*oldest->second);
+        entries.erase(oldest);
+    }
+}
+
+void SampleCache::setBudget(size_t bytes) {
+    pthread_mutex_lock(&mutex);
+
+    budget = bytes;
+    trim();
+
+    pthread_mutex_unlock(&mutex);
+}
+
+size_t SampleCache::getSize() {
+    pthread_mutex_lock(&mutex);
+    releaseRetired();
+    size_t size = bytes;
+    pthread_mutex_unlock(&mutex);
+
+    return size;
+}
+
+SampleCache &sampleCache() {
+    static SampleCache cache;
+    return cache;
+}
@@ -0,0 +1,93 @@
+#ifndef __SAMPLECACHE_H
+#define __SAMPLECACHE_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "samplefile.h"
+
+// A mapped .f32 file shared by everything that plays it, optionally decoded
+// to doubles for the players in main.py. Read-only once it is handed out,
+// except for decoding, which only shows through doubles() once it is done.
+class CachedSamples {
+    friend class SampleCache;
+    private:
+        MappedSampleFile file;
+        std::vector<double> decoded;
+
+        // set once decoded is filled in, players may already hold the entry
+        // while another one decodes it
+        std::atomic<const double *> decodedData;
+
+        // identity of the file on disk when it was mapped, modified is in
+        // nanoseconds
+        int64_t modified;
+        int64_t fileSize;
+        uint64_t inode;
+
+        // value of the use counter of the cache when last acquired
+        uint64_t lastUse;
+    public:
+        CachedSamples();
+
+        const float *data() const;
+        size_t size() const;
+
+        // NULL unless acquired with decode at some point
+        const double *doubles() const;
+};
+
+typedef std::shared_ptr<const CachedSamples> SampleRef;
+
+// Process wide cache of sample files keyed by path and modification time, so
+// a patch with many voices on one file maps and decodes it once. References
+// keep a file alive, files nobody references stay around until the bytes
+// held go over the budget and are dropped oldest use first. A file that has
+// changed on disk is mapped again while players of the old one keep the old
+// mapping, which only stays intact if the file was replaced rather than
+// rewritten in place.
+class SampleCache {
+    private:
+        pthread_mutex_t mutex;
+        std::unordered_map<std::string, std::shared_ptr<CachedSamples>> entries;
+
+        // entries for files that changed while still referenced, their bytes
+        // count until the last reference is dropped, which the next call into
+        // the cache notices
+        std::vector<std::shared_ptr<CachedSamples>> retired;
+
+        size_t budget;
+        size_t bytes;
+        uint64_t useCounter;
+
+        static size_t entryBytes(const CachedSamples &entry);
+        void releaseRetired();
+        void trim();
+    public:
+        SampleCache();
+        ~SampleCache();
+
+        SampleCache(const SampleCache &) = delete;
+        SampleCache &operator=(const SampleCache &) = delete;
+
+        // empty on failure
+        SampleRef acquire(const char *path, bool decode);
+
+        void setBudget(size_t bytes);
+
+        // bytes held, referenced or not, including files that changed on disk
+        // while players still had them
+        size_t getSize();
+};
+
+// the cache all sample players share
+SampleCache &sampleCache();
+
+#endif
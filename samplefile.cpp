@@ -0,0 +1,278 @@
+#include <algorithm>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "audio.h"
+#include "samplefile.h"
+
+const float *mapSampleFile(const char *path, size_t *sampleCount) {
+    *sampleCount = 0;
+
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        printf("mapSampleFile: can't open %s: %s\n", path, strerror(errno));
+        return nullptr;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        printf("mapSampleFile: can't stat %s: %s\n", path, strerror(errno));
+        ::close(fd);
+        return nullptr;
+    }
+
+    size_t count = info.st_size / sizeof(float);
+    if (count == 0) {
+        ::close(fd);
+        return nullptr;
+    }
+
+    void *data = mmap(nullptr, count * sizeof(float), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (data == MAP_FAILED) {
+        printf("mapSampleFile: can't map %s: %s\n", path, strerror(errno));
+        return nullptr;
+    }
+
+    // players read the file front to back, let the kernel read ahead
+    madvise(data, count * sizeof(float), MADV_WILLNEED);
+
+    *sampleCount = count;
+    return (const float *)data;
+}
+
+void unmapSampleFile(const float *samples, size_t sampleCount) {
+    if (samples) {
+        munmap((void *)samples, sampleCount * sizeof(float));
+    }
+}
+
+MappedSampleFile::MappedSampleFile() : samples(nullptr), sampleCount(0) {
+}
+
+MappedSampleFile::~MappedSampleFile() {
+    close();
+}
+
+bool MappedSampleFile::open(const char *path) {
+    close();
+
+    samples = mapSampleFile(path, &sampleCount);
+    return samples != nullptr;
+}
+
+void MappedSampleFile::close() {
+    unmapSampleFile(samples, sampleCount);
+
+    samples = nullptr;
+    sampleCount = 0;
+}
+
+const float *MappedSampleFile::data() const {
+    return samples;
+}
+
+size_t MappedSampleFile::size() const {
+    return sampleCount;
+}
+
+// one megabyte is a multiple of every block size O_DIRECT could ask for
+static const size_t writeBufferSize = 1 << 20;
+static const size_t wavHeaderSize = 44;
+
+SampleFileWriter::SampleFileWriter() : fd(-1), format(AUDIO_FILE_F32), sampleRate(0), channelCount(0), direct(false), buffer(nullptr), bufferFill(0), headerFill(0), dataSize(0), failed(false) {
+}
+
+SampleFileWriter::~SampleFileWriter() {
+    close();
+    free(buffer);
+}
+
+bool SampleFileWriter::open(const char *path, int format, int sampleRate, int channelCount, bool direct) {
+    close();
+
+    if (!buffer && posix_memalign((void **)&buffer, 4096, writeBufferSize) != 0) {
+        buffer = nullptr;
+        printf("SampleFileWriter: can't allocate write buffer\n");
+        return false;
+    }
+
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+    this->direct = false;
+
+#ifdef O_DIRECT
+    if (direct) {
+        fd = ::open(path, flags | O_DIRECT, 0644);
+        this->direct = fd >= 0;
+    }
+#endif
+
+    // file systems like tmpfs refuse O_DIRECT, fall back to plain writes
+    if (fd < 0) {
+        fd = ::open(path, flags, 0644);
+    }
+
+    if (fd < 0) {
+        printf("SampleFileWriter: can't create %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+#ifdef F_NOCACHE
+    if (direct) {
+        fcntl(fd, F_NOCACHE, 1);
+    }
+#endif
+
+    this->format = format;
+    this->sampleRate = sampleRate;
+    this->channelCount = channelCount;
+    dataSize = 0;
+    failed = false;
+
+    // the header is filled in on close, when the size is known
+    bufferFill = format == AUDIO_FILE_WAV ? wavHeaderSize : 0;
+    headerFill = bufferFill;
+    memset(buffer, 0, bufferFill);
+
+    return true;
+}
+
+size_t SampleFileWriter::writeAll(const char *data, size_t size) {
+    size_t written = 0;
+    while (written < size) {
+        ssize_t result = ::write(fd, data + written, size - written);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+#ifdef O_DIRECT
+            // some file systems open with O_DIRECT and then refuse the writes
+            if (errno == EINVAL && direct) {
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+                direct = false;
+                continue;
+            }
+#endif
+
+            printf("SampleFileWriter: write failed: %s\n", strerror(errno));
+            break;
+        }
+
+        written += result;
+    }
+
+    return written;
+}
+
+bool SampleFileWriter::flush() {
+    size_t written = writeAll(buffer, bufferFill);
+
+    // the WAV header goes out first and isn't data
+    size_t header = std::min(written, headerFill);
+    headerFill -= header;
+    dataSize += written - header;
+
+    // what didn't reach the file stays for the next flush
+    memmove(buffer, buffer + written, bufferFill - written);
+    bufferFill -= written;
+    failed = bufferFill > 0;
+
+    return !failed;
+}
+
+bool SampleFileWriter::write(const float *samples, size_t count) {
+    if (fd < 0 || failed) {
+        return false;
+    }
+
+    const char *data = (const char *)samples;
+    size_t size = count * sizeof(float);
+
+    while (size > 0) {
+        size_t chunk = std::min(size, writeBufferSize - bufferFill);
+        memcpy(buffer + bufferFill, data, chunk);
+
+        data += chunk;
+        size -= chunk;
+        bufferFill += chunk;
+
+        // only whole buffers go out while rendering, which keeps O_DIRECT
+        // writes aligned
+        if (bufferFill == writeBufferSize && !flush()) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void putLittleEndian(char *destination, uint32_t value, int size) {
+    for (int i=0; i<size; ++i) {
+        destination[i] = (value >> (i * 8)) & 0xff;
+    }
+}
+
+void SampleFileWriter::fillWavHeader(char *header) {
+    uint32_t bytesPerFrame = channelCount * sizeof(float);
+
+    // a failed write can end in the middle of a frame
+    uint32_t dataBytes = (uint32_t)std::min(dataSize, (uint64_t)UINT32_MAX - wavHeaderSize);
+    dataBytes -= dataBytes % bytesPerFrame;
+
+    memcpy(header, "RIFF", 4);
+    putLittleEndian(header + 4, dataBytes + wavHeaderSize - 8, 4);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    putLittleEndian(header + 16, 16, 4);
+    putLittleEndian(header + 20, 3, 2);     // IEEE float
+    putLittleEndian(header + 22, channelCount, 2);
+    putLittleEndian(header + 24, sampleRate, 4);
+    putLittleEndian(header + 28, sampleRate * bytesPerFrame, 4);
+    putLittleEndian(header + 32, bytesPerFrame, 2);
+    putLittleEndian(header + 34, 32, 2);
+    memcpy(header + 36, "data", 4);
+    putLittleEndian(header + 40, dataBytes, 4);
+}
+
+bool SampleFileWriter::close() {
+    if (fd < 0) {
+        return true;
+    }
+
+    // the tail isn't a whole block, write it and the header the normal way
+#ifdef O_DIRECT
+    if (direct) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+    }
+#endif
+
+    bool result = !failed && flush();
+
+    if (format == AUDIO_FILE_WAV) {
+        char header[wavHeaderSize];
+        fillWavHeader(header);
+
+        if (pwrite(fd, header, wavHeaderSize, 0) != (ssize_t)wavHeaderSize) {
+            printf("SampleFileWriter: can't write WAV header: %s\n", strerror(errno));
+            result = false;
+        }
+    }
+
+    ::close(fd);
+    fd = -1;
+
+    return result;
+}
+
+uint64_t SampleFileWriter::getSampleCount() const {
+    return dataSize / sizeof(float);
+}
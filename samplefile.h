@@ -0,0 +1,80 @@
+#ifndef __SAMPLEFILE_H
+#define __SAMPLEFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Read-only memory mapping of a .f32 sample file, which is nothing but raw
+// native float samples. The pages are shared with every other process that
+// maps the same file.
+class MappedSampleFile {
+    private:
+        const float *samples;
+        size_t sampleCount;
+    public:
+        MappedSampleFile();
+        ~MappedSampleFile();
+
+        // owns the mapping, so no copies
+        MappedSampleFile(const MappedSampleFile &) = delete;
+        MappedSampleFile &operator=(const MappedSampleFile &) = delete;
+
+        bool open(const char *path);
+        void close();
+
+        const float *data() const;
+        size_t size() const;
+};
+
+// Writes float samples to a .f32 or WAV file as fast as the disk allows.
+// Samples are collected in a large page aligned buffer that goes out in one
+// write() when full, optionally with O_DIRECT (F_NOCACHE on OS X) so long
+// renders don't push everything else out of the page cache.
+class SampleFileWriter {
+    private:
+        int fd;
+        int format;
+        int sampleRate;
+        int channelCount;
+        bool direct;
+
+        // page aligned, starts with room for the WAV header until that has
+        // been written. dataSize only counts samples that reached the file.
+        char *buffer;
+        size_t bufferFill;
+        size_t headerFill;
+        uint64_t dataSize;
+
+        // set when a write fails, the file ends where the error happened
+        bool failed;
+
+        // returns how much of the data reached the file
+        size_t writeAll(const char *data, size_t size);
+
+        // keeps whatever couldn't be written at the start of the buffer
+        bool flush();
+        void fillWavHeader(char *header);
+    public:
+        SampleFileWriter();
+        ~SampleFileWriter();
+
+        SampleFileWriter(const SampleFileWriter &) = delete;
+        SampleFileWriter &operator=(const SampleFileWriter &) = delete;
+
+        // format is AUDIO_FILE_F32 or AUDIO_FILE_WAV
+        bool open(const char *path, int format, int sampleRate, int channelCount, bool direct);
+        bool write(const float *samples, size_t count);
+
+        // writes what's left and finishes the WAV header
+        bool close();
+
+        // samples written to the file so far
+        uint64_t getSampleCount() const;
+};
+
+// map a file for users that keep the pointer themselves, unmapSampleFile
+// needs the sample count that mapSampleFile returned
+const float *mapSampleFile(const char *path, size_t *sampleCount);
+void unmapSampleFile(const float *samples, size_t sampleCount);
+
+#endif
@@ -0,0 +1,307 @@
+#include <algorithm>
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "samplestream.h"
+
+SampleStream::SampleStream(size_t chunkSize, int chunkCount) : fd(-1), fileLength(0), readPosition(0), readGeneration(0), seekPosition(0), seekGeneration(0), chunks(std::max(chunkCount, 2)), filledChunks(chunks.size()), emptyChunks(chunks.size()), current(nullptr), currentOffset(0), lookahead(nullptr), generation(0), playedPosition(0), running(false), underruns(0) {
+    // all chunk storage is allocated here, nothing is allocated while
+    // streaming
+    for (auto &chunk : chunks) {
+        chunk.samples.resize(chunkSize);
+        chunk.count = 0;
+        chunk.position = 0;
+        chunk.generation = 0;
+    }
+}
+
+SampleStream::~SampleStream() {
+    close();
+}
+
+bool SampleStream::open(const char *path) {
+    close();
+
+    fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        printf("SampleStream: can't open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(float)) {
+        printf("SampleStream: %s has no samples\n", path);
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+
+    fileLength = info.st_size / sizeof(float);
+    readPosition = 0;
+    readGeneration = 0;
+    seekPosition = 0;
+    seekGeneration = 0;
+    generation = 0;
+    playedPosition = 0;
+
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    // fill every chunk before the render thread gets to see the stream so it
+    // starts with a full read-ahead
+    for (auto &chunk : chunks) {
+        fillChunk(&chunk);
+        filledChunks.push(&chunk);
+    }
+
+    running = true;
+    pthread_create(&thread, NULL, ioThreadTrampoline, this);
+
+    return true;
+}
+
+void SampleStream::close() {
+    if (running) {
+        running = false;
+        chunkReleased.signal();
+        pthread_join(thread, NULL);
+    }
+
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+
+    // collect the chunks from wherever they are so the stream can be opened
+    // again
+    Chunk *chunk;
+    while (filledChunks.pop(chunk)) {
+    }
+    while (emptyChunks.pop(chunk)) {
+    }
+
+    current = nullptr;
+    currentOffset = 0;
+    lookahead = nullptr;
+    fileLength = 0;
+}
+
+void *SampleStream::ioThreadTrampoline(void *sampleStream) {
+    return ((SampleStream *)sampleStream)->ioThreadHandler();
+}
+
+void *SampleStream::ioThreadHandler() {
+    for (;;) {
+        Chunk *chunk = nullptr;
+
+        // sleep until the render thread has played a chunk or we are closed
+        chunkReleased.wait([&]() { return emptyChunks.pop(chunk) || !running; });
+        if (!running) {
+            break;
+        }
+
+        fillChunk(chunk);
+
+        // there is a slot for every chunk so this can't fail
+        filledChunks.push(chunk);
+    }
+
+    return nullptr;
+}
+
+void SampleStream::fillChunk(Chunk *chunk) {
+    unsigned seek = seekGeneration.load(std::memory_order_acquire);
+    if (seek != readGeneration) {
+        readGeneration = seek;
+        readPosition = seekPosition.load(std::memory_order_relaxed);
+    }
+
+    chunk->position = readPosition;
+    chunk->generation = readGeneration;
+
+    size_t filled = 0;
+    size_t capacity = chunk->samples.size();
+
+    while (filled < capacity) {
+        size_t count = std::min(capacity - filled, fileLength - readPosition);
+        ssize_t result = pread(fd, chunk->samples.data() + filled, count * sizeof(float), readPosition * sizeof(float));
+
+        if (result <= 0) {
+            if (result < 0 && errno == EINTR) {
+                continue;
+            }
+
+            // read error, hand out what we have
+            break;
+        }
+
+        size_t samples = result / sizeof(float);
+        filled += samples;
+        readPosition += samples;
+
+        // wrap around so the stream loops
+        if (readPosition >= fileLength) {
+            readPosition = 0;
+        }
+    }
+
+    chunk->count = filled;
+}
+
+SampleStream::Chunk *SampleStream::takeChunk() {
+    Chunk *chunk = lookahead;
+    lookahead = nullptr;
+
+    if (!chunk && !filledChunks.pop(chunk)) {
+        return nullptr;
+    }
+
+    return chunk;
+}
+
+SampleStream::Chunk *SampleStream::nextChunk() {
+    for (;;) {
+        Chunk *chunk = takeChunk();
+        if (!chunk || chunk->generation == generation) {
+            return chunk;
+        }
+
+        // read before the last seek
+        releaseChunk(chunk);
+    }
+}
+
+void SampleStream::releaseChunk(Chunk *chunk) {
+    // hand the chunk back to the I/O thread for refilling
+    emptyChunks.push(chunk);
+    chunkReleased.signal();
+}
+
+template <typename T>
+size_t SampleStream::readSamples(T *destination, size_t count) {
+    size_t done = 0;
+
+    while (done < count) {
+        if (!current) {
+            current = nextChunk();
+            if (!current) {
+                // the disk can't keep up, play silence rather than wait
+                std::fill(destination + done, destination + count, (T)0);
+                underruns++;
+                break;
+            }
+
+            currentOffset = 0;
+        }
+
+        size_t available = std::min(count - done, current->count - currentOffset);
+        const float *samples = current->samples.data() + currentOffset;
+        for (size_t i=0; i<available; ++i) {
+            destination[done + i] = samples[i];
+        }
+
+        done += available;
+        currentOffset += available;
+
+        if (currentOffset >= current->count) {
+            playedPosition = (current->position + current->count) % fileLength;
+            releaseChunk(current);
+            current = nullptr;
+        }
+    }
+
+    return done;
+}
+
+size_t SampleStream::read(float *destination, size_t count) {
+    return readSamples(destination, count);
+}
+
+size_t SampleStream::read(double *destination, size_t count) {
+    return readSamples(destination, count);
+}
+
+void SampleStream::continueFrom(SampleStream &other) {
+    if (!running || !other.running || fileLength != other.fileLength || chunks[0].samples.size() < other.chunks[0].samples.size()) {
+        return;
+    }
+
+    // what the other stream has read ahead, the rest of its current chunk
+    // and the one after it
+    Chunk *sources[2] = {nullptr, nullptr};
+    size_t offsets[2] = {0, 0};
+    if (other.current) {
+        sources[0] = other.current;
+        offsets[0] = other.currentOffset;
+        sources[1] = other.lookahead = other.nextChunk();
+    } else {
+        sources[0] = other.lookahead = other.nextChunk();
+    }
+
+    // this side starts over: the chunks it holds become the copies and
+    // anything left of the old read-ahead is handed back after the seek
+    Chunk *spare = current;
+    current = nullptr;
+    generation++;
+
+    size_t position = other.current ? (other.current->position + other.currentOffset) % fileLength : other.playedPosition;
+    for (int i=0; i<2 && sources[i]; ++i) {
+        Chunk *source = sources[i];
+        size_t offset = offsets[i];
+
+        position = (source->position + offset) % fileLength;
+        if (offset >= source->count) {
+            continue;
+        }
+
+        Chunk *copy = spare ? spare : takeChunk();
+        spare = nullptr;
+        if (!copy) {
+            break;
+        }
+
+        copy->count = source->count - offset;
+        copy->position = position;
+        copy->generation = generation;
+        std::copy(source->samples.begin() + offset, source->samples.begin() + source->count, copy->samples.begin());
+        position = (source->position + source->count) % fileLength;
+
+        if (!current) {
+            current = copy;
+            currentOffset = 0;
+        } else {
+            lookahead = copy;
+        }
+    }
+
+    // so the I/O thread can start on them right away
+    Chunk *stale;
+    while (filledChunks.pop(stale)) {
+        emptyChunks.push(stale);
+    }
+    if (spare) {
+        emptyChunks.push(spare);
+    }
+
+    playedPosition = current ? current->position : position;
+
+    // the I/O thread reads on from the end of the copies
+    seekPosition.store(position, std::memory_order_relaxed);
+    seekGeneration.store(generation, std::memory_order_release);
+    chunkReleased.signal();
+}
+
+size_t SampleStream::length() const {
+    return fileLength;
+}
+
+uint64_t SampleStream::getUnderrunCount() const {
+    return underruns.load();
+}
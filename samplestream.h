@@ -0,0 +1,101 @@
+#ifndef __SAMPLESTREAM_H
+#define __SAMPLESTREAM_H
+
+#include <atomic>
+#include <vector>
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "ringbuffer.h"
+
+// Streams a .f32 file from disk so memory stays bounded no matter how long
+// the file is. A background thread reads ahead in fixed-size chunks, which
+// travel to the render thread and back through lock-free queues just like
+// the frames of AudioRenderer do. The stream loops at the end of the file.
+//
+// The render thread can move the stream to another position without
+// waiting. Chunks remember the seek they were read after, the ones read
+// before the last seek are handed back unplayed.
+class SampleStream : public CacheAligned {
+    private:
+        struct Chunk {
+            std::vector<float> samples;
+            size_t count;
+
+            // file position of the first sample and the seek it belongs to
+            size_t position;
+            unsigned generation;
+        };
+
+        int fd;
+        size_t fileLength;
+
+        // next sample the I/O thread reads and the last seek it followed,
+        // only touched by that thread
+        size_t readPosition;
+        unsigned readGeneration;
+
+        // set by the render thread, the generation is published last
+        std::atomic<size_t> seekPosition;
+        std::atomic<unsigned> seekGeneration;
+
+        std::vector<Chunk> chunks;
+        SpscQueue<Chunk *> filledChunks;
+        SpscQueue<Chunk *> emptyChunks;
+        EventSignal chunkReleased;
+
+        // render thread: the chunk it is reading from, the next one if it
+        // had a look at it already, and the seek it waits for
+        Chunk *current;
+        size_t currentOffset;
+        Chunk *lookahead;
+        unsigned generation;
+
+        // file position after the last chunk the render thread played
+        size_t playedPosition;
+
+        std::atomic<bool> running;
+        std::atomic<uint64_t> underruns;
+        pthread_t thread;
+
+        static void *ioThreadTrampoline(void *sampleStream);
+        void *ioThreadHandler();
+        void fillChunk(Chunk *chunk);
+
+        // render thread side of the queues
+        Chunk *takeChunk();
+        Chunk *nextChunk();
+        void releaseChunk(Chunk *chunk);
+
+        template <typename T>
+        size_t readSamples(T *destination, size_t count);
+    public:
+        // chunkCount chunks of chunkSize samples are in flight, at least two
+        // so one can be read from disk while the other one plays
+        SampleStream(size_t chunkSize, int chunkCount);
+        ~SampleStream();
+
+        // owns a thread and a file, so no copies
+        SampleStream(const SampleStream &) = delete;
+        SampleStream &operator=(const SampleStream &) = delete;
+
+        bool open(const char *path);
+        void close();
+
+        // render thread side, never blocks. If the disk fell behind the rest
+        // of the block is filled with silence and counted as an underrun.
+        size_t read(float *destination, size_t count);
+        size_t read(double *destination, size_t count);
+
+        // render thread, for a stream of the same file taking over from
+        // another one: plays on from where the other is. The samples the
+        // other has read ahead are copied, up to two of its chunks, which
+        // gives the I/O thread time to catch up with the seek.
+        void continueFrom(SampleStream &other);
+
+        size_t length() const;
+        uint64_t getUnderrunCount() const;
+};
+
+#endif
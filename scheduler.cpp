@@ -0,0 +1,242 @@
+#include <algorithm>
+
+#include <sched.h>
+
+#include "scheduler.h"
+
+WorkStealingDeque::WorkStealingDeque(size_t capacity) : top(0), bottom(0) {
+    size_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+
+    slots = std::vector<std::atomic<int>>(size);
+    mask = size - 1;
+}
+
+void WorkStealingDeque::push(int task) {
+    int64_t b = bottom.load(std::memory_order_relaxed);
+
+    slots[b & mask].store(task, std::memory_order_relaxed);
+    bottom.store(b + 1, std::memory_order_release);
+}
+
+bool WorkStealingDeque::take(int &task) {
+    int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top.load(std::memory_order_relaxed);
+
+    if (t > b) {
+        // empty
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return false;
+    }
+
+    task = slots[b & mask].load(std::memory_order_relaxed);
+    if (t < b) {
+        return true;
+    }
+
+    // last task, race the thieves for it
+    bool won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+    bottom.store(b + 1, std::memory_order_relaxed);
+
+    return won;
+}
+
+bool WorkStealingDeque::steal(int &task) {
+    int64_t t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = bottom.load(std::memory_order_acquire);
+
+    if (t >= b) {
+        return false;
+    }
+
+    task = slots[t & mask].load(std::memory_order_relaxed);
+    return top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+}
+
+TaskScheduler::TaskScheduler(int threadCount, const ThreadPolicy &policy) : threadCount(std::max(threadCount, 1)), policy(policy), runner(nullptr), remaining(0), busyWorkers(0), generation(0), running(true) {
+    deques.resize(this->threadCount);
+    starts.resize(this->threadCount);
+
+    // worker 0 is whoever calls run()
+    threads.resize(this->threadCount - 1);
+    for (int i=1; i<this->threadCount; ++i) {
+        starts[i].scheduler = this;
+        starts[i].worker = i;
+        pthread_create(&threads[i - 1], NULL, workerTrampoline, &starts[i]);
+    }
+
+    setGraph(std::vector<std::vector<int>>());
+}
+
+TaskScheduler::~TaskScheduler() {
+    running = false;
+    generation++;
+    wake.signal();
+
+    for (auto &thread : threads) {
+        pthread_join(thread, NULL);
+    }
+}
+
+void TaskScheduler::setGraph(const std::vector<std::vector<int>> &dependencies) {
+    int taskCount = dependencies.size();
+
+    // a worker can still be looking for work right after the last run
+    while (busyWorkers.load() > 0) {
+        sched_yield();
+    }
+
+    dependencyCounts.assign(taskCount, 0);
+    roots.clear();
+
+    // turn the dependency lists around into successor lists
+    std::vector<int> successorCounts(taskCount, 0);
+    for (int i=0; i<taskCount; ++i) {
+        dependencyCounts[i] = dependencies[i].size();
+        for (int dependency : dependencies[i]) {
+            successorCounts[dependency]++;
+        }
+
+        if (dependencies[i].empty()) {
+            roots.push_back(i);
+        }
+    }
+
+    successorOffsets.assign(taskCount + 1, 0);
+    for (int i=0; i<taskCount; ++i) {
+        successorOffsets[i + 1] = successorOffsets[i] + successorCounts[i];
+    }
+
+    successors.resize(successorOffsets[taskCount]);
+    std::vector<int> fill(successorOffsets.begin(), successorOffsets.end() - 1);
+    for (int i=0; i<taskCount; ++i) {
+        for (int dependency : dependencies[i]) {
+            successors[fill[dependency]++] = i;
+        }
+    }
+
+    pending.reset(new std::atomic<int>[std::max(taskCount, 1)]);
+
+    // a task is only ever in one deque once per run
+    for (auto &deque : deques) {
+        deque.reset(new WorkStealingDeque(std::max(taskCount, 1)));
+    }
+}
+
+void TaskScheduler::run(TaskRunner *runner) {
+    int taskCount = dependencyCounts.size();
+    if (taskCount == 0) {
+        return;
+    }
+
+    this->runner = runner;
+    for (int i=0; i<taskCount; ++i) {
+        pending[i].store(dependencyCounts[i], std::memory_order_relaxed);
+    }
+    remaining.store(taskCount, std::memory_order_relaxed);
+
+    for (int root : roots) {
+        deques[0]->push(root);
+    }
+
+    // publishes everything above to the workers
+    generation.fetch_add(1, std::memory_order_release);
+    wake.signal();
+
+    work(0);
+}
+
+void *TaskScheduler::workerTrampoline(void *start) {
+    WorkerStart *workerStart = (WorkerStart *)start;
+    workerStart->scheduler->workerHandler(workerStart->worker);
+
+    return nullptr;
+}
+
+void TaskScheduler::workerHandler(int worker) {
+    ThreadPolicy workerPolicy = policy;
+    if (workerPolicy.cpu >= 0) {
+        workerPolicy.cpu += worker - 1;
+    }
+    applyThreadPolicy(workerPolicy);
+
+    uint64_t seen = 0;
+
+    for (;;) {
+        // blocks tend to come back to back, spin for a bit before parking
+        uint64_t current = generation.load(std::memory_order_acquire);
+        for (int spin=0; spin<1000 && current == seen; ++spin) {
+            sched_yield();
+            current = generation.load(std::memory_order_acquire);
+        }
+
+        if (current == seen) {
+            wake.wait([&]() {
+                current = generation.load(std::memory_order_acquire);
+                return current != seen;
+            });
+        }
+
+        if (!running) {
+            break;
+        }
+
+        seen = current;
+
+        busyWorkers++;
+        work(worker);
+        busyWorkers--;
+    }
+}
+
+bool TaskScheduler::findTask(int worker, uint32_t &random, int &task) {
+    if (deques[worker]->take(task)) {
+        return true;
+    }
+
+    // xorshift to pick where to start stealing
+    random ^= random << 13;
+    random ^= random >> 17;
+    random ^= random << 5;
+
+    for (int i=0; i<threadCount; ++i) {
+        int victim = (random + i) % threadCount;
+        if (victim != worker && deques[victim]->steal(task)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void TaskScheduler::work(int worker) {
+    uint32_t random = 2463534242u + worker;
+    int task;
+
+    while (remaining.load() > 0) {
+        if (!findTask(worker, random, task)) {
+            sched_yield();
+            continue;
+        }
+
+        runner->runTask(task, worker);
+
+        for (int i=successorOffsets[task]; i<successorOffsets[task + 1]; ++i) {
+            int successor = successors[i];
+            if (pending[successor].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                deques[worker]->push(successor);
+            }
+        }
+
+        remaining.fetch_sub(1);
+    }
+}
+
+int TaskScheduler::getThreadCount() const {
+    return threadCount;
+}
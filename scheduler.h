@@ -0,0 +1,110 @@
+#ifndef __SCHEDULER_H
+#define __SCHEDULER_H
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "realtime.h"
+#include "ringbuffer.h"
+
+// Chase-Lev work-stealing deque of task indices. The owning thread pushes
+// and takes at the bottom, any other thread steals from the top. Indices only
+// ever grow so the slots never have to be reset, the capacity just has to
+// cover the number of tasks that can be in the deque at the same time.
+class WorkStealingDeque : public CacheAligned {
+    private:
+        std::vector<std::atomic<int>> slots;
+        int64_t mask;
+
+        alignas(64) std::atomic<int64_t> top;
+        alignas(64) std::atomic<int64_t> bottom;
+    public:
+        WorkStealingDeque(size_t capacity);
+
+        // owner only
+        void push(int task);
+        bool take(int &task);
+
+        // any thread
+        bool steal(int &task);
+};
+
+// Something that can run the tasks of a TaskScheduler. The worker index
+// goes from 0 (the thread that called run()) to threadCount - 1.
+class TaskRunner {
+    public:
+        virtual ~TaskRunner() {}
+
+        virtual void runTask(int task, int worker) = 0;
+};
+
+// Runs a fixed DAG of tasks over a pool of threads. Every task has an atomic
+// count of unfinished dependencies, finishing a task pushes the successors it
+// made ready onto the worker's own deque and idle workers steal from the
+// others. The calling thread works along and then spins until the last task
+// is done, so run() never sleeps or takes a lock itself.
+class TaskScheduler {
+    private:
+        int threadCount;
+        std::vector<pthread_t> threads;
+        ThreadPolicy policy;
+
+        // the DAG, successors are stored back to back
+        std::vector<int> dependencyCounts;
+        std::vector<int> successorOffsets;
+        std::vector<int> successors;
+        std::vector<int> roots;
+
+        std::unique_ptr<std::atomic<int>[]> pending;
+        std::vector<std::unique_ptr<WorkStealingDeque>> deques;
+
+        TaskRunner *runner;
+        std::atomic<int> remaining;
+
+        // workers inside work(), setGraph() waits for stragglers to leave
+        // before it replaces the deques
+        std::atomic<int> busyWorkers;
+
+        // bumped for every run, parked workers wait for it to change
+        std::atomic<uint64_t> generation;
+        std::atomic<bool> running;
+        EventSignal wake;
+
+        struct WorkerStart {
+            TaskScheduler *scheduler;
+            int worker;
+        };
+        std::vector<WorkerStart> starts;
+
+        static void *workerTrampoline(void *start);
+        void workerHandler(int worker);
+
+        // runs tasks until the current run is complete
+        void work(int worker);
+        bool findTask(int worker, uint32_t &random, int &task);
+    public:
+        // the worker threads apply the policy when they start. The thread
+        // calling run() is worker 0 and keeps its own settings, worker
+        // thread i (from 1 on) is pinned to core policy.cpu + i - 1 if it
+        // pins at all.
+        TaskScheduler(int threadCount, const ThreadPolicy &policy = ThreadPolicy());
+        ~TaskScheduler();
+
+        TaskScheduler(const TaskScheduler &) = delete;
+        TaskScheduler &operator=(const TaskScheduler &) = delete;
+
+        // dependencies[i] lists the tasks that have to finish before task i,
+        // call it from the thread that calls run()
+        void setGraph(const std::vector<std::vector<int>> &dependencies);
+
+        // runs every task once and returns when all of them are done
+        void run(TaskRunner *runner);
+
+        int getThreadCount() const;
+};
+
+#endif
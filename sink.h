@@ -0,0 +1,47 @@
+#ifndef __SINK_H
+#define __SINK_H
+
+#include <stdint.h>
+
+#include "audio.h"
+
+// rate the feed functions hand samples to a sink at
+inline int renderRate(const AudioConfig &config) {
+    return config.renderRate > 0 ? config.renderRate : config.sampleRate;
+}
+
+// The push API the feed functions use, implemented by the OpenAL renderer
+// and by the offline renderer that writes to a file instead. Samples are
+// either pushed as whole frames or written straight into blocks acquired
+// from the sink.
+class AudioSink {
+    public:
+        virtual ~AudioSink() {}
+
+        virtual const AudioConfig &getConfig() = 0;
+        virtual double getOutputLatency() = 0;
+
+        virtual void pushFrame(const int16_t *samples, int sampleCount, int sampleRate, int channelCount) = 0;
+        virtual void pushFrame(const float *samples, int sampleCount, int sampleRate, int channelCount) = 0;
+
+        // blocks of frames * channelCount samples in the configured format,
+        // usesFloatOutput() says which of the two acquire functions to use.
+        // Only one block is out at a time, an acquire before the last block
+        // was committed or released returns NULL.
+        virtual bool usesFloatOutput() = 0;
+        virtual int16_t *acquireWriteBlock(int frames) = 0;
+        virtual float *acquireFloatWriteBlock(int frames) = 0;
+        virtual void commitWriteBlock() = 0;
+
+        // gives the block back without playing it
+        virtual void releaseWriteBlock() = 0;
+
+        virtual int64_t getSamplePosition() = 0;
+        virtual double getSecondsPlayed() = 0;
+        virtual void resetSecondsPlayed() = 0;
+
+        // samples pushed but not played yet
+        virtual int getBufferSize() = 0;
+};
+
+#endif
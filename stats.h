@@ -0,0 +1,104 @@
+#ifndef __STATS_H
+#define __STATS_H
+
+#include <atomic>
+
+#include <limits.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "audio.h"
+
+// Counters for the runtime statistics of the renderer. Every update is a
+// relaxed atomic operation so they are cheap enough to leave on, readers on
+// other threads get values that are each consistent but may be a few updates
+// apart from each other.
+
+inline int64_t monotonicNanoseconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// Durations in power of two buckets of microseconds, laid out like the
+// histograms in AudioStats.
+class DurationHistogram {
+    private:
+        std::atomic<int64_t> buckets[AUDIO_HISTOGRAM_BUCKETS];
+    public:
+        DurationHistogram() {
+            reset();
+        }
+
+        void record(int64_t nanoseconds) {
+            int64_t microseconds = nanoseconds / 1000;
+
+            int bucket = 0;
+            while (bucket < AUDIO_HISTOGRAM_BUCKETS - 1 && (microseconds >> bucket) > 0) {
+                ++bucket;
+            }
+
+            buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void read(long long *counts) const {
+            for (int i=0; i<AUDIO_HISTOGRAM_BUCKETS; ++i) {
+                counts[i] = buckets[i].load(std::memory_order_relaxed);
+            }
+        }
+
+        void reset() {
+            for (int i=0; i<AUDIO_HISTOGRAM_BUCKETS; ++i) {
+                buckets[i].store(0, std::memory_order_relaxed);
+            }
+        }
+};
+
+// Minimum, maximum and average of a value that only one thread records.
+class ValueRange {
+    private:
+        std::atomic<int> minimum;
+        std::atomic<int> maximum;
+        std::atomic<int64_t> sum;
+        std::atomic<int64_t> count;
+    public:
+        ValueRange() {
+            reset();
+        }
+
+        void record(int value) {
+            if (value < minimum.load(std::memory_order_relaxed)) {
+                minimum.store(value, std::memory_order_relaxed);
+            }
+            if (value > maximum.load(std::memory_order_relaxed)) {
+                maximum.store(value, std::memory_order_relaxed);
+            }
+
+            sum.fetch_add(value, std::memory_order_relaxed);
+            count.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // all zero until something was recorded
+        void read(int &minimum, int &maximum, double &average) const {
+            int64_t records = count.load(std::memory_order_relaxed);
+            if (records == 0) {
+                minimum = maximum = 0;
+                average = 0.0;
+                return;
+            }
+
+            minimum = this->minimum.load(std::memory_order_relaxed);
+            maximum = this->maximum.load(std::memory_order_relaxed);
+            average = (double)sum.load(std::memory_order_relaxed) / records;
+        }
+
+        void reset() {
+            minimum.store(INT_MAX, std::memory_order_relaxed);
+            maximum.store(INT_MIN, std::memory_order_relaxed);
+            sum.store(0, std::memory_order_relaxed);
+            count.store(0, std::memory_order_relaxed);
+        }
+};
+
+#endif
@@ -0,0 +1,487 @@
+// Regression tests for the native side, none of them need an audio device.
+// Build and run with ./t from the repository root, failed checks are printed
+// and make the exit status nonzero. The status messages of the library, like
+// the ones about damaged graph files, are expected.
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "audio.h"
+#include "graph.h"
+#include "graphfile.h"
+#include "resample.h"
+
+namespace {
+
+const int sampleRate = 44100;
+
+int failures = 0;
+
+void check(bool condition, const char *test, const char *what) {
+    if (!condition) {
+        fprintf(stderr, "FAIL %s: %s\n", test, what);
+        ++failures;
+    }
+}
+
+float maxDifference(const std::vector<float> &a, const std::vector<float> &b) {
+    if (a.size() != b.size()) {
+        return INFINITY;
+    }
+
+    float difference = 0.0f;
+    for (size_t i=0; i<a.size(); ++i) {
+        difference = std::max(difference, fabsf(a[i] - b[i]));
+    }
+
+    return difference;
+}
+
+// a file in TMPDIR or /tmp, removed again by the tests
+std::string temporaryPath(const char *name) {
+    std::string path = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+    return path + "/" + name;
+}
+
+std::vector<char> readFile(const std::string &path) {
+    std::vector<char> data;
+
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file) {
+        char buffer[4096];
+        size_t count;
+        while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+            data.insert(data.end(), buffer, buffer + count);
+        }
+        fclose(file);
+    }
+
+    return data;
+}
+
+void writeFile(const std::string &path, const char *data, size_t size) {
+    FILE *file = fopen(path.c_str(), "wb");
+    if (file) {
+        if (size > 0) {
+            fwrite(data, 1, size, file);
+        }
+        fclose(file);
+    }
+}
+
+// collects whatever the output device gets
+class CollectSink : public SampleSink {
+    public:
+        std::vector<float> samples;
+
+        void write(const float *input, size_t count) {
+            samples.insert(samples.end(), input, input + count);
+        }
+};
+
+// renders frames in pieces of at most count and collects what the given
+// buffer holds after each of them
+void renderBuffer(AudioGraph &graph, int buffer, size_t frames, size_t count, std::vector<float> &output) {
+    for (size_t done=0; done<frames;) {
+        size_t frameCount = std::min(count, frames - done);
+        graph.render(frameCount);
+
+        const float *samples = graph.getBuffer(buffer);
+        output.insert(output.end(), samples, samples + frameCount);
+        done += frameCount;
+    }
+}
+
+// two oscillators, the first one through a low pass, into a combiner that
+// writes buffer 3
+AudioGraph *createAutomationGraph(int threadCount) {
+    AudioGraph *graph = new AudioGraph(sampleRate, 256);
+
+    int oscillator = graph->addNode(AUDIO_NODE_OSCILLATOR);
+    int lowPass = graph->addNode(AUDIO_NODE_LOW_PASS);
+    int second = graph->addNode(AUDIO_NODE_OSCILLATOR);
+    int combiner = graph->addNode(AUDIO_NODE_COMBINER);
+
+    graph->setParam(oscillator, AUDIO_PARAM_FREQUENCY, 440.0);
+    graph->setParam(second, AUDIO_PARAM_FREQUENCY, 220.0);
+
+    graph->setOutput(oscillator, 0);
+    graph->setInput(lowPass, 0, 0);
+    graph->setOutput(lowPass, 1);
+    graph->setOutput(second, 2);
+    graph->setInput(combiner, 0, 1);
+    graph->setInput(combiner, 1, 2);
+    graph->setOutput(combiner, 3);
+
+    graph->setThreadCount(threadCount);
+    return graph;
+}
+
+// scheduled changes land on their exact frame, the same as rendering up to
+// the frame and setting the parameter there
+void testAutomationTiming() {
+    const char *test = "automation timing";
+    const size_t frames = 4096;
+
+    for (int threadCount : {1, 3}) {
+        std::unique_ptr<AudioGraph> scheduled(createAutomationGraph(threadCount));
+        check(scheduled->scheduleParam(0, AUDIO_PARAM_FREQUENCY, 880.0, 1000, 0, AUDIO_RAMP_LINEAR), test, "frequency change accepted");
+        check(scheduled->scheduleParam(1, AUDIO_PARAM_CUTOFF, 300.0, 1000, 0, AUDIO_RAMP_LINEAR), test, "cutoff change accepted");
+        check(scheduled->scheduleParam(3, AUDIO_PARAM_SECOND_LEVEL, 0.25, 1003, 0, AUDIO_RAMP_LINEAR), test, "level change accepted");
+
+        std::vector<float> output;
+        renderBuffer(*scheduled, 3, frames, 256, output);
+        check(scheduled->getPosition() == (int64_t)frames, test, "clock follows the frames rendered");
+
+        std::unique_ptr<AudioGraph> manual(createAutomationGraph(threadCount));
+        std::vector<float> expected;
+        renderBuffer(*manual, 3, 1000, 256, expected);
+        manual->setParam(0, AUDIO_PARAM_FREQUENCY, 880.0);
+        manual->setParam(1, AUDIO_PARAM_CUTOFF, 300.0);
+        renderBuffer(*manual, 3, 3, 256, expected);
+        manual->setParam(3, AUDIO_PARAM_SECOND_LEVEL, 0.25);
+        renderBuffer(*manual, 3, frames - 1003, 256, expected);
+
+        check(maxDifference(output, expected) == 0.0f, test, "changes land on their frame");
+    }
+
+    // a ramp ends on its target, a later change cancels it
+    std::unique_ptr<AudioGraph> ramped(createAutomationGraph(1));
+    ramped->scheduleParam(3, AUDIO_PARAM_FIRST_LEVEL, 0.0, 512, 1024, AUDIO_RAMP_LINEAR);
+    ramped->scheduleParam(3, AUDIO_PARAM_SECOND_LEVEL, 0.5, 0, 4096, AUDIO_RAMP_LINEAR);
+    ramped->scheduleParam(3, AUDIO_PARAM_SECOND_LEVEL, 0.01, 2048, 0, AUDIO_RAMP_LINEAR);
+
+    std::unique_ptr<AudioGraph> settled(createAutomationGraph(1));
+    settled->setParam(3, AUDIO_PARAM_FIRST_LEVEL, 0.0);
+    settled->setParam(3, AUDIO_PARAM_SECOND_LEVEL, 0.01);
+
+    std::vector<float> output, expected;
+    renderBuffer(*ramped, 3, 3072, 256, output);
+    renderBuffer(*settled, 3, 3072, 256, expected);
+
+    output.erase(output.begin(), output.begin() + 2048);
+    expected.erase(expected.begin(), expected.begin() + 2048);
+    check(maxDifference(output, expected) < 1e-6f, test, "ramps end on their target");
+}
+
+// Oscillators into mixer -> delay -> combiner and low pass -> delay -> low
+// pass chains that fuse, the last low pass writes buffer 7. Blocking adds
+// mixers reading the intermediate buffers, which keeps both chains from
+// forming.
+AudioGraph *createFusionGraph(bool blockFusion, int threadCount, size_t blockSize) {
+    AudioGraph *graph = new AudioGraph(sampleRate, blockSize);
+
+    int oscillator = graph->addNode(AUDIO_NODE_OSCILLATOR);
+    int modulator = graph->addNode(AUDIO_NODE_OSCILLATOR);
+    int mixer = graph->addNode(AUDIO_NODE_MIXER);
+    int delay = graph->addNode(AUDIO_NODE_DELAY);
+    int combiner = graph->addNode(AUDIO_NODE_COMBINER);
+    int lowPass = graph->addNode(AUDIO_NODE_LOW_PASS);
+    int shortDelay = graph->addNode(AUDIO_NODE_DELAY);
+    int lastLowPass = graph->addNode(AUDIO_NODE_LOW_PASS);
+
+    graph->setParam(oscillator, AUDIO_PARAM_FREQUENCY, 300.0);
+    graph->setParam(oscillator, AUDIO_PARAM_WAVEFORM, AUDIO_WAVEFORM_SAW);
+    graph->setParam(modulator, AUDIO_PARAM_FREQUENCY, 3.0);
+    graph->setParam(delay, AUDIO_PARAM_DELAY, 0.004);
+    graph->setParam(combiner, AUDIO_PARAM_FIRST_LEVEL, 0.5);
+    graph->setParam(shortDelay, AUDIO_PARAM_DELAY, 0.0001);
+    graph->setParam(lastLowPass, AUDIO_PARAM_CUTOFF, 3000.0);
+
+    graph->setOutput(oscillator, 0);
+    graph->setOutput(modulator, 1);
+    graph->setInput(mixer, 0, 0);
+    graph->setInput(mixer, 2, 1);
+    graph->setOutput(mixer, 2);
+    graph->setInput(delay, 0, 2);
+    graph->setOutput(delay, 3);
+    graph->setInput(combiner, 0, 3);
+    graph->setInput(combiner, 1, 1);
+    graph->setOutput(combiner, 4);
+    graph->setInput(lowPass, 0, 4);
+    graph->setOutput(lowPass, 5);
+    graph->setInput(shortDelay, 0, 5);
+    graph->setOutput(shortDelay, 6);
+    graph->setInput(lastLowPass, 0, 6);
+    graph->setOutput(lastLowPass, 7);
+
+    if (blockFusion) {
+        for (int buffer : {2, 5}) {
+            int reader = graph->addNode(AUDIO_NODE_MIXER);
+            graph->setInput(reader, 0, buffer);
+            graph->setInput(reader, 1, buffer + 1);
+            graph->setOutput(reader, 8);
+        }
+    }
+
+    graph->setThreadCount(threadCount);
+    return graph;
+}
+
+// fused chains give exactly the samples of the nodes run one by one, also
+// around scheduled changes, which run a chain unfused for a block
+void testFusion() {
+    const char *test = "fusion";
+    const size_t frames = 20000;
+
+    for (int threadCount : {1, 2}) {
+        for (size_t blockSize : {64, 256}) {
+            std::unique_ptr<AudioGraph> fused(createFusionGraph(false, threadCount, blockSize));
+            std::unique_ptr<AudioGraph> separate(createFusionGraph(true, threadCount, blockSize));
+
+            for (AudioGraph *graph : {fused.get(), separate.get()}) {
+                graph->scheduleParam(3, AUDIO_PARAM_DELAY, 0.002, 3000, 0, AUDIO_RAMP_LINEAR);
+                graph->scheduleParam(5, AUDIO_PARAM_CUTOFF, 600.0, 7000, 0, AUDIO_RAMP_LINEAR);
+                graph->scheduleParam(4, AUDIO_PARAM_SECOND_LEVEL, 0.2, 9000, 0, AUDIO_RAMP_LINEAR);
+            }
+
+            std::vector<float> output, expected;
+            renderBuffer(*fused, 7, frames, blockSize, output);
+            renderBuffer(*separate, 7, frames, blockSize, expected);
+            check(maxDifference(output, expected) == 0.0f, test, "fused output equals unfused");
+
+            // the delays run inside the chains, so their buffers are never
+            // written when fused
+            fused->render(blockSize);
+            separate->render(blockSize);
+            check(fused->getBuffer(3)[1] != separate->getBuffer(3)[1], test, "mixer -> delay -> combiner fuses");
+            check(fused->getBuffer(6)[1] != separate->getBuffer(6)[1], test, "low pass -> delay -> low pass fuses");
+        }
+    }
+}
+
+// no call of the converter writes more than maxOutputFrames() promises,
+// whatever the sizes of the calls, and over a stream the frame count stays
+// at the rate ratio
+void testResamplerBound() {
+    const char *test = "resampler bound";
+    const int chunkSizes[] = {1, 7, 256, 1023, 333, 2};
+    const int chunkCount = sizeof(chunkSizes) / sizeof(chunkSizes[0]);
+    const int rates[][2] = {{48000, 44100}, {44100, 48000}, {22050, 44100}, {88200, 44100}, {96000, 44100}, {44100, 44101}};
+
+    for (int quality=AUDIO_RESAMPLE_LINEAR; quality<=AUDIO_RESAMPLE_BEST; ++quality) {
+        for (const int *pair : rates) {
+            for (int channelCount : {1, 2}) {
+                int inputRate = pair[0];
+                int outputRate = pair[1];
+
+                FormatConverter converter;
+                converter.setOutputFormat(outputRate, channelCount);
+                converter.setQuality(quality);
+
+                const int frames = inputRate;
+                std::vector<float> input(frames * channelCount);
+                for (int i=0; i<frames; ++i) {
+                    for (int c=0; c<channelCount; ++c) {
+                        input[i * channelCount + c] = 0.5f * (float)sin(2.0 * M_PI * 1000.0 * i / inputRate);
+                    }
+                }
+
+                bool bounded = true;
+                long written = 0;
+                for (int done=0, chunk=0; done<frames; ++chunk) {
+                    int inputFrames = std::min(chunkSizes[chunk % chunkCount], frames - done);
+                    int maxFrames = converter.maxOutputFrames(inputFrames, inputRate);
+
+                    // room for more than promised, so an overrun shows in
+                    // the count instead of corrupting the heap
+                    std::vector<float> output((maxFrames * 2 + 64) * channelCount);
+                    int outputFrames = converter.process(&input[done * channelCount], inputFrames, inputRate, channelCount, output.data());
+
+                    bounded = bounded && outputFrames >= 0 && outputFrames <= maxFrames;
+                    written += outputFrames;
+                    done += inputFrames;
+                }
+
+                // linear interpolation waits for the frame after the last
+                // position, which holds back a frame or two at the end
+                double expected = (double)frames * outputRate / inputRate;
+                check(bounded, test, "calls stay within maxOutputFrames");
+                check(written <= expected + 1 && written >= expected - 2, test, "stream length follows the rate ratio");
+            }
+        }
+    }
+}
+
+// every node type with parameters other than the defaults, keys and a
+// sample file, feeding an output device
+AudioGraph *createFileGraph(const char *samplePath) {
+    AudioGraph *graph = new AudioGraph(sampleRate, 256);
+
+    int player = graph->addNode(AUDIO_NODE_SAMPLE_PLAYER);
+    graph->setSampleFile(player, samplePath);
+    graph->setOutput(player, 0);
+
+    int oscillator = graph->addNode(AUDIO_NODE_OSCILLATOR);
+    graph->setParam(oscillator, AUDIO_PARAM_FREQUENCY, 3.5);
+    graph->setParam(oscillator, AUDIO_PARAM_WAVEFORM, AUDIO_WAVEFORM_SAW);
+    graph->setOutput(oscillator, 1);
+
+    int bank = graph->addNode(AUDIO_NODE_FILTER_BANK);
+    graph->setParam(bank, AUDIO_PARAM_SECTIONS, 5);
+    for (int band=0; band<5; ++band) {
+        graph->setParam(bank, AUDIO_PARAM_BAND_CUTOFF(band), 200.0 * (band + 1));
+        graph->setParam(bank, AUDIO_PARAM_BAND_GAIN(band), 0.1 * (band + 1));
+    }
+    graph->setInput(bank, 0, 0);
+    graph->setOutput(bank, 2);
+
+    int cascade = graph->addNode(AUDIO_NODE_LOW_PASS_CASCADE);
+    graph->setParam(cascade, AUDIO_PARAM_SECTIONS, 3);
+    graph->setParam(cascade, AUDIO_PARAM_CUTOFF, 3000.0);
+    graph->setInput(cascade, 0, 2);
+    graph->setOutput(cascade, 3);
+
+    int modulated = graph->addNode(AUDIO_NODE_MODULATED_DELAY);
+    graph->setParam(modulated, AUDIO_PARAM_DELAY, 0.01);
+    graph->setParam(modulated, AUDIO_PARAM_DEPTH, 0.003);
+    graph->setInput(modulated, 0, 3);
+    graph->setInput(modulated, 1, 1);
+    graph->setOutput(modulated, 4);
+
+    int lowPass = graph->addNode(AUDIO_NODE_LOW_PASS);
+    graph->setParam(lowPass, AUDIO_PARAM_CUTOFF, 900.0);
+    graph->setInput(lowPass, 0, 0);
+    graph->setOutput(lowPass, 5);
+
+    int mixer = graph->addNode(AUDIO_NODE_MIXER);
+    graph->setInput(mixer, 0, 4);
+    graph->setInput(mixer, 1, 5);
+    graph->setInput(mixer, 2, 1);
+    graph->setOutput(mixer, 0);
+
+    int delay = graph->addNode(AUDIO_NODE_DELAY);
+    graph->setParam(delay, AUDIO_PARAM_DELAY, 0.2);
+    graph->setInput(delay, 0, 0);
+    graph->setOutput(delay, 1);
+
+    int combiner = graph->addNode(AUDIO_NODE_COMBINER);
+    graph->setParam(combiner, AUDIO_PARAM_FIRST_LEVEL, 0.9);
+    graph->setParam(combiner, AUDIO_PARAM_SECOND_LEVEL, 0.6);
+    graph->setInput(combiner, 0, 0);
+    graph->setInput(combiner, 1, 1);
+    graph->setOutput(combiner, 2);
+
+    int output = graph->addNode(AUDIO_NODE_OUTPUT_DEVICE);
+    graph->setInput(output, 0, 2);
+
+    for (int node=0; node<graph->getNodeCount(); ++node) {
+        graph->setNodeKey(node, 100 + node);
+    }
+
+    return graph;
+}
+
+// a saved graph loads into one that renders the same samples, and damaged
+// files are refused instead of being read out of bounds
+void testGraphFile() {
+    const char *test = "graph file";
+    const size_t frames = 20000;
+
+    std::string samplePath = temporaryPath("tests_samples.f32");
+    std::vector<float> samples(10007);
+    for (size_t i=0; i<samples.size(); ++i) {
+        samples[i] = (float)sin(i * 0.05) * 0.5f;
+    }
+    writeFile(samplePath, (const char *)samples.data(), samples.size() * sizeof(float));
+
+    std::string path = temporaryPath("tests_graph.agrf");
+    std::unique_ptr<AudioGraph> original(createFileGraph(samplePath.c_str()));
+    check(saveGraphFile(*original, path.c_str()), test, "graph saves");
+
+    std::unique_ptr<AudioGraph> loaded(loadGraphFile(path.c_str()));
+    check(loaded != nullptr, test, "saved graph loads");
+
+    if (loaded) {
+        check(loaded->getNodeCount() == original->getNodeCount(), test, "node count survives");
+        check(loaded->getSampleRate() == original->getSampleRate() && loaded->getBlockSize() == original->getBlockSize(), test, "format survives");
+
+        bool keys = true;
+        for (int node=0; node<original->getNodeCount(); ++node) {
+            keys = keys && loaded->getNodeKey(node) == original->getNodeKey(node);
+        }
+        check(keys, test, "keys survive");
+
+        CollectSink originalSink, loadedSink;
+        original->setSink(&originalSink);
+        loaded->setSink(&loadedSink);
+        original->render(frames);
+        loaded->render(frames);
+        original->setSink(nullptr);
+        loaded->setSink(nullptr);
+
+        check(originalSink.samples.size() == frames && maxDifference(originalSink.samples, loadedSink.samples) == 0.0f, test, "loaded graph renders the same samples");
+    }
+
+    // offsets in the layout of graphfile.cpp: a 32 byte header with the
+    // version at 4 and the node count at 16, then 40 byte nodes with the
+    // output at 20
+    const size_t versionOffset = 4;
+    const size_t nodeCountOffset = 16;
+    const size_t firstOutputOffset = 32 + 20;
+
+    std::vector<char> data = readFile(path);
+    std::string damagedPath = temporaryPath("tests_damaged.agrf");
+
+    auto refused = [&](const std::vector<char> &damaged) {
+        writeFile(damagedPath, damaged.data(), damaged.size());
+        std::unique_ptr<AudioGraph> graph(loadGraphFile(damagedPath.c_str()));
+        return graph == nullptr;
+    };
+
+    auto withValue = [&](size_t offset, uint32_t value) {
+        std::vector<char> damaged(data);
+        memcpy(&damaged[offset], &value, sizeof(value));
+        return damaged;
+    };
+
+    check(data.size() > firstOutputOffset, test, "file has a node");
+    if (data.size() > firstOutputOffset) {
+        bool truncated = true;
+        for (size_t size : {(size_t)0, (size_t)16, (size_t)32, data.size() / 2, data.size() - 1}) {
+            truncated = truncated && refused(std::vector<char>(data.begin(), data.begin() + size));
+        }
+        check(truncated, test, "truncated files are refused");
+
+        std::vector<char> badMagic(data);
+        badMagic[0] = 'X';
+        check(refused(badMagic), test, "wrong magic is refused");
+
+        check(refused(withValue(versionOffset, 0xffffffffu)), test, "other versions are refused");
+        check(refused(withValue(nodeCountOffset, 0x7ffffff0u)), test, "node counts past the end are refused");
+        check(refused(withValue(firstOutputOffset, 0x7ffffff0u)), test, "buffers out of range are refused");
+
+        std::vector<char> unterminated(data);
+        unterminated.back() = 'x';
+        check(refused(unterminated), test, "unterminated sample paths are refused");
+    }
+
+    remove(damagedPath.c_str());
+    remove(path.c_str());
+    remove(samplePath.c_str());
+}
+
+}
+
+int main() {
+    testAutomationTiming();
+    testFusion();
+    testResamplerBound();
+    testGraphFile();
+
+    if (failures) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+
+    printf("all tests passed\n");
+    return 0;
+}
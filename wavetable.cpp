@@ -0,0 +1,198 @@
+#include <algorithm>
+#include <vector>
+
+#include <math.h>
+
+#include "audio.h"
+#include "wavetable.h"
+
+namespace {
+
+// tables hold 1, 2, 4 up to 1024 harmonics
+const int levelCount = 11;
+const int maxHarmonics = 1 << (levelCount - 1);
+
+// every table has at least 4096 samples and 32 per cycle of its highest
+// harmonic, otherwise linear interpolation smears the top harmonics
+const int minimumBits = 12;
+const int maxBits = 15;
+
+int levelBits(int level) {
+    return std::max(minimumBits, level + 5);
+}
+
+// every table has a copy of its first sample at the end, so interpolation
+// never has to wrap
+struct SineTable {
+    std::vector<float> samples;
+
+    SineTable();
+};
+
+SineTable::SineTable() : samples((1 << minimumBits) + 1) {
+    for (size_t i=0; i<samples.size(); ++i) {
+        samples[i] = (float)sin(2.0 * M_PI * (double)i / (1 << minimumBits));
+    }
+}
+
+struct BandLimitedTables {
+    std::vector<float> saw[levelCount];
+    std::vector<float> square[levelCount];
+
+    BandLimitedTables();
+};
+
+BandLimitedTables::BandLimitedTables() {
+    std::vector<double> reciprocals(maxHarmonics + 1);
+    for (int k=1; k<=maxHarmonics; ++k) {
+        reciprocals[k] = 1.0 / k;
+    }
+
+    for (int level=0; level<levelCount; ++level) {
+        saw[level].resize((1 << levelBits(level)) + 1);
+        square[level].resize((1 << levelBits(level)) + 1);
+    }
+
+    // all levels are sampled from one grid fine enough for the largest, adds
+    // one harmonic after another with sin(kx) = 2 cos(x) sin((k-1)x) - sin((k-2)x)
+    // and keeps the partial sums whenever the count reaches the next level
+    const size_t gridSize = 1 << maxBits;
+    for (size_t i=0; i<=gridSize; ++i) {
+        double x = 2.0 * M_PI * (double)(i % gridSize) / gridSize;
+
+        double twoCos = 2.0 * cos(x);
+        double previous = 0.0;
+        double current = sin(x);
+
+        double sawSum = 0.0;
+        double squareSum = 0.0;
+
+        int level = 0;
+        for (int k=1; k<=maxHarmonics; ++k) {
+            double term = current * reciprocals[k];
+            sawSum += term;
+            if (k & 1) {
+                squareSum += term;
+            }
+
+            if (k == 1 << level) {
+                size_t stride = (size_t)1 << (maxBits - levelBits(level));
+                if (i % stride == 0) {
+                    saw[level][i / stride] = (float)(-2.0 / M_PI * sawSum);
+                    square[level][i / stride] = (float)(4.0 / M_PI * squareSum);
+                }
+                ++level;
+            }
+
+            double next = twoCos * current - previous;
+            previous = current;
+            current = next;
+        }
+    }
+}
+
+// shared by all oscillators and built along with the first one, the
+// band-limited tables take about 100 ms which mustn't happen on the render
+// thread when a waveform changes
+const SineTable &sineTable() {
+    static SineTable instance;
+    return instance;
+}
+
+const BandLimitedTables &bandLimitedTables() {
+    static BandLimitedTables instance;
+    return instance;
+}
+
+}
+
+WavetableOscillator::WavetableOscillator(int sampleRate) : sampleRate(sampleRate), waveform(AUDIO_WAVEFORM_SINE) {
+    bandLimitedTables();
+
+    reset();
+    setFrequency(440.0);
+}
+
+void WavetableOscillator::selectTable() {
+    if (waveform == AUDIO_WAVEFORM_SINE) {
+        table = sineTable().samples.data();
+        tableBits = minimumBits;
+        return;
+    }
+
+    double allowed = frequency != 0.0 ? 0.5 * sampleRate / fabs(frequency) : maxHarmonics;
+
+    int level = 0;
+    while (level < levelCount - 1 && (double)(2 << level) <= allowed) {
+        ++level;
+    }
+
+    const BandLimitedTables &all = bandLimitedTables();
+    table = waveform == AUDIO_WAVEFORM_SAW ? all.saw[level].data() : all.square[level].data();
+    tableBits = levelBits(level);
+}
+
+void WavetableOscillator::setFrequency(double frequency) {
+    this->frequency = frequency;
+
+    // fraction of a cycle per sample, negative frequencies wrap around to
+    // the same phase steps backwards
+    double cycles = frequency / sampleRate;
+    cycles -= floor(cycles);
+
+    // tiny negative frequencies round up to a whole cycle, which is no step
+    // at all and wouldn't fit the 64 bits
+    increment = cycles < 1.0 ? (uint64_t)ldexp(cycles, 64) : 0;
+
+    selectTable();
+}
+
+double WavetableOscillator::getFrequency() const {
+    return frequency;
+}
+
+bool WavetableOscillator::setWaveform(int waveform) {
+    if (waveform != AUDIO_WAVEFORM_SINE && waveform != AUDIO_WAVEFORM_SAW && waveform != AUDIO_WAVEFORM_SQUARE) {
+        return false;
+    }
+
+    this->waveform = waveform;
+    selectTable();
+
+    return true;
+}
+
+int WavetableOscillator::getWaveform() const {
+    return waveform;
+}
+
+void WavetableOscillator::reset() {
+    phase = 0;
+}
+
+void WavetableOscillator::copyPhase(const WavetableOscillator &other) {
+    phase = other.phase;
+}
+
+void WavetableOscillator::process(float *output, size_t frames) {
+    const float *samples = table;
+    int indexShift = 64 - tableBits;
+    int fractionShift = 32 - tableBits;
+
+    uint64_t position = phase;
+    uint64_t step = increment;
+
+    // the top bits index the table, the next 32 are the interpolation fraction
+    for (size_t i=0; i<frames; ++i) {
+        size_t index = (size_t)(position >> indexShift);
+        float fraction = (float)(uint32_t)(position >> fractionShift) * (1.0f / 4294967296.0f);
+
+        float first = samples[index];
+        float second = samples[index + 1];
+        output[i] = first + (second - first) * fraction;
+
+        position += step;
+    }
+
+    phase = position;
+}
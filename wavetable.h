@@ -0,0 +1,45 @@
+#ifndef __WAVETABLE_H
+#define __WAVETABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Oscillator reading single cycle tables with linear interpolation. The
+// phase is a wrapping 64 bit fraction of a cycle, so it stays exact no matter
+// how long the oscillator runs. Saw and square tables are band-limited, each
+// frequency picks the table with as many harmonics as fit below Nyquist,
+// rounded down to a power of two, same as Oscillator in main.py. The tables
+// are built once per process when the first oscillator is created, so
+// changing the waveform later never computes anything.
+class WavetableOscillator {
+    private:
+        int sampleRate;
+        int waveform;
+        double frequency;
+
+        const float *table;
+        int tableBits;
+        uint64_t phase;
+        uint64_t increment;
+
+        void selectTable();
+    public:
+        WavetableOscillator(int sampleRate);
+
+        // the frequency can change while running without a jump in phase
+        void setFrequency(double frequency);
+        double getFrequency() const;
+
+        // one of AUDIO_WAVEFORM_*, returns false for unknown waveforms
+        bool setWaveform(int waveform);
+        int getWaveform() const;
+
+        void reset();
+
+        // continues at the phase of another oscillator
+        void copyPhase(const WavetableOscillator &other);
+
+        void process(float *output, size_t frames);
+};
+
+#endif